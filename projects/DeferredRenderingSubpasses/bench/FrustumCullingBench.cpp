@@ -0,0 +1,88 @@
+/*
+	Measures FrustumCuller at 10k, 100k and 1M instances with every SIMD level compiled in,
+	and checks each level against the scalar loop.
+
+	Instances are spheres scattered through a cube the camera looks into from one face,
+	so roughly a third of them survive. Build with ENABLE_AVX2 to include the AVX2 path.
+
+	Usage: FrustumCullingBench [repetitions, default 100]
+*/
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "FrustumCuller.h"
+
+// std
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static bool benchInstances(uint32_t instanceCount, uint32_t repetitions, const Frustum& frustum)
+{
+	std::mt19937 random(instanceCount);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+	FrustumCuller culler;
+	culler.resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		culler.setSphere(i, glm::vec3(position(random), position(random), position(random)), size(random));
+	}
+
+	std::vector<uint32_t> referenceIndices;
+	uint32_t referenceCount = culler.cull(frustum, referenceIndices, FrustumCuller::SIMD_SCALAR);
+	referenceIndices.resize(referenceCount);
+
+	std::cout << "Bench >> " << instanceCount << " instances, " << referenceCount << " visible" << std::endl;
+
+	bool isMatching = true;
+	for (int level = FrustumCuller::SIMD_SCALAR; level <= FrustumCuller::getSimdLevel(); level++) {
+		FrustumCuller::SIMD_LEVEL simdLevel = static_cast<FrustumCuller::SIMD_LEVEL>(level);
+		std::vector<uint32_t> visibleIndices;
+
+		// Once to grow visibleIndices, so the timed runs do not allocate
+		uint32_t visibleCount = culler.cull(frustum, visibleIndices, simdLevel);
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < repetitions; i++) {
+			visibleCount = culler.cull(frustum, visibleIndices, simdLevel);
+		}
+		auto endTime = std::chrono::high_resolution_clock::now();
+		float cullTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count() / repetitions;
+
+		visibleIndices.resize(visibleCount);
+		bool isSame = visibleIndices == referenceIndices;
+		isMatching = isMatching && isSame;
+
+		printf("    %-7s %8.4f ms, %10.0f instances/ms%s\n", FrustumCuller::getSimdName(simdLevel), cullTime, instanceCount / cullTime, isSame ? "" : "  MISMATCH");
+	}
+
+	return isMatching;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t repetitions = argc > 1 ? std::max(1, atoi(argv[1])) : 100;
+
+	// Camera on the -Z face of the cube, looking through it
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -110.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+	projection[1][1] *= -1;
+	Frustum frustum(projection * view);
+
+	std::cout << "Bench >> best SIMD level " << FrustumCuller::getSimdName(FrustumCuller::getSimdLevel()) << std::endl;
+
+	bool isMatching = true;
+	for (uint32_t instanceCount : { 10000u, 100000u, 1000000u }) {
+		isMatching = benchInstances(instanceCount, repetitions, frustum) && isMatching;
+	}
+
+	return isMatching ? EXIT_SUCCESS : EXIT_FAILURE;
+}
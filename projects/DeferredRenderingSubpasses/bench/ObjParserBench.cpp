@@ -0,0 +1,175 @@
+/*
+	Compares ObjParser against the tinyobj path Model used before on the bundled models
+	and on generated grids with millions of triangles.
+
+	Usage: ObjParserBench [triangle count in millions, default 2]
+*/
+
+#include "ObjParser.h"
+
+// std
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tinyobjloader/tiny_obj_loader.h>
+
+static void loadTinyObj(const std::string& modelPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelPath.c_str())) {
+		throw std::runtime_error("ERROR: cannot read model \"" + modelPath + "\".");
+	}
+
+	std::unordered_map<Vertex, uint32_t> uniqueVertices;
+
+	for (const auto& shape : shapes) {
+		for (const auto& index : shape.mesh.indices) {
+			Vertex vertex = {};
+
+			vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
+			vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
+			vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
+
+			if (index.texcoord_index >= 0) {
+				vertex.texCoord.x = attrib.texcoords[2 * index.texcoord_index + 0];
+				vertex.texCoord.y = 1 - attrib.texcoords[2 * index.texcoord_index + 1];
+			}
+
+			if (index.normal_index >= 0) {
+				vertex.norm.x = attrib.normals[3 * index.normal_index + 0];
+				vertex.norm.y = attrib.normals[3 * index.normal_index + 1];
+				vertex.norm.z = attrib.normals[3 * index.normal_index + 2];
+			}
+
+			auto it = uniqueVertices.find(vertex);
+			if (it == uniqueVertices.end()) {
+				it = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size())).first;
+				vertices.push_back(vertex);
+			}
+
+			indices.push_back(it->second);
+		}
+	}
+}
+
+static std::string writeGrid(uint32_t triangleMillions)
+{
+	/*
+		Square grid of quads, written as "f" records with relative indices every other row
+		so both index forms are exercised.
+	*/
+	uint32_t side = 1;
+	while (2ull * side * side < triangleMillions * 1000000ull) {
+		side++;
+	}
+
+	std::string path = "grid_" + std::to_string(triangleMillions) + "M.obj";
+	std::ofstream file(path);
+
+	for (uint32_t y = 0; y <= side; y++) {
+		for (uint32_t x = 0; x <= side; x++) {
+			file << "v " << float(x) / side << " " << 0.1f * ((x ^ y) & 7) << " " << float(y) / side << "\n";
+			file << "vt " << float(x) / side << " " << float(y) / side << "\n";
+		}
+	}
+	file << "vn 0 1 0\n";
+
+	uint32_t rowSize = side + 1;
+	int64_t vertexTotal = int64_t(rowSize) * rowSize;
+	for (uint32_t y = 0; y < side; y++) {
+		for (uint32_t x = 0; x < side; x++) {
+			int64_t a = int64_t(y) * rowSize + x + 1;
+			int64_t b = a + 1;
+			int64_t c = a + rowSize + 1;
+			int64_t d = a + rowSize;
+
+			if (y % 2) {
+				a -= vertexTotal + 1; b -= vertexTotal + 1; c -= vertexTotal + 1; d -= vertexTotal + 1;
+				file << "f " << a << "/" << a << "/-1 " << b << "/" << b << "/-1 " << c << "/" << c << "/-1 " << d << "/" << d << "/-1\n";
+			}
+			else {
+				file << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+			}
+		}
+	}
+
+	return path;
+}
+
+template<typename Function>
+static float measure(Function function)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	function();
+	auto endTime = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+}
+
+static bool benchModel(const std::string& modelPath)
+{
+	std::vector<Vertex> referenceVertices;
+	std::vector<uint32_t> referenceIndices;
+	float tinyObjTime = measure([&]() { loadTinyObj(modelPath, referenceVertices, referenceIndices); });
+
+	std::cout << "Bench >> \"" << modelPath << "\" " << referenceIndices.size() / 3 << " triangles, "
+		<< referenceVertices.size() << " unique vertices" << std::endl;
+	std::cout << "    tinyobj       " << tinyObjTime << " ms" << std::endl;
+
+	bool isMatching = true;
+	uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	for (uint32_t threads : threadCounts) {
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		float parseTime = measure([&]() {
+			ObjParser parser(modelPath, threads);
+			vertices = std::move(parser.getVertices());
+			indices = std::move(parser.getIndices());
+		});
+
+		bool isSame = vertices == referenceVertices && indices == referenceIndices;
+		isMatching = isMatching && isSame;
+
+		printf("    ObjParser x%-2u %g ms (%.2fx)%s\n", threads, parseTime, tinyObjTime / parseTime, isSame ? "" : "  MISMATCH");
+	}
+
+	return isMatching;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t triangleMillions = argc > 1 ? std::max(1, atoi(argv[1])) : 2;
+
+	bool isMatching = true;
+
+	try {
+		isMatching = benchModel(MODELS_DIR "head.obj") && isMatching;
+		isMatching = benchModel(MODELS_DIR "room.obj") && isMatching;
+
+		std::string gridPath = writeGrid(triangleMillions);
+		isMatching = benchModel(gridPath) && isMatching;
+		std::remove(gridPath.c_str());
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return isMatching ? EXIT_SUCCESS : EXIT_FAILURE;
+}
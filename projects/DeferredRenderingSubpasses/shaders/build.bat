@@ -1,6 +1,16 @@
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe phong.vert -o phong_vert.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DPACKED_VERTEX phong.vert -o phong_packed_vert.spv
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe phong.frag -o phong_frag.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DGBUFFER_OCTAHEDRAL phong.frag -o phong_octahedral_frag.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DGBUFFER_PACKED phong.frag -o phong_packed_gbuffer_frag.spv
 
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe second.vert -o second_vert.spv
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe second.frag -o second_frag.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DGBUFFER_OCTAHEDRAL second.frag -o second_octahedral_frag.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DGBUFFER_PACKED second.frag -o second_packed_gbuffer_frag.spv
+
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe cull.comp -o cull_comp.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DOCCLUSION cull.comp -o cull_occlusion_comp.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe compact.comp -o compact_comp.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe depth_pyramid.comp -o depth_pyramid_comp.spv
 pause
\ No newline at end of file
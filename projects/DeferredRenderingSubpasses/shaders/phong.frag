@@ -1,18 +1,46 @@
 #version 450
 
+// Keep in sync with MAX_SCENE_TEXTURES in VulkanRenderer.cpp
+#define MAX_SCENE_TEXTURES 16
+
 layout(location = 0) in vec2 fragTexCoord;
 layout(location = 1) in vec3 fragNorm;
-layout(location = 2) in vec3 fragPosition;
+layout(location = 2) flat in uint fragTextureIndex;
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(binding = 1) uniform sampler2D textures[MAX_SCENE_TEXTURES];
 
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec4 outNorm;
-layout(location = 2) out vec4 outPosition;
+
+#if defined(GBUFFER_OCTAHEDRAL) || defined(GBUFFER_PACKED)
+// Keep in sync with decodeOctahedral in second.frag
+vec2 encodeOctahedral(vec3 norm)
+{
+	norm /= abs(norm.x) + abs(norm.y) + abs(norm.z);
+	vec2 encoded = norm.xy;
+
+	// Fold the lower hemisphere over the diagonals of the square
+	if (norm.z < 0.0f) {
+		encoded = (1.0f - abs(norm.yx)) * vec2(norm.x >= 0.0f ? 1.0f : -1.0f, norm.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+#endif
+
+#ifdef GBUFFER_PACKED
+// Nothing in the scene has a roughness of its own yet
+#define DEFAULT_ROUGHNESS 0.5f
+#endif
 
 void main()
 {
-	outColor = texture(texSampler, fragTexCoord);
+	outColor = texture(textures[fragTextureIndex], fragTexCoord);
+#if defined(GBUFFER_OCTAHEDRAL)
+	outNorm = vec4(encodeOctahedral(normalize(fragNorm)), 0.0f, 0.0f);
+#elif defined(GBUFFER_PACKED)
+	// 10 bits per encoded component, 10 bits of roughness and the mesh's 2 bit material ID
+	outNorm = vec4(encodeOctahedral(normalize(fragNorm)) * 0.5f + 0.5f, DEFAULT_ROUGHNESS, float(fragTextureIndex & 3) / 3.0f);
+#else
 	outNorm = vec4(fragNorm, 1.0f);
-	outPosition = vec4(fragPosition, 1.0f);
+#endif
 }
\ No newline at end of file
@@ -1,9 +1,39 @@
 #version 450
 
+#ifdef PACKED_VERTEX
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec2 inNorm;
+
+struct VertexDecode {
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;
+};
+
+// Per mesh, indirect draws render meshes with different bounds in one call
+layout(std430, binding = 2) readonly buffer MeshDecodes {
+    VertexDecode decodes[];
+};
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 norm = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-norm.z, 0.0f);
+    norm.x += norm.x >= 0.0f ? -fold : fold;
+    norm.y += norm.y >= 0.0f ? -fold : fold;
+    return normalize(norm);
+}
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNorm;
+#endif
+
+// Per-instance transform, one column per location
+layout(location = 4) in mat4 inTransform;
+// Mesh of the instance, picks the texture and the vertex decode
+layout(location = 8) in uint inMeshIndex;
 
 layout(binding = 0) uniform MVP {
     mat4 model;
@@ -13,11 +43,24 @@ layout(binding = 0) uniform MVP {
 
 layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec3 fragNorm;
-layout(location = 2) out vec3 fragPosition;
+layout(location = 2) flat out uint fragTextureIndex;
 
 void main() {
-    fragPosition = vec3(mvp.model * vec4(inPosition, 1.0f));
-    gl_Position = mvp.projection * mvp.view * mvp.model * vec4(inPosition, 1.0f);
-    fragTexCoord = inTexCoord;
-    fragNorm = mat3(mvp.model) * inNorm;
+#ifdef PACKED_VERTEX
+    VertexDecode decode = decodes[inMeshIndex];
+    vec3 position = decode.positionOffset.xyz + decode.positionScale.xyz * inPosition;
+    vec2 texCoord = decode.texCoordScaleOffset.zw + decode.texCoordScaleOffset.xy * inTexCoord;
+    vec3 normal = decodeOctahedral(inNorm);
+#else
+    vec3 position = inPosition;
+    vec2 texCoord = inTexCoord;
+    vec3 normal = inNorm;
+#endif
+
+    mat4 model = mvp.model * inTransform;
+
+    gl_Position = mvp.projection * mvp.view * model * vec4(position, 1.0f);
+    fragTexCoord = texCoord;
+    fragNorm = mat3(model) * normal;
+    fragTextureIndex = inMeshIndex;
 }
\ No newline at end of file
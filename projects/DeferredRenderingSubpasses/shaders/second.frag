@@ -2,20 +2,78 @@
 
 layout(set = 0, input_attachment_index = 0, binding = 0) uniform subpassInput inputColor;
 layout(set = 0, input_attachment_index = 1, binding = 1) uniform subpassInput inputNorm;
-layout(set = 0, input_attachment_index = 2, binding = 2) uniform subpassInput inputPosition;
+layout(set = 0, input_attachment_index = 2, binding = 2) uniform subpassInput inputDepth;
 
-layout(set = 1, binding = 0) uniform Light {
+// Keep in sync with Light::Properties
+struct PointLight {
 	vec3 position;
+	float radius;
 	vec3 color;
-} light;
+	float padding;
+};
+
+// Keep in sync with LightGrid::Info
+layout(set = 1, binding = 0) uniform LightGrid {
+	uint tileSize;
+	uint tileCountX;
+	uint tileCountY;
+	uint lightCount;
+	vec4 ambient;
+} lightGrid;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights {
+	PointLight lights[];
+};
+
+// First light index and light count of every screen tile
+layout(std430, set = 1, binding = 2) readonly buffer Tiles {
+	uvec2 tiles[];
+};
+
+layout(std430, set = 1, binding = 3) readonly buffer LightIndices {
+	uint lightIndices[];
+};
 
 layout (push_constant) uniform constants
 {
+	mat4 inverseViewProjection;
+	vec2 inverseExtent;
 	int mode;
 } pushConstants;
 
 layout(location = 0) out vec4 outColor;
 
+#if defined(GBUFFER_OCTAHEDRAL) || defined(GBUFFER_PACKED)
+// Keep in sync with encodeOctahedral in phong.frag
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 norm = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-norm.z, 0.0f);
+	norm.x += norm.x >= 0.0f ? -fold : fold;
+	norm.y += norm.y >= 0.0f ? -fold : fold;
+	return normalize(norm);
+}
+#endif
+
+vec3 loadNorm()
+{
+#if defined(GBUFFER_OCTAHEDRAL)
+	return decodeOctahedral(subpassLoad(inputNorm).rg);
+#elif defined(GBUFFER_PACKED)
+	return decodeOctahedral(subpassLoad(inputNorm).rg * 2.0f - 1.0f);
+#else
+	return subpassLoad(inputNorm).rgb;
+#endif
+}
+
+// World position of the pixel from its depth
+vec3 reconstructPosition()
+{
+	vec2 uv = gl_FragCoord.xy * pushConstants.inverseExtent;
+	vec4 position = pushConstants.inverseViewProjection * vec4(uv * 2.0f - 1.0f, subpassLoad(inputDepth).r, 1.0f);
+	return position.xyz / position.w;
+}
+
 void main()
 {
 	if (pushConstants.mode == 1) {
@@ -23,22 +81,42 @@ void main()
 		return;
 	}
 	if (pushConstants.mode == 2) {
-		outColor = vec4(subpassLoad(inputNorm).rgb, 1.0f);
+		outColor = vec4(loadNorm(), 1.0f);
 		return;
 	}
 	if (pushConstants.mode == 3) {
-		outColor = vec4(subpassLoad(inputPosition).rgb, 1.0f);
+		outColor = vec4(reconstructPosition(), 1.0f);
+		return;
+	}
+
+	// Only the lights that reach the pixel's tile
+	uvec2 tileCoord = min(uvec2(gl_FragCoord.xy) / lightGrid.tileSize, uvec2(lightGrid.tileCountX, lightGrid.tileCountY) - 1);
+	uvec2 tile = tiles[tileCoord.y * lightGrid.tileCountX + tileCoord.x];
+
+	if (pushConstants.mode == 4) {
+		outColor = vec4(vec3(tile.y / 64.0f), 1.0f);
 		return;
 	}
 
-	vec3 ambientLight = 0.1f * light.color;
+	vec3 position = reconstructPosition();
+	vec3 norm = loadNorm();
+	vec3 light = lightGrid.ambient.rgb;
+
+	for (uint i = tile.x; i < tile.x + tile.y; i++) {
+		PointLight pointLight = lights[lightIndices[i]];
 
-	vec3 position = subpassLoad(inputPosition).rgb;
-	vec3 lightDir = normalize(light.position - position);
-	vec3 norm = subpassLoad(inputNorm).rgb;
-	float diff = max(dot(norm, lightDir), 0.0f);
-	vec3 diffuseLight = diff * light.color;
+		vec3 toLight = pointLight.position - position;
+		float distance = length(toLight);
+		if (distance >= pointLight.radius) {
+			continue;
+		}
+
+		// Smooth falloff that reaches 0 at the radius
+		float falloff = 1.0f - (distance * distance) / (pointLight.radius * pointLight.radius);
+		float diff = max(dot(norm, toLight / max(distance, 0.0001f)), 0.0f);
+		light += diff * falloff * falloff * pointLight.color;
+	}
 
 	vec3 color = subpassLoad(inputColor).rgb;
-	outColor = vec4((ambientLight + diffuseLight) * color, 1.0f);
+	outColor = vec4(light * color, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+/*
+	Frame timings of a headless run.
+
+	The camera follows a scripted orbit around the model that depends only on the frame number,
+	so runs on different machines and builds render the same frames. Warmup frames are rendered
+	but left out of the statistics. Results are written as CSV or JSON (chosen by the output file
+	extension) with per-frame times and mean/min/percentiles/max of every column.
+*/
+class Benchmark
+{
+public:
+
+	// Milliseconds, gpuTime is negative when the device has no timestamp support
+	struct Frame
+	{
+		float frameTime = 0.0f;
+		float cpuTime = 0.0f;
+		float gpuTime = -1.0f;
+	};
+
+	struct Statistics
+	{
+		float mean;
+		float min;
+		float p50;
+		float p90;
+		float p95;
+		float p99;
+		float max;
+	};
+
+	Benchmark(uint32_t frameCount, uint32_t warmupFrames);
+
+	void getCameraPose(uint32_t frame, glm::vec3& position, glm::vec3& target);
+
+	void setCpuTimes(uint32_t frame, float frameTime, float cpuTime);
+	void setGpuTime(uint32_t frame, float gpuTime);
+
+	// Print the summary and write the results to outputPath
+	void report(std::string outputPath);
+
+	// Getters
+	uint32_t getFrameCount() { return static_cast<uint32_t>(frames.size()); }
+
+private:
+
+	std::vector<Frame> frames;
+	uint32_t warmupFrames;
+
+	Statistics getStatistics(float Frame::* time);
+	void writeCSV(std::string outputPath);
+	void writeJSON(std::string outputPath);
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+// std
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+/*
+	Axis aligned bounding box. A default constructed box is empty (min above max),
+	so growing it by the first point or box gives that point or box.
+*/
+struct BoundingBox
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const BoundingBox& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+
+	// Area of the six faces, what the SAH weighs nodes by
+	float getSurfaceArea() const
+	{
+		glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	// Box around this box after the transform, from the transformed center and the absolute linear part applied to the extent
+	BoundingBox transformed(const glm::mat4& transform) const
+	{
+		glm::vec3 center = glm::vec3(transform * glm::vec4(getCenter(), 1.0f));
+		glm::vec3 extent = (max - min) * 0.5f;
+
+		glm::vec3 transformedExtent =
+			glm::abs(glm::vec3(transform[0])) * extent.x +
+			glm::abs(glm::vec3(transform[1])) * extent.y +
+			glm::abs(glm::vec3(transform[2])) * extent.z;
+
+		BoundingBox box;
+		box.min = center - transformedExtent;
+		box.max = center + transformedExtent;
+		return box;
+	}
+};
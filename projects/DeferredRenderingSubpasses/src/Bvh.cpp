@@ -0,0 +1,395 @@
+#include "Bvh.h"
+
+// std
+#include <algorithm>
+#include <numeric>
+#include <cfloat>
+
+// Candidate split planes per axis are the borders between bins
+#define BVH_BIN_COUNT 8
+// Traversal stack entries, the builder stops splitting before a tree gets deeper than that
+#define BVH_STACK_SIZE 64
+
+enum BOX_CLASS {
+	BOX_OUTSIDE,
+	BOX_INTERSECTING,
+	BOX_INSIDE
+};
+
+static BOX_CLASS classifyBox(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t& planeMask)
+{
+	/*
+		The corner furthest along a plane's normal tells whether the box is completely behind it,
+		the nearest corner whether it is completely in front. Planes a box is in front of stay
+		in front for everything inside it, so they are cleared from planeMask for the children.
+	*/
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; p++) {
+		if ((planeMask & (1u << p)) == 0) {
+			continue;
+		}
+
+		const glm::vec4& plane = frustum.planes[p];
+		glm::vec3 normal = glm::vec3(plane);
+		glm::vec3 furthest(normal.x >= 0.0f ? boundsMax.x : boundsMin.x, normal.y >= 0.0f ? boundsMax.y : boundsMin.y, normal.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		glm::vec3 nearest(normal.x >= 0.0f ? boundsMin.x : boundsMax.x, normal.y >= 0.0f ? boundsMin.y : boundsMax.y, normal.z >= 0.0f ? boundsMin.z : boundsMax.z);
+
+		if (glm::dot(normal, furthest) + plane.w < 0.0f) {
+			return BOX_OUTSIDE;
+		}
+		if (glm::dot(normal, nearest) + plane.w >= 0.0f) {
+			planeMask &= ~(1u << p);
+		}
+	}
+
+	return planeMask == 0 ? BOX_INSIDE : BOX_INTERSECTING;
+}
+
+static float intersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// Slab test, returns where the ray enters the box (0 when it starts inside) or FLT_MAX on a miss
+	glm::vec3 t1 = (boundsMin - origin) * inverseDirection;
+	glm::vec3 t2 = (boundsMax - origin) * inverseDirection;
+
+	glm::vec3 tNear = glm::min(t1, t2);
+	glm::vec3 tFar = glm::max(t1, t2);
+
+	float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+void Bvh::build(const std::vector<BoundingBox>& itemBounds)
+{
+	uint32_t itemCount = static_cast<uint32_t>(itemBounds.size());
+
+	items.resize(itemCount);
+	std::iota(items.begin(), items.end(), 0);
+	bounds = itemBounds;
+
+	nodes.clear();
+	if (itemCount == 0) {
+		return;
+	}
+
+	// A binary tree with a leaf per item at most
+	nodes.reserve(2 * itemCount - 1);
+
+	Node root = {};
+	root.leftFirst = 0;
+	root.itemCount = itemCount;
+	updateBounds(root);
+	nodes.push_back(root);
+
+	subdivide(0);
+}
+
+void Bvh::refit(const std::vector<BoundingBox>& itemBounds)
+{
+	for (uint32_t i = 0; i < items.size(); i++) {
+		bounds[i] = itemBounds[items[i]];
+	}
+
+	// Children always come after their parent
+	for (uint32_t i = static_cast<uint32_t>(nodes.size()); i-- > 0;) {
+		Node& node = nodes[i];
+
+		if (node.itemCount > 0) {
+			updateBounds(node);
+		}
+		else {
+			const Node& left = nodes[node.leftFirst];
+			const Node& right = nodes[node.leftFirst + 1];
+			node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+			node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+		}
+	}
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<ItemRange>& itemRanges) const
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	struct Entry
+	{
+		uint32_t nodeIndex;
+		uint32_t planeMask;
+	};
+
+	Entry stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, (1u << Frustum::PLANE_COUNT) - 1 };
+
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+		const Node* node = &nodes[entry.nodeIndex];
+
+		BOX_CLASS boxClass = classifyBox(frustum, node->boundsMin, node->boundsMax, entry.planeMask);
+		if (boxClass == BOX_OUTSIDE) {
+			continue;
+		}
+
+		ItemRange range = {};
+		range.isInside = boxClass == BOX_INSIDE;
+
+		if (node->itemCount > 0) {
+			range.firstItem = node->leftFirst;
+			range.itemCount = node->itemCount;
+		}
+		else if (range.isInside) {
+			// A subtree covers a contiguous range, from its leftmost to its rightmost leaf
+			const Node* first = node;
+			while (first->itemCount == 0) {
+				first = &nodes[first->leftFirst];
+			}
+			const Node* last = node;
+			while (last->itemCount == 0) {
+				last = &nodes[last->leftFirst + 1];
+			}
+
+			range.firstItem = first->leftFirst;
+			range.itemCount = last->leftFirst + last->itemCount - first->leftFirst;
+		}
+		else {
+			// Right child first, so ranges come out in item order and neighbours can merge
+			stack[stackSize++] = { node->leftFirst + 1, entry.planeMask };
+			stack[stackSize++] = { node->leftFirst, entry.planeMask };
+			continue;
+		}
+
+		if (!itemRanges.empty()) {
+			ItemRange& previous = itemRanges.back();
+			if (previous.isInside == range.isInside && previous.firstItem + previous.itemCount == range.firstItem) {
+				previous.itemCount += range.itemCount;
+				continue;
+			}
+		}
+		itemRanges.push_back(range);
+	}
+}
+
+bool Bvh::queryRay(const glm::vec3& origin, const glm::vec3& direction, uint32_t& item, float& distance) const
+{
+	if (nodes.empty()) {
+		return false;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	float nearestDistance = FLT_MAX;
+
+	struct Entry
+	{
+		uint32_t nodeIndex;
+		float distance;
+	};
+
+	Entry stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+
+	float rootDistance = intersectBox(origin, inverseDirection, nodes[0].boundsMin, nodes[0].boundsMax);
+	if (rootDistance != FLT_MAX) {
+		stack[stackSize++] = { 0, rootDistance };
+	}
+
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+		if (entry.distance >= nearestDistance) {
+			continue;
+		}
+
+		const Node& node = nodes[entry.nodeIndex];
+
+		if (node.itemCount > 0) {
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.itemCount; i++) {
+				float itemDistance = intersectBox(origin, inverseDirection, bounds[i].min, bounds[i].max);
+				if (itemDistance < nearestDistance) {
+					nearestDistance = itemDistance;
+					item = items[i];
+				}
+			}
+			continue;
+		}
+
+		// The nearer child goes on top, so it is visited first and can prune the other one
+		Entry left = { node.leftFirst, intersectBox(origin, inverseDirection, nodes[node.leftFirst].boundsMin, nodes[node.leftFirst].boundsMax) };
+		Entry right = { node.leftFirst + 1, intersectBox(origin, inverseDirection, nodes[node.leftFirst + 1].boundsMin, nodes[node.leftFirst + 1].boundsMax) };
+		if (left.distance > right.distance) {
+			std::swap(left, right);
+		}
+
+		if (right.distance < nearestDistance) {
+			stack[stackSize++] = right;
+		}
+		if (left.distance < nearestDistance) {
+			stack[stackSize++] = left;
+		}
+	}
+
+	distance = nearestDistance;
+	return nearestDistance != FLT_MAX;
+}
+
+BoundingBox Bvh::getBounds() const
+{
+	BoundingBox box;
+	if (!nodes.empty()) {
+		box.min = nodes[0].boundsMin;
+		box.max = nodes[0].boundsMax;
+	}
+	return box;
+}
+
+void Bvh::updateBounds(Node& node)
+{
+	BoundingBox box;
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.itemCount; i++) {
+		box.grow(bounds[i]);
+	}
+
+	node.boundsMin = box.min;
+	node.boundsMax = box.max;
+}
+
+void Bvh::subdivide(uint32_t nodeIndex)
+{
+	struct Pending
+	{
+		uint32_t nodeIndex;
+		uint32_t depth;
+	};
+
+	std::vector<Pending> pending = { { nodeIndex, 0 } };
+
+	while (!pending.empty()) {
+		Pending current = pending.back();
+		pending.pop_back();
+		Node& node = nodes[current.nodeIndex];
+
+		// A query stack holds at most one entry per level plus one
+		if (node.itemCount <= 1 || current.depth + 2 >= BVH_STACK_SIZE) {
+			continue;
+		}
+
+		int splitAxis = 0;
+		float splitPosition = 0.0f;
+		float splitCost = findSplit(node, splitAxis, splitPosition);
+
+		BoundingBox nodeBox = { node.boundsMin, node.boundsMax };
+		float leafCost = node.itemCount * nodeBox.getSurfaceArea();
+		if (splitCost >= leafCost) {
+			continue;
+		}
+
+		// Items left of the plane to the front of the node's range
+		uint32_t first = node.leftFirst;
+		uint32_t end = node.leftFirst + node.itemCount;
+		uint32_t i = first;
+		uint32_t j = end;
+		while (i < j) {
+			if (bounds[i].getCenter()[splitAxis] < splitPosition) {
+				i++;
+			}
+			else {
+				j--;
+				std::swap(bounds[i], bounds[j]);
+				std::swap(items[i], items[j]);
+			}
+		}
+
+		uint32_t leftCount = i - first;
+		if (leftCount == 0 || leftCount == node.itemCount) {
+			continue;
+		}
+
+		uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+
+		Node left = {};
+		left.leftFirst = first;
+		left.itemCount = leftCount;
+		updateBounds(left);
+
+		Node right = {};
+		right.leftFirst = i;
+		right.itemCount = node.itemCount - leftCount;
+		updateBounds(right);
+
+		node.leftFirst = leftIndex;
+		node.itemCount = 0;
+
+		// node is not used past this point, the push may move it
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		pending.push_back({ leftIndex + 1, current.depth + 1 });
+		pending.push_back({ leftIndex, current.depth + 1 });
+	}
+}
+
+float Bvh::findSplit(const Node& node, int& splitAxis, float& splitPosition) const
+{
+	/*
+		Item centers are sorted into bins along each axis. Sweeping the bins from both ends gives
+		the item count and box on either side of every bin border, and with them the SAH cost
+		of splitting there: items on a side times that side's surface area.
+	*/
+	BoundingBox centerBox;
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.itemCount; i++) {
+		centerBox.grow(bounds[i].getCenter());
+	}
+
+	float bestCost = FLT_MAX;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float axisMin = centerBox.min[axis];
+		float axisMax = centerBox.max[axis];
+		if (axisMax <= axisMin) {
+			continue;
+		}
+
+		struct Bin
+		{
+			BoundingBox box;
+			uint32_t itemCount = 0;
+		} bins[BVH_BIN_COUNT];
+
+		float scale = BVH_BIN_COUNT / (axisMax - axisMin);
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.itemCount; i++) {
+			int binIndex = std::min(BVH_BIN_COUNT - 1, static_cast<int>((bounds[i].getCenter()[axis] - axisMin) * scale));
+			bins[binIndex].box.grow(bounds[i]);
+			bins[binIndex].itemCount++;
+		}
+
+		float leftArea[BVH_BIN_COUNT - 1];
+		uint32_t leftCount[BVH_BIN_COUNT - 1];
+		BoundingBox leftBox;
+		uint32_t leftSum = 0;
+		for (int i = 0; i < BVH_BIN_COUNT - 1; i++) {
+			leftSum += bins[i].itemCount;
+			leftBox.grow(bins[i].box);
+			leftCount[i] = leftSum;
+			leftArea[i] = leftBox.getSurfaceArea();
+		}
+
+		BoundingBox rightBox;
+		uint32_t rightSum = 0;
+		for (int i = BVH_BIN_COUNT - 1; i > 0; i--) {
+			rightSum += bins[i].itemCount;
+			rightBox.grow(bins[i].box);
+
+			if (leftCount[i - 1] == 0 || rightSum == 0) {
+				continue;
+			}
+
+			float cost = leftCount[i - 1] * leftArea[i - 1] + rightSum * rightBox.getSurfaceArea();
+			if (cost < bestCost) {
+				bestCost = cost;
+				splitAxis = axis;
+				splitPosition = axisMin + i / scale;
+			}
+		}
+	}
+
+	return bestCost;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+#include "Frustum.h"
+
+/*
+	Bounding volume hierarchy over item boxes.
+
+	Built top down, splitting each node where the surface area heuristic is cheapest among
+	BVH_BIN_COUNT bins of the item centers per axis. Nodes are 32 bytes in one flat array, the
+	two children of a node next to each other and after their parent, so a refit is a single
+	backwards pass. Leaves index a contiguous range of getItems(), and so does every subtree.
+
+	refit() keeps the tree and only recomputes the boxes, for items that moved. The tree gets
+	worse the further items move from where it was built, build() again when that matters.
+*/
+class Bvh
+{
+public:
+
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		// Leaf: first entry in getItems(), interior node: left child, the right child follows it
+		uint32_t leftFirst;
+		glm::vec3 boundsMax;
+		// 0 for interior nodes
+		uint32_t itemCount;
+	};
+
+	// Entries of getItems() a frustum query found
+	struct ItemRange
+	{
+		uint32_t firstItem;
+		uint32_t itemCount;
+		// The whole range is inside the frustum, otherwise the items still need a test of their own
+		bool isInside;
+	};
+
+	void build(const std::vector<BoundingBox>& itemBounds);
+	// Same item count as the last build
+	void refit(const std::vector<BoundingBox>& itemBounds);
+
+	// Appends ranges covering every item whose box the frustum does not reject
+	void queryFrustum(const Frustum& frustum, std::vector<ItemRange>& itemRanges) const;
+	// Nearest item box the ray enters, distance is in units of direction
+	bool queryRay(const glm::vec3& origin, const glm::vec3& direction, uint32_t& item, float& distance) const;
+
+	// Getters
+	const std::vector<Node>& getNodes() const { return nodes; }
+	// Item indices in tree order
+	const std::vector<uint32_t>& getItems() const { return items; }
+	BoundingBox getBounds() const;
+
+private:
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> items;
+	// Item boxes in tree order
+	std::vector<BoundingBox> bounds;
+
+	void updateBounds(Node& node);
+	void subdivide(uint32_t nodeIndex);
+	float findSplit(const Node& node, int& splitAxis, float& splitPosition) const;
+};
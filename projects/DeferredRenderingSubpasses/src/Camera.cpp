@@ -23,6 +23,16 @@ glm::mat4 Camera::getViewMatrix()
     return glm::lookAt(positionVector, positionVector + frontVector, upVector);
 }
 
+void Camera::getRay(float x, float y, float viewAspectRatio, glm::vec3& origin, glm::vec3& direction)
+{
+    // Half the view's height at distance 1 is tan(FOV / 2), the same FOV the projection is built with
+    float halfHeight = tan(glm::radians(FOV) * 0.5f);
+    float halfWidth = halfHeight * viewAspectRatio;
+
+    origin = positionVector;
+    direction = glm::normalize(frontVector + rightVector * (x * halfWidth) + upVector * (y * halfHeight));
+}
+
 void Camera::move(CAMERA_MOVEMENT direction, float deltaTime)
 {
     float velocity = 3.0f * deltaTime;
@@ -56,6 +66,17 @@ void Camera::rotateByMouse(float xOffset, float yOffset)
     updateVectors();
 }
 
+void Camera::lookAt(glm::vec3 position, glm::vec3 target)
+{
+    positionVector = position;
+
+    glm::vec3 direction = glm::normalize(target - position);
+    pitch = glm::degrees(asin(direction.y));
+    yaw = glm::degrees(atan2(direction.z, direction.x));
+
+    updateVectors();
+}
+
 void Camera::updateVectors()
 {
     glm::vec3 front;
@@ -27,8 +27,11 @@ public:
 	glm::vec3 getPosition() { return positionVector; }
 	
 	glm::mat4 getViewMatrix();
+	// World space ray through a point of the view, x and y in [-1, 1] from the bottom left, direction is normalized
+	void getRay(float x, float y, float viewAspectRatio, glm::vec3& origin, glm::vec3& direction);
 	void move(CAMERA_MOVEMENT direction, float deltaTime);
 	void rotateByMouse(float xOffset, float yOffset);
+	void lookAt(glm::vec3 position, glm::vec3 target);
 
 private:
 
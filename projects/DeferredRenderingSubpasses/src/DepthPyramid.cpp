@@ -0,0 +1,346 @@
+#include "DepthPyramid.h"
+
+// std
+#include <stdexcept>
+#include <array>
+#include <algorithm>
+
+#include "Shader.h"
+
+#define DEPTH_PYRAMID_GROUP_SIZE 8
+
+static uint32_t previousPowerOfTwo(uint32_t value)
+{
+	uint32_t power = 1;
+	while (power * 2 <= value) {
+		power *= 2;
+	}
+	return power;
+}
+
+DepthPyramid::DepthPyramid(VkDevice device, MemoryAllocator* allocator, VkPipelineCache pipelineCache, VkImageView depthImageView, VkExtent2D depthExtent)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->pipelineCache = pipelineCache;
+
+	createSampler();
+	createDescriptorSetLayout();
+	createPipeline();
+	resize(depthImageView, depthExtent);
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	destroyLevels();
+
+	vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+}
+
+void DepthPyramid::resize(VkImageView depthImageView, VkExtent2D depthExtent)
+{
+	destroyLevels();
+
+	this->depthImageView = depthImageView;
+	this->depthExtent = depthExtent;
+
+	/*
+		Rounding down keeps every level an exact halving of the one before it. A level 0 texel then covers
+		less than 2x2 depth texels along each axis, which the shader reads in full, so no depth is lost.
+	*/
+	extent.width = previousPowerOfTwo(depthExtent.width);
+	extent.height = previousPowerOfTwo(depthExtent.height);
+
+	levelCount = 1;
+	while ((extent.width >> levelCount) > 0 || (extent.height >> levelCount) > 0) {
+		levelCount++;
+	}
+
+	createImage();
+	createDescriptorSets();
+}
+
+void DepthPyramid::build(VkCommandBuffer commandBuffer)
+{
+	/*
+		Every level is rewritten, so the old contents are discarded. The barrier also keeps the writes
+		after the culling that read the pyramid of an earlier frame.
+	*/
+	VkImageMemoryBarrier discardBarrier = {};
+	discardBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	discardBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	discardBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	discardBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	discardBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	discardBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	discardBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	discardBarrier.image = image;
+	discardBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	discardBarrier.subresourceRange.baseMipLevel = 0;
+	discardBarrier.subresourceRange.levelCount = levelCount;
+	discardBarrier.subresourceRange.baseArrayLayer = 0;
+	discardBarrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &discardBarrier);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	VkExtent2D sourceExtent = depthExtent;
+	for (uint32_t level = 0; level < levelCount; level++) {
+		VkExtent2D levelExtent = { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+
+		PushConstant pushConstant;
+		pushConstant.sourceWidth = static_cast<int32_t>(sourceExtent.width);
+		pushConstant.sourceHeight = static_cast<int32_t>(sourceExtent.height);
+		pushConstant.width = static_cast<int32_t>(levelExtent.width);
+		pushConstant.height = static_cast<int32_t>(levelExtent.height);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+		vkCmdDispatch(
+			commandBuffer,
+			(levelExtent.width + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			(levelExtent.height + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			1
+		);
+
+		// The next level reads this one, the culling reads all of them
+		VkImageMemoryBarrier levelBarrier = discardBarrier;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.subresourceRange.baseMipLevel = level;
+		levelBarrier.subresourceRange.levelCount = 1;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+
+		sourceExtent = levelExtent;
+	}
+}
+
+void DepthPyramid::createImage()
+{
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent.width = extent.width;
+	imageInfo.extent.height = extent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkResult result = vkCreateImage(device, &imageInfo, nullptr, &image);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Image.");
+	}
+
+	imageAllocation = allocator->allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkImageViewCreateInfo imageViewInfo = {};
+	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewInfo.image = image;
+	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewInfo.subresourceRange.baseMipLevel = 0;
+	imageViewInfo.subresourceRange.levelCount = levelCount;
+	imageViewInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(device, &imageViewInfo, nullptr, &imageView);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Image View.");
+	}
+
+	levelImageViews.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		imageViewInfo.subresourceRange.baseMipLevel = level;
+		imageViewInfo.subresourceRange.levelCount = 1;
+
+		result = vkCreateImageView(device, &imageViewInfo, nullptr, &levelImageViews[level]);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot create Depth Pyramid Level Image View.");
+		}
+	}
+}
+
+void DepthPyramid::createSampler()
+{
+	// The shaders only fetch texels, but a combined image sampler still needs a sampler
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+	VkResult result = vkCreateSampler(device, &samplerInfo, nullptr, &sampler);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Sampler.");
+	}
+}
+
+void DepthPyramid::createDescriptorSetLayout()
+{
+	// What the level is reduced from, the level
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorCount = 1;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorCount = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Descriptor Set Layout.");
+	}
+}
+
+void DepthPyramid::createDescriptorSets()
+{
+	// The pool goes with the levels, so a resize can make one for its level count
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].descriptorCount = levelCount;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = levelCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.maxSets = levelCount;
+	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	descriptorPoolInfo.pPoolSizes = poolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Descriptor Pool.");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(levelCount, descriptorSetLayout);
+	descriptorSets.resize(levelCount);
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = levelCount;
+	allocateInfo.pSetLayouts = layouts.data();
+
+	result = vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot allocate Depth Pyramid Descriptor Sets.");
+	}
+
+	for (uint32_t level = 0; level < levelCount; level++) {
+		VkDescriptorImageInfo sourceInfo = {};
+		sourceInfo.sampler = sampler;
+		sourceInfo.imageView = level == 0 ? depthImageView : levelImageViews[level - 1];
+		sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo levelInfo = {};
+		levelInfo.sampler = VK_NULL_HANDLE;
+		levelInfo.imageView = levelImageViews[level];
+		levelInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writeSets = {};
+		writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[0].dstSet = descriptorSets[level];
+		writeSets[0].dstBinding = 0;
+		writeSets[0].dstArrayElement = 0;
+		writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeSets[0].descriptorCount = 1;
+		writeSets[0].pImageInfo = &sourceInfo;
+
+		writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[1].dstSet = descriptorSets[level];
+		writeSets[1].dstBinding = 1;
+		writeSets[1].dstArrayElement = 0;
+		writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeSets[1].descriptorCount = 1;
+		writeSets[1].pImageInfo = &levelInfo;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+	}
+}
+
+void DepthPyramid::createPipeline()
+{
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstant);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Pipeline Layout.");
+	}
+
+	Shader shader(device, "shaders/depth_pyramid_comp.spv");
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shader.getShaderModule();
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+
+	result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Depth Pyramid Pipeline.");
+	}
+}
+
+void DepthPyramid::destroyLevels()
+{
+	if (image == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Destroying the pool frees its sets
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	descriptorSets.clear();
+
+	for (VkImageView levelImageView : levelImageViews) {
+		vkDestroyImageView(device, levelImageView, nullptr);
+	}
+	levelImageViews.clear();
+	vkDestroyImageView(device, imageView, nullptr);
+	vkDestroyImage(device, image, nullptr);
+	allocator->free(imageAllocation);
+
+	image = VK_NULL_HANDLE;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+
+/*
+	Hierarchical-Z pyramid of a depth buffer for occlusion culling.
+
+	Every texel holds the farthest depth of the texels it covers in the level below, so a box whose nearest
+	depth is farther than the few texels its screen bounds touch is hidden behind what was already drawn.
+	Level 0 is the depth buffer's size rounded down to powers of two, each level after it halves that,
+	down to 1x1. depth_pyramid_comp.spv writes one level per dispatch from the depth buffer or the level
+	before it.
+
+	The pyramid stays in VK_IMAGE_LAYOUT_GENERAL, storage writes and sampled reads both work in it.
+	The depth buffer has to be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL and done being written
+	when build() is recorded.
+*/
+class DepthPyramid
+{
+public:
+
+	DepthPyramid(VkDevice device, MemoryAllocator* allocator, VkPipelineCache pipelineCache, VkImageView depthImageView, VkExtent2D depthExtent);
+	~DepthPyramid();
+
+	// Must be recorded outside of a render pass, leaves the pyramid ready for compute shader reads
+	void build(VkCommandBuffer commandBuffer);
+	// For a new depth buffer, only when the GPU is done with the pyramid. The image view changes, the object stays
+	void resize(VkImageView depthImageView, VkExtent2D depthExtent);
+
+	// Getters
+	VkImageView getImageView() { return imageView; }
+	VkSampler getSampler() { return sampler; }
+	VkExtent2D getExtent() { return extent; }
+	uint32_t getLevelCount() { return levelCount; }
+
+private:
+
+	// Sizes of a level and of what it is reduced from, push constants of depth_pyramid.comp
+	struct PushConstant
+	{
+		int32_t sourceWidth;
+		int32_t sourceHeight;
+		int32_t width;
+		int32_t height;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+	VkPipelineCache pipelineCache;
+	VkImageView depthImageView;
+	VkExtent2D depthExtent;
+
+	VkExtent2D extent;
+	uint32_t levelCount;
+
+	VkImage image = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation imageAllocation;
+	// Every level, for culling
+	VkImageView imageView = VK_NULL_HANDLE;
+	// One level each, for writing it and reading it when the next one is built
+	std::vector<VkImageView> levelImageViews;
+	VkSampler sampler = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	// One per level
+	std::vector<VkDescriptorSet> descriptorSets;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	void createImage();
+	void createSampler();
+	void createDescriptorSetLayout();
+	void createDescriptorSets();
+	void createPipeline();
+	// Everything that depends on the depth buffer's size
+	void destroyLevels();
+};
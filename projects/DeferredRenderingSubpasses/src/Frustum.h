@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*
+	Six planes bounding what a view-projection matrix keeps on screen.
+
+	Planes are (normal, distance) with normals pointing inside and normalized, so dot(normal, p) + distance
+	is the signed distance of p. They are extracted from the rows of the matrix (Gribb and Hartmann),
+	with the 0 to 1 clip depth Vulkan uses. A matrix that also holds a model transform gives planes in
+	that model's space.
+*/
+struct Frustum
+{
+	enum PLANE {
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+		PLANE_COUNT
+	};
+
+	glm::vec4 planes[PLANE_COUNT];
+
+	Frustum() {};
+	Frustum(const glm::mat4& viewProjection)
+	{
+		glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		planes[PLANE_LEFT] = row3 + row0;
+		planes[PLANE_RIGHT] = row3 - row0;
+		planes[PLANE_BOTTOM] = row3 + row1;
+		planes[PLANE_TOP] = row3 - row1;
+		planes[PLANE_NEAR] = row2;
+		planes[PLANE_FAR] = row3 - row2;
+
+		for (glm::vec4& plane : planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+	}
+
+	bool isSphereVisible(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// False when the box is completely behind a plane, tested at its corner furthest along the normal
+	bool isBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+	{
+		for (const glm::vec4& plane : planes) {
+			glm::vec3 normal = glm::vec3(plane);
+			glm::vec3 furthest(normal.x >= 0.0f ? boundsMax.x : boundsMin.x, normal.y >= 0.0f ? boundsMax.y : boundsMin.y, normal.z >= 0.0f ? boundsMax.z : boundsMin.z);
+			if (glm::dot(normal, furthest) + plane.w < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
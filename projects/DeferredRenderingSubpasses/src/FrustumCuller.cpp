@@ -0,0 +1,195 @@
+#include "FrustumCuller.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+
+#if defined(FRUSTUM_CULLER_AVX2)
+#include <immintrin.h>
+#elif defined(FRUSTUM_CULLER_SSE)
+#include <emmintrin.h>
+#endif
+
+void FrustumCuller::resize(uint32_t count)
+{
+	this->count = count;
+
+	/*
+		A batch starting at the last sphere reads BATCH_SIZE - 1 past it. Padding spheres have
+		a negative infinite radius, so every plane rejects them.
+	*/
+	uint32_t paddedCount = (count + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE + BATCH_SIZE;
+	centerX.resize(paddedCount);
+	centerY.resize(paddedCount);
+	centerZ.resize(paddedCount);
+	radius.resize(paddedCount);
+
+	for (uint32_t i = count; i < paddedCount; i++) {
+		centerX[i] = centerY[i] = centerZ[i] = 0.0f;
+		radius[i] = -FLT_MAX;
+	}
+}
+
+void FrustumCuller::setSphere(uint32_t index, const glm::vec3& center, float radius)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	this->radius[index] = radius;
+}
+
+void FrustumCuller::setSphere(uint32_t index, const glm::mat4& transform, const glm::vec4& sphere)
+{
+	glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(sphere), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	setSphere(index, center, sphere.w * scale);
+}
+
+uint32_t FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices, SIMD_LEVEL simdLevel) const
+{
+	// Compaction writes every index and only advances past visible ones, so there has to be room for all of them
+	if (visibleIndices.size() < count + BATCH_SIZE) {
+		visibleIndices.resize(count + BATCH_SIZE);
+	}
+
+	return cull(frustum, 0, count, visibleIndices.data(), simdLevel);
+}
+
+uint32_t FrustumCuller::cull(const Frustum& frustum, uint32_t firstSphere, uint32_t sphereCount, uint32_t* visibleIndices, SIMD_LEVEL simdLevel) const
+{
+	simdLevel = std::min(simdLevel, getSimdLevel());
+
+	switch (simdLevel) {
+	case SIMD_AVX2:
+		return cullAvx2(frustum, firstSphere, firstSphere + sphereCount, visibleIndices);
+	case SIMD_SSE:
+		return cullSse(frustum, firstSphere, firstSphere + sphereCount, visibleIndices);
+	default:
+		return cullScalar(frustum, firstSphere, firstSphere + sphereCount, visibleIndices);
+	}
+}
+
+FrustumCuller::SIMD_LEVEL FrustumCuller::getSimdLevel()
+{
+#if defined(FRUSTUM_CULLER_AVX2)
+	return SIMD_AVX2;
+#elif defined(FRUSTUM_CULLER_SSE)
+	return SIMD_SSE;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+const char* FrustumCuller::getSimdName(SIMD_LEVEL simdLevel)
+{
+	const char* names[] = { "scalar", "SSE", "AVX2" };
+	return names[simdLevel];
+}
+
+uint32_t FrustumCuller::cullScalar(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const
+{
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = first; i < end; i++) {
+		bool isVisible = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+			isVisible = isVisible && distance >= -radius[i];
+		}
+
+		visibleIndices[visibleCount] = i;
+		visibleCount += isVisible ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+uint32_t FrustumCuller::cullSse(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const
+{
+#if defined(FRUSTUM_CULLER_SSE)
+	__m128 planeX[Frustum::PLANE_COUNT];
+	__m128 planeY[Frustum::PLANE_COUNT];
+	__m128 planeZ[Frustum::PLANE_COUNT];
+	__m128 planeW[Frustum::PLANE_COUNT];
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = first; i < end; i += 4) {
+		__m128 x = _mm_loadu_ps(&centerX[i]);
+		__m128 y = _mm_loadu_ps(&centerY[i]);
+		__m128 z = _mm_loadu_ps(&centerZ[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < Frustum::PLANE_COUNT; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_mul_ps(planeZ[p], z)), planeW[p]);
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		// Lanes past the end belong to spheres outside the range
+		int mask = _mm_movemask_ps(visible);
+		if (end - i < 4) {
+			mask &= (1 << (end - i)) - 1;
+		}
+		for (uint32_t j = 0; j < 4; j++) {
+			visibleIndices[visibleCount] = i + j;
+			visibleCount += (mask >> j) & 1;
+		}
+	}
+
+	return visibleCount;
+#else
+	return cullScalar(frustum, first, end, visibleIndices);
+#endif
+}
+
+uint32_t FrustumCuller::cullAvx2(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const
+{
+#if defined(FRUSTUM_CULLER_AVX2)
+	__m256 planeX[Frustum::PLANE_COUNT];
+	__m256 planeY[Frustum::PLANE_COUNT];
+	__m256 planeZ[Frustum::PLANE_COUNT];
+	__m256 planeW[Frustum::PLANE_COUNT];
+	for (uint32_t p = 0; p < Frustum::PLANE_COUNT; p++) {
+		planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = first; i < end; i += 8) {
+		__m256 x = _mm256_loadu_ps(&centerX[i]);
+		__m256 y = _mm256_loadu_ps(&centerY[i]);
+		__m256 z = _mm256_loadu_ps(&centerZ[i]);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (uint32_t p = 0; p < Frustum::PLANE_COUNT; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(visible);
+		if (end - i < 8) {
+			mask &= (1 << (end - i)) - 1;
+		}
+		for (uint32_t j = 0; j < 8; j++) {
+			visibleIndices[visibleCount] = i + j;
+			visibleCount += (mask >> j) & 1;
+		}
+	}
+
+	return visibleCount;
+#else
+	return cullSse(frustum, first, end, visibleIndices);
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+// AVX2 needs the ENABLE_AVX2 build option, SSE2 is part of every x64 target
+#if defined(__AVX2__)
+#define FRUSTUM_CULLER_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE
+#endif
+
+/*
+	Frustum culling of bounding spheres on the CPU.
+
+	Spheres are stored as a structure of arrays, so a plane is tested against 4 (SSE) or 8 (AVX2)
+	spheres with one multiply-add chain and a compare. The indices of the visible spheres are
+	compacted without branches, so the cost does not depend on how many of them are visible.
+	The arrays are padded past a multiple of BATCH_SIZE, so batches can start anywhere.
+*/
+class FrustumCuller
+{
+public:
+
+	enum SIMD_LEVEL {
+		SIMD_SCALAR,
+		SIMD_SSE,
+		SIMD_AVX2
+	};
+
+	// Widest SIMD batch
+	static const uint32_t BATCH_SIZE = 8;
+
+	// Sets the sphere count, spheres are left undefined until set
+	void resize(uint32_t count);
+	void setSphere(uint32_t index, const glm::vec3& center, float radius);
+	// Model space sphere (center xyz, radius w) placed by transform, the radius grows with the largest axis scale
+	void setSphere(uint32_t index, const glm::mat4& transform, const glm::vec4& sphere);
+
+	/*
+		Writes the indices of the visible spheres in increasing order to the front of visibleIndices
+		and returns how many there are. visibleIndices is only ever grown, entries past the count are garbage.
+		A simdLevel that was not compiled in falls back to the best one that was.
+	*/
+	uint32_t cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices, SIMD_LEVEL simdLevel = getSimdLevel()) const;
+	// Same for spheres [firstSphere, firstSphere + sphereCount), visibleIndices needs room for sphereCount + BATCH_SIZE entries
+	uint32_t cull(const Frustum& frustum, uint32_t firstSphere, uint32_t sphereCount, uint32_t* visibleIndices, SIMD_LEVEL simdLevel = getSimdLevel()) const;
+
+	// Getters
+	uint32_t getCount() const { return count; }
+	// Best level compiled in
+	static SIMD_LEVEL getSimdLevel();
+	static const char* getSimdName(SIMD_LEVEL simdLevel);
+
+private:
+
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	uint32_t count = 0;
+
+	uint32_t cullScalar(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const;
+	uint32_t cullSse(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const;
+	uint32_t cullAvx2(const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visibleIndices) const;
+};
@@ -0,0 +1,236 @@
+#include "GpuProfiler.h"
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+GpuProfiler::GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t maxScopes)
+{
+	this->device = device;
+	// Frame begin and end, then a pair per scope
+	this->maxQueries = 2 + 2 * maxScopes;
+
+	frames.resize(frameCount);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
+
+	uint32_t validBits = queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+	if (validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+		std::cerr << "WARNING: queue does not support timestamps, GPU times are not available." << std::endl;
+		return;
+	}
+
+	timestampPeriod = properties.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	for (Frame& frame : frames) {
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = maxQueries;
+
+		VkResult result = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.queryPool);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot create Timestamp Query Pool.");
+		}
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (Frame& frame : frames) {
+		vkDestroyQueryPool(device, frame.queryPool, nullptr);
+	}
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t frameNumber)
+{
+	if (!isSupported()) {
+		return;
+	}
+
+	recordingFrame = &frames[frameIndex];
+	recordingFrame->scopeQueries.clear();
+	recordingFrame->frameNumber = frameNumber;
+	openScopes.clear();
+
+	vkCmdResetQueryPool(commandBuffer, recordingFrame->queryPool, 0, maxQueries);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, recordingFrame->queryPool, 0);
+	recordingFrame->queryCount = 2;
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer)
+{
+	if (!recordingFrame) {
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, recordingFrame->queryPool, 1);
+	recordingFrame = nullptr;
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+	if (!recordingFrame) {
+		return;
+	}
+
+	if (recordingFrame->queryCount + 2 > maxQueries) {
+		throw std::runtime_error("ERROR: too many GPU Profiler scopes in a frame.");
+	}
+
+	ScopeQuery scopeQuery = {};
+	scopeQuery.scope = getScope(name);
+	scopeQuery.beginQuery = recordingFrame->queryCount;
+	scopeQuery.endQuery = recordingFrame->queryCount + 1;
+	recordingFrame->queryCount += 2;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, recordingFrame->queryPool, scopeQuery.beginQuery);
+
+	openScopes.push_back(static_cast<uint32_t>(recordingFrame->scopeQueries.size()));
+	recordingFrame->scopeQueries.push_back(scopeQuery);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer)
+{
+	if (!recordingFrame || openScopes.empty()) {
+		return;
+	}
+
+	const ScopeQuery& scopeQuery = recordingFrame->scopeQueries[openScopes.back()];
+	openScopes.pop_back();
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, recordingFrame->queryPool, scopeQuery.endQuery);
+}
+
+bool GpuProfiler::readFrame(uint32_t frameIndex)
+{
+	Frame& frame = frames[frameIndex];
+	if (!isSupported() || frame.frameNumber < 0) {
+		return false;
+	}
+
+	std::vector<uint64_t> timestamps(frame.queryCount);
+	VkResult result = vkGetQueryPoolResults(
+		device, frame.queryPool, 0, frame.queryCount,
+		timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT
+	);
+
+	frameNumber = static_cast<uint32_t>(frame.frameNumber);
+	frame.frameNumber = -1;
+
+	if (result != VK_SUCCESS) {
+		return false;
+	}
+
+	frameTime = toMilliseconds(timestamps[0], timestamps[1]);
+	frameTimeSum += frameTime;
+	frameTimeCount++;
+
+	for (Scope& scope : scopes) {
+		scope.time = -1.0f;
+	}
+
+	// A scope recorded more than once in a frame counts with its total time
+	for (const ScopeQuery& scopeQuery : frame.scopeQueries) {
+		Scope& scope = scopes[scopeQuery.scope];
+		float time = toMilliseconds(timestamps[scopeQuery.beginQuery], timestamps[scopeQuery.endQuery]);
+		scope.time = scope.time < 0.0f ? time : scope.time + time;
+	}
+
+	for (Scope& scope : scopes) {
+		if (scope.time >= 0.0f) {
+			scope.timeSum += scope.time;
+			scope.timeCount++;
+		}
+	}
+
+	return true;
+}
+
+void GpuProfiler::flushAverages()
+{
+	averageFrameTime = frameTimeCount > 0 ? static_cast<float>(frameTimeSum / frameTimeCount) : 0.0f;
+
+	for (Scope& scope : scopes) {
+		scope.averageTime = scope.timeCount > 0 ? static_cast<float>(scope.timeSum / scope.timeCount) : 0.0f;
+	}
+
+	if (logFile.is_open()) {
+		// Scopes are only known once recorded, so the header is written again when new ones show up
+		if (loggedScopeCount != scopes.size()) {
+			logFile << "flush,frames,frame_ms";
+			for (const Scope& scope : scopes) {
+				logFile << "," << scope.name << "_ms";
+			}
+			logFile << "\n";
+			loggedScopeCount = scopes.size();
+		}
+
+		logFile << flushCount << "," << frameTimeCount << "," << averageFrameTime;
+		for (const Scope& scope : scopes) {
+			logFile << "," << scope.averageTime;
+		}
+		logFile << std::endl;
+	}
+
+	flushCount++;
+	frameTimeSum = 0.0;
+	frameTimeCount = 0;
+	for (Scope& scope : scopes) {
+		scope.timeSum = 0.0;
+		scope.timeCount = 0;
+	}
+}
+
+void GpuProfiler::openLog(std::string logPath)
+{
+	logFile.open(logPath, std::ios::trunc);
+	if (!logFile.is_open()) {
+		std::cerr << "WARNING: cannot write GPU profiler log \"" << logPath << "\"." << std::endl;
+	}
+}
+
+std::string GpuProfiler::getSummary()
+{
+	if (!isSupported()) {
+		return "";
+	}
+
+	std::stringstream summary;
+	summary << std::fixed << std::setprecision(2) << "GPU " << averageFrameTime << " ms";
+	for (const Scope& scope : scopes) {
+		summary << " | " << scope.name << " " << scope.averageTime << " ms";
+	}
+
+	return summary.str();
+}
+
+uint32_t GpuProfiler::getScope(const char* name)
+{
+	for (size_t i = 0; i < scopes.size(); i++) {
+		if (scopes[i].name == name) {
+			return static_cast<uint32_t>(i);
+		}
+	}
+
+	Scope scope;
+	scope.name = name;
+	scopes.push_back(scope);
+
+	return static_cast<uint32_t>(scopes.size() - 1);
+}
+
+float GpuProfiler::toMilliseconds(uint64_t begin, uint64_t end)
+{
+	return ((end - begin) & timestampMask) * timestampPeriod / 1000000.0f;
+}
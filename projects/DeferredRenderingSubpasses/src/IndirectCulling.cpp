@@ -0,0 +1,640 @@
+#include "IndirectCulling.h"
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <array>
+#include <algorithm>
+
+#include "Shader.h"
+#include "CpuProfiler.h"
+
+#define CULL_GROUP_SIZE 64
+
+IndirectCulling::IndirectCulling(
+	VkDevice device,
+	MemoryAllocator* allocator,
+	VkPipelineCache pipelineCache,
+	uint32_t frameCount,
+	bool useGpu,
+	bool isDrawCountSupported,
+	bool isMultiDrawSupported,
+	DepthPyramid* depthPyramid,
+	bool isValidated)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->pipelineCache = pipelineCache;
+	this->useGpu = useGpu;
+	this->isDrawCountSupported = isDrawCountSupported;
+	this->isMultiDrawSupported = isMultiDrawSupported;
+	this->depthPyramid = depthPyramid;
+	this->isValidated = isValidated;
+
+	// The draw count only ever exists on the GPU when the GPU culls
+	if (useGpu && !isDrawCountSupported) {
+		throw std::runtime_error("ERROR: GPU culling needs drawIndirectCount.");
+	}
+	if (!useGpu && depthPyramid != nullptr) {
+		throw std::runtime_error("ERROR: occlusion culling needs GPU culling.");
+	}
+	// The CPU has no depth pyramid to reproduce the occlusion test with
+	if (isValidated && (!useGpu || depthPyramid != nullptr)) {
+		throw std::runtime_error("ERROR: culling validation needs GPU culling without occlusion culling.");
+	}
+
+	frames.resize(frameCount);
+
+	if (useGpu) {
+		createDescriptorSetLayout();
+		createDescriptorSets();
+		createPipelines();
+	}
+}
+
+IndirectCulling::~IndirectCulling()
+{
+	if (isValidated) {
+		std::cout << "Culling >> validated " << validatedFrameCount << " frames against the CPU, " << differingFrameCount << " differed" << std::endl;
+	}
+
+	for (Frame& frame : frames) {
+		destroyBuffer(frame.meshes);
+		destroyBuffer(frame.counts);
+		destroyBuffer(frame.instances);
+		destroyBuffer(frame.indirect);
+		destroyBuffer(frame.lateIndirect);
+		destroyBuffer(frame.visibility);
+		destroyBuffer(frame.occlusion);
+	}
+
+	vkDestroyPipeline(device, cullPipeline, nullptr);
+	vkDestroyPipeline(device, compactPipeline, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+void IndirectCulling::cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene* scene, const Frustum& frustum)
+{
+	PROFILE_FUNCTION();
+
+	Frame& frame = frames[frameIndex];
+	// Before prepareFrame() may replace the buffers holding the results
+	if (frame.hasExpected) {
+		validate(frame);
+	}
+	prepareFrame(frame, scene);
+
+	if (useGpu) {
+		cullOnGpu(commandBuffer, frame, scene, frameIndex, frustum, isOcclusionCulled() ? PHASE_EARLY : PHASE_ALL);
+
+		if (isValidated) {
+			frame.expectedInstances.resize(scene->getInstanceCount());
+			frame.expectedCommands.resize(frame.meshCount);
+			uint32_t drawCount = cullOnCpu(scene, frustum, frame.expectedInstances.data(), frame.expectedCommands.data());
+			frame.expectedCommands.resize(drawCount);
+			frame.hasExpected = true;
+		}
+	}
+	else {
+		IndirectHeader* header = static_cast<IndirectHeader*>(frame.indirect.allocation.mapped);
+		InstanceData* culledInstances = static_cast<InstanceData*>(frame.instances.allocation.mapped);
+
+		frame.drawCount = cullOnCpu(scene, frustum, culledInstances, reinterpret_cast<VkDrawIndexedIndirectCommand*>(header + 1));
+		header->drawCount = frame.drawCount;
+	}
+}
+
+void IndirectCulling::cullLate(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene* scene, const Frustum& frustum, const glm::mat4& viewProjection)
+{
+	PROFILE_FUNCTION();
+
+	Frame& frame = frames[frameIndex];
+
+	Occlusion occlusion = {};
+	occlusion.viewProjection = viewProjection;
+	occlusion.pyramidSize = glm::vec2(depthPyramid->getExtent().width, depthPyramid->getExtent().height);
+	memcpy(frame.occlusion.allocation.mapped, &occlusion, sizeof(Occlusion));
+
+	cullOnGpu(commandBuffer, frame, scene, frameIndex, frustum, PHASE_LATE);
+}
+
+void IndirectCulling::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	Frame& frame = frames[frameIndex];
+	drawIndirect(commandBuffer, frame, frame.indirect.buffer, frame.drawCount);
+}
+
+void IndirectCulling::drawLate(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	Frame& frame = frames[frameIndex];
+	// Only GPU culling has a late phase, and GPU culling requires drawIndirectCount
+	drawIndirect(commandBuffer, frame, frame.lateIndirect.buffer, 0);
+}
+
+void IndirectCulling::drawIndirect(VkCommandBuffer commandBuffer, Frame& frame, VkBuffer indirectBuffer, uint32_t drawCount)
+{
+	if (frame.meshCount == 0) {
+		return;
+	}
+
+	VkDeviceSize commandOffset = sizeof(IndirectHeader);
+	uint32_t commandStride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (isDrawCountSupported) {
+		vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer, commandOffset, indirectBuffer, 0, frame.meshCount, commandStride);
+	}
+	else if (isMultiDrawSupported) {
+		vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, commandOffset, drawCount, commandStride);
+	}
+	else {
+		for (uint32_t i = 0; i < drawCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, commandOffset + i * commandStride, 1, commandStride);
+		}
+	}
+}
+
+void IndirectCulling::prepareFrame(Frame& frame, Scene* scene)
+{
+	/*
+		The mesh table is rebuilt every frame, it is as long as the mesh count and keeps
+		the buffers of a frame in flight from depending on how the scene looked for another one.
+	*/
+	uint32_t meshCount = scene->getMeshCount();
+	uint32_t instanceCount = scene->getInstanceCount();
+
+	meshDraws.assign(meshCount, { 0, 0, 0, 0, glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) });
+	for (uint32_t i = 0; i < meshCount; i++) {
+		Model* model = scene->getModel(i);
+		meshDraws[i].indexCount = model->getIndexCount();
+		meshDraws[i].firstIndex = model->getFirstIndex();
+		meshDraws[i].vertexOffset = model->getVertexOffset();
+		meshDraws[i].boundingSphere = model->getBoundingSphere();
+		meshDraws[i].boxMin = glm::vec4(model->getBoundingBox().min, 0.0f);
+		meshDraws[i].boxMax = glm::vec4(model->getBoundingBox().max, 0.0f);
+	}
+	for (const Scene::Batch& batch : scene->getBatches()) {
+		meshDraws[batch.meshIndex].firstInstance = batch.firstInstance;
+	}
+
+	VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	// What the GPU writes stays in device local memory, what the CPU writes or validation reads back is host visible
+	VkMemoryPropertyFlags outputProperties = useGpu && !isValidated ? static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) : hostVisible;
+
+	// Sizes never reach 0, so there always is a buffer to bind
+	VkDeviceSize meshesSize = std::max<VkDeviceSize>(1, meshCount) * sizeof(MeshDraw);
+	VkDeviceSize instancesSize = std::max<VkDeviceSize>(1, instanceCount) * sizeof(InstanceData);
+	VkDeviceSize indirectSize = sizeof(IndirectHeader) + std::max<VkDeviceSize>(1, meshCount) * sizeof(VkDrawIndexedIndirectCommand);
+
+	ensureBuffer(frame.meshes, meshesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+	ensureBuffer(frame.instances, instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, outputProperties);
+	ensureBuffer(frame.indirect, indirectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, outputProperties);
+	if (useGpu) {
+		ensureBuffer(frame.counts, 2 * std::max<VkDeviceSize>(1, meshCount) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+	if (isOcclusionCulled()) {
+		ensureBuffer(frame.lateIndirect, indirectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		ensureBuffer(frame.visibility, std::max<VkDeviceSize>(1, instanceCount) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		ensureBuffer(frame.occlusion, sizeof(Occlusion), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible);
+	}
+
+	if (meshCount > 0) {
+		memcpy(frame.meshes.allocation.mapped, meshDraws.data(), meshCount * sizeof(MeshDraw));
+	}
+	frame.meshCount = meshCount;
+}
+
+void IndirectCulling::cullOnGpu(VkCommandBuffer commandBuffer, Frame& frame, Scene* scene, uint32_t frameIndex, const Frustum& frustum, PHASE phase)
+{
+	uint32_t instanceCount = scene->getInstanceCount();
+	VkBuffer indirectBuffer = phase == PHASE_LATE ? frame.lateIndirect.buffer : frame.indirect.buffer;
+	VkDescriptorSet descriptorSet = phase == PHASE_LATE ? frame.lateDescriptorSet : frame.descriptorSet;
+
+	if (instanceCount == 0) {
+		vkCmdFillBuffer(commandBuffer, indirectBuffer, 0, sizeof(IndirectHeader), 0);
+	}
+	else {
+		// Buffers may have been replaced since the frame was last culled, so the set is written every frame
+		writeDescriptorSet(descriptorSet, frame, scene, frameIndex, indirectBuffer);
+
+		PushConstant pushConstant;
+		std::copy(std::begin(frustum.planes), std::end(frustum.planes), pushConstant.planes);
+		pushConstant.instanceCount = instanceCount;
+		pushConstant.meshCount = frame.meshCount;
+		pushConstant.phase = phase;
+
+		if (phase == PHASE_LATE) {
+			// The late phase reads the early counts and appends behind the early instances
+			VkMemoryBarrier earlyBarrier = {};
+			earlyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			earlyBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			earlyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &earlyBarrier, 0, nullptr, 0, nullptr);
+		}
+		else {
+			vkCmdFillBuffer(commandBuffer, frame.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+			// New instances start out not visible, the late phase draws them if they are
+			if (isOcclusionCulled() && frame.visibilityCount != instanceCount) {
+				vkCmdFillBuffer(commandBuffer, frame.visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+				frame.visibilityCount = instanceCount;
+			}
+
+			VkMemoryBarrier clearBarrier = {};
+			clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdDispatch(commandBuffer, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		// The compaction needs every instance counted
+		VkMemoryBarrier countBarrier = {};
+		countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		countBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &countBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compactPipeline);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+	}
+
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+	// Validation reads the results on the host once the frame's fence signaled
+	if (isValidated) {
+		drawBarrier.dstAccessMask |= VK_ACCESS_HOST_READ_BIT;
+		dstStages |= VK_PIPELINE_STAGE_HOST_BIT;
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		dstStages,
+		0, 1, &drawBarrier, 0, nullptr, 0, nullptr
+	);
+}
+
+void IndirectCulling::writeDescriptorSet(VkDescriptorSet descriptorSet, Frame& frame, Scene* scene, uint32_t frameIndex, VkBuffer indirectBuffer)
+{
+	// Instances, meshes, visible counts, culled instances, indirect commands, visibility
+	std::array<VkDescriptorBufferInfo, 6> bufferInfos = {};
+	bufferInfos[0].buffer = scene->getInstanceBuffer(frameIndex);
+	bufferInfos[1].buffer = frame.meshes.buffer;
+	bufferInfos[2].buffer = frame.counts.buffer;
+	bufferInfos[3].buffer = frame.instances.buffer;
+	bufferInfos[4].buffer = indirectBuffer;
+	bufferInfos[5].buffer = frame.visibility.buffer;
+
+	uint32_t storageBufferCount = isOcclusionCulled() ? 6 : 5;
+
+	std::array<VkWriteDescriptorSet, 8> writeSets = {};
+	for (uint32_t i = 0; i < storageBufferCount; i++) {
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writeSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[i].dstSet = descriptorSet;
+		writeSets[i].dstBinding = i;
+		writeSets[i].dstArrayElement = 0;
+		writeSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeSets[i].descriptorCount = 1;
+		writeSets[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	if (!isOcclusionCulled()) {
+		vkUpdateDescriptorSets(device, storageBufferCount, writeSets.data(), 0, nullptr);
+		return;
+	}
+
+	VkDescriptorImageInfo pyramidInfo = {};
+	pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidInfo.imageView = depthPyramid->getImageView();
+	pyramidInfo.sampler = depthPyramid->getSampler();
+
+	VkDescriptorBufferInfo occlusionInfo = {};
+	occlusionInfo.buffer = frame.occlusion.buffer;
+	occlusionInfo.offset = 0;
+	occlusionInfo.range = sizeof(Occlusion);
+
+	writeSets[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeSets[6].dstSet = descriptorSet;
+	writeSets[6].dstBinding = 6;
+	writeSets[6].dstArrayElement = 0;
+	writeSets[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeSets[6].descriptorCount = 1;
+	writeSets[6].pImageInfo = &pyramidInfo;
+
+	writeSets[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeSets[7].dstSet = descriptorSet;
+	writeSets[7].dstBinding = 7;
+	writeSets[7].dstArrayElement = 0;
+	writeSets[7].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeSets[7].descriptorCount = 1;
+	writeSets[7].pBufferInfo = &occlusionInfo;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+}
+
+uint32_t IndirectCulling::cullOnCpu(Scene* scene, const Frustum& frustum, InstanceData* culledInstances, VkDrawIndexedIndirectCommand* commands)
+{
+	/*
+		Same tests and output layout as cull.comp and compact.comp. The instances of a mesh's range are in
+		instance order, the GPU appends them in whatever order its invocations run.
+	*/
+	const std::vector<InstanceData>& instances = scene->getInstanceData();
+	const std::vector<BoundingBox>& instanceBounds = scene->getInstanceBounds();
+	uint32_t meshCount = static_cast<uint32_t>(meshDraws.size());
+
+	/*
+		The scene's BVH does the box test: it rejects groups of instances whose boxes are all behind a plane and
+		accepts groups entirely inside the frustum, only the boxes of leaves the frustum cuts through are tested
+		one by one. Every instance it returns gets the sphere test. Spheres are stored in BVH item order, so the
+		ranges are contiguous runs of spheres for the SIMD loops.
+	*/
+	const Bvh& bvh = scene->getBvh();
+	const std::vector<uint32_t>& bvhItems = bvh.getItems();
+
+	// Instance spheres only move with the instances
+	if (cullerVersion != scene->getVersion()) {
+		culler.resize(static_cast<uint32_t>(bvhItems.size()));
+		for (uint32_t i = 0; i < bvhItems.size(); i++) {
+			const InstanceData& instance = instances[bvhItems[i]];
+			culler.setSphere(i, instance.transform, meshDraws[instance.meshIndex].boundingSphere);
+		}
+		cullerVersion = scene->getVersion();
+	}
+
+	itemRanges.clear();
+	bvh.queryFrustum(frustum, itemRanges);
+
+	if (visibleIndices.size() < bvhItems.size() + FrustumCuller::BATCH_SIZE) {
+		visibleIndices.resize(bvhItems.size() + FrustumCuller::BATCH_SIZE);
+	}
+
+	uint32_t visibleCount = 0;
+	for (const Bvh::ItemRange& range : itemRanges) {
+		uint32_t* rangeVisible = visibleIndices.data() + visibleCount;
+		uint32_t rangeVisibleCount = culler.cull(frustum, range.firstItem, range.itemCount, rangeVisible);
+
+		if (range.isInside) {
+			visibleCount += rangeVisibleCount;
+			continue;
+		}
+
+		// Compacted in place, the write position never passes the read position
+		for (uint32_t i = 0; i < rangeVisibleCount; i++) {
+			const BoundingBox& bounds = instanceBounds[bvhItems[rangeVisible[i]]];
+			if (frustum.isBoxVisible(bounds.min, bounds.max)) {
+				visibleIndices[visibleCount++] = rangeVisible[i];
+			}
+		}
+	}
+
+	// Batches list their instances in the scene's order, so sorted positions give sorted ranges
+	for (uint32_t i = 0; i < visibleCount; i++) {
+		visibleIndices[i] = bvhItems[visibleIndices[i]];
+	}
+	std::sort(visibleIndices.begin(), visibleIndices.begin() + visibleCount);
+
+	visibleCounts.assign(meshCount, 0);
+
+	for (uint32_t i = 0; i < visibleCount; i++) {
+		const InstanceData& instance = instances[visibleIndices[i]];
+		culledInstances[meshDraws[instance.meshIndex].firstInstance + visibleCounts[instance.meshIndex]++] = instance;
+	}
+
+	uint32_t drawCount = 0;
+	for (uint32_t i = 0; i < meshCount; i++) {
+		if (visibleCounts[i] == 0) {
+			continue;
+		}
+
+		const MeshDraw& meshDraw = meshDraws[i];
+		commands[drawCount].indexCount = meshDraw.indexCount;
+		commands[drawCount].instanceCount = visibleCounts[i];
+		commands[drawCount].firstIndex = meshDraw.firstIndex;
+		commands[drawCount].vertexOffset = meshDraw.vertexOffset;
+		commands[drawCount].firstInstance = meshDraw.firstInstance;
+		drawCount++;
+	}
+
+	return drawCount;
+}
+
+void IndirectCulling::validate(Frame& frame)
+{
+	PROFILE_FUNCTION();
+
+	frame.hasExpected = false;
+
+	const IndirectHeader* header = static_cast<const IndirectHeader*>(frame.indirect.allocation.mapped);
+	const VkDrawIndexedIndirectCommand* commands = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(header + 1);
+	const InstanceData* culledInstances = static_cast<const InstanceData*>(frame.instances.allocation.mapped);
+
+	uint32_t expectedDrawCount = static_cast<uint32_t>(frame.expectedCommands.size());
+	bool isMatching = header->drawCount == expectedDrawCount;
+
+	for (uint32_t i = 0; isMatching && i < expectedDrawCount; i++) {
+		const VkDrawIndexedIndirectCommand& command = commands[i];
+		const VkDrawIndexedIndirectCommand& expected = frame.expectedCommands[i];
+
+		isMatching =
+			command.indexCount == expected.indexCount &&
+			command.instanceCount == expected.instanceCount &&
+			command.firstIndex == expected.firstIndex &&
+			command.vertexOffset == expected.vertexOffset &&
+			command.firstInstance == expected.firstInstance;
+		if (!isMatching) {
+			break;
+		}
+
+		// Sorted like the CPU's range
+		rangeIndices.resize(command.instanceCount);
+		for (uint32_t j = 0; j < command.instanceCount; j++) {
+			rangeIndices[j] = culledInstances[command.firstInstance + j].instanceIndex;
+		}
+		std::sort(rangeIndices.begin(), rangeIndices.end());
+
+		for (uint32_t j = 0; isMatching && j < command.instanceCount; j++) {
+			isMatching = rangeIndices[j] == frame.expectedInstances[expected.firstInstance + j].instanceIndex;
+		}
+	}
+
+	validatedFrameCount++;
+	if (!isMatching) {
+		differingFrameCount++;
+		std::cerr << "WARNING: GPU culling differs from CPU culling, " << header->drawCount << " draws against " << expectedDrawCount << "." << std::endl;
+	}
+}
+
+void IndirectCulling::createDescriptorSetLayout()
+{
+	// Instances, meshes, visible counts, culled instances, indirect commands, then for occlusion culling visibility, depth pyramid and occlusion uniform
+	uint32_t bindingCount = isOcclusionCulled() ? 8 : 5;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+	if (isOcclusionCulled()) {
+		bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Culling Descriptor Set Layout.");
+	}
+}
+
+void IndirectCulling::createDescriptorSets()
+{
+	uint32_t frameCount = static_cast<uint32_t>(frames.size());
+	// Occlusion culling has a set for each phase, they differ in the indirect buffer
+	uint32_t setCount = isOcclusionCulled() ? 2 * frameCount : frameCount;
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].descriptorCount = (isOcclusionCulled() ? 6 : 5) * setCount;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = setCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.maxSets = setCount;
+	descriptorPoolInfo.poolSizeCount = isOcclusionCulled() ? static_cast<uint32_t>(poolSizes.size()) : 1;
+	descriptorPoolInfo.pPoolSizes = poolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Culling Descriptor Pool.");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout);
+	std::vector<VkDescriptorSet> descriptorSets(setCount);
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = setCount;
+	allocateInfo.pSetLayouts = layouts.data();
+
+	result = vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot allocate Culling Descriptor Sets.");
+	}
+
+	for (uint32_t i = 0; i < frameCount; i++) {
+		frames[i].descriptorSet = descriptorSets[i];
+		if (isOcclusionCulled()) {
+			frames[i].lateDescriptorSet = descriptorSets[frameCount + i];
+		}
+	}
+}
+
+void IndirectCulling::createPipelines()
+{
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstant);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Culling Pipeline Layout.");
+	}
+
+	// Same shader built with OCCLUSION defined
+	Shader cullShader(device, isOcclusionCulled() ? "shaders/cull_occlusion_comp.spv" : "shaders/cull_comp.spv");
+	Shader compactShader(device, "shaders/compact_comp.spv");
+
+	std::array<VkComputePipelineCreateInfo, 2> pipelineInfos = {};
+	std::array<VkShaderModule, 2> shaderModules = { cullShader.getShaderModule(), compactShader.getShaderModule() };
+
+	for (uint32_t i = 0; i < pipelineInfos.size(); i++) {
+		pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfos[i].stage.module = shaderModules[i];
+		pipelineInfos[i].stage.pName = "main";
+		pipelineInfos[i].layout = pipelineLayout;
+	}
+
+	std::array<VkPipeline, 2> pipelines = {};
+	result = vkCreateComputePipelines(device, pipelineCache, static_cast<uint32_t>(pipelineInfos.size()), pipelineInfos.data(), nullptr, pipelines.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Culling Pipelines.");
+	}
+
+	cullPipeline = pipelines[0];
+	compactPipeline = pipelines[1];
+}
+
+void IndirectCulling::ensureBuffer(FrameBuffer& frameBuffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+{
+	if (frameBuffer.size >= size) {
+		return;
+	}
+
+	// Before destroying, which zeroes the size
+	size = std::max(size, frameBuffer.size * 2);
+	// The frame's fence was waited on, so the old buffer can go right away
+	destroyBuffer(frameBuffer);
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &frameBuffer.buffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Culling Buffer.");
+	}
+
+	frameBuffer.allocation = allocator->allocateBuffer(frameBuffer.buffer, properties);
+	frameBuffer.size = size;
+}
+
+void IndirectCulling::destroyBuffer(FrameBuffer& frameBuffer)
+{
+	if (frameBuffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDestroyBuffer(device, frameBuffer.buffer, nullptr);
+	allocator->free(frameBuffer.allocation);
+
+	frameBuffer.buffer = VK_NULL_HANDLE;
+	frameBuffer.size = 0;
+}
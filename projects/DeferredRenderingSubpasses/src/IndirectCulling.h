@@ -0,0 +1,193 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "MemoryAllocator.h"
+#include "Scene.h"
+#include "Frustum.h"
+#include "FrustumCuller.h"
+#include "DepthPyramid.h"
+
+/*
+	Frustum culling of scene instances that feeds indirect draws.
+
+	Visible instances are compacted per mesh into an instance buffer, in the ranges the scene's batches
+	reserve for them, and every mesh with visible instances gets a VkDrawIndexedIndirectCommand. The
+	commands are packed in mesh order after a draw count, and drawn with vkCmdDrawIndexedIndirectCount.
+	All meshes share the MeshArena buffers and meshes pick textures by the meshIndex of the instance, so
+	one indirect draw renders the whole scene and recording costs the same for any number of instances.
+
+	An instance is visible when neither its bounding sphere nor its world box is completely behind a
+	frustum plane. On the GPU two compute passes do the work: cull_comp.spv tests one instance per
+	invocation and appends the visible ones to their mesh's range, compact_comp.spv then writes the
+	commands. The CPU fallback walks the scene's BVH, whose boxes give the box test, runs FrustumCuller's
+	SIMD sphere test on every instance it returns and writes the same draw count and commands into host
+	visible buffers, for devices without drawIndirectCount. Its ranges are sorted by instance.
+
+	With validation on, GPU culling is also done on the CPU and the GPU's results are read back and
+	compared once the frame's fence signaled, ranges sorted by InstanceData::instanceIndex since the GPU
+	appends in any order. Instances right on a plane may still differ by float rounding.
+
+	With a DepthPyramid the GPU path also culls occluded instances, in two phases. cull() draws what the
+	last culling of the frame found visible, without an occlusion test. After those draws fill the depth
+	buffer and the pyramid is built from it, cullLate() tests every instance against the pyramid, keeps
+	the result for the next frame and draws the instances that turned visible. Late instances follow the
+	early ones in their mesh's range and get their own indirect buffer.
+
+	Buffers are per frame in flight, like the scene's instance buffers the culling reads.
+*/
+class IndirectCulling
+{
+public:
+
+	IndirectCulling(
+		VkDevice device,
+		MemoryAllocator* allocator,
+		VkPipelineCache pipelineCache,
+		uint32_t frameCount,
+		bool useGpu,
+		bool isDrawCountSupported,
+		bool isMultiDrawSupported,
+		DepthPyramid* depthPyramid = nullptr,
+		bool isValidated = false
+	);
+	~IndirectCulling();
+
+	// GPU culling is recorded to the command buffer and must be outside of a render pass, CPU culling runs right away
+	void cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene* scene, const Frustum& frustum);
+	// Occlusion culling only, after the early draws' depth is in the depth pyramid, also outside of a render pass
+	void cullLate(VkCommandBuffer commandBuffer, uint32_t frameIndex, Scene* scene, const Frustum& frustum, const glm::mat4& viewProjection);
+	// Needs the pipeline, descriptor sets, index buffer and vertex buffers bound, with getInstanceBuffer() at binding 1
+	void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void drawLate(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	// Getters
+	VkBuffer getInstanceBuffer(uint32_t frameIndex) { return frames[frameIndex].instances.buffer; }
+	bool isGpu() { return useGpu; }
+	bool isOcclusionCulled() { return depthPyramid != nullptr; }
+
+private:
+
+	// Keep in sync with shaders/cull.comp
+	enum PHASE
+	{
+		PHASE_ALL,
+		PHASE_EARLY,
+		PHASE_LATE
+	};
+
+	// Per mesh input of the culling, std430 layout of cull.comp
+	struct MeshDraw
+	{
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance;
+		glm::vec4 boundingSphere;
+		glm::vec4 boxMin;
+		glm::vec4 boxMax;
+	};
+
+	// Start of the indirect buffer, the commands follow
+	struct IndirectHeader
+	{
+		uint32_t drawCount;
+		uint32_t padding[3];
+	};
+
+	struct PushConstant
+	{
+		glm::vec4 planes[Frustum::PLANE_COUNT];
+		uint32_t instanceCount;
+		uint32_t meshCount;
+		uint32_t phase;
+	};
+
+	// Uniform buffer of cull_occlusion_comp.spv
+	struct Occlusion
+	{
+		glm::mat4 viewProjection;
+		glm::vec2 pyramidSize;
+		glm::vec2 padding;
+	};
+
+	struct FrameBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		VkDeviceSize size = 0;
+	};
+
+	struct Frame
+	{
+		FrameBuffer meshes;
+		// Visible instances per mesh, GPU only, the late phase's counts follow the early ones
+		FrameBuffer counts;
+		FrameBuffer instances;
+		FrameBuffer indirect;
+		VkDescriptorSet descriptorSet;
+		// Occlusion culling only
+		FrameBuffer lateIndirect;
+		FrameBuffer visibility;
+		FrameBuffer occlusion;
+		VkDescriptorSet lateDescriptorSet;
+		// Instances the visibility flags were cleared for
+		uint32_t visibilityCount = 0;
+		uint32_t meshCount = 0;
+		// Known on the CPU only for CPU culling
+		uint32_t drawCount = 0;
+		// Validation only, what the CPU culled for the frame the GPU results belong to
+		std::vector<InstanceData> expectedInstances;
+		std::vector<VkDrawIndexedIndirectCommand> expectedCommands;
+		bool hasExpected = false;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+	VkPipelineCache pipelineCache;
+	bool useGpu;
+	bool isDrawCountSupported;
+	bool isMultiDrawSupported;
+	DepthPyramid* depthPyramid;
+	bool isValidated;
+	uint32_t validatedFrameCount = 0;
+	uint32_t differingFrameCount = 0;
+
+	std::vector<Frame> frames;
+	std::vector<MeshDraw> meshDraws;
+	std::vector<uint32_t> visibleCounts;
+	// CPU culling, spheres in the order of the scene BVH's items
+	FrustumCuller culler;
+	// Scene version the culler's spheres were placed for
+	uint64_t cullerVersion = 0;
+	std::vector<Bvh::ItemRange> itemRanges;
+	std::vector<uint32_t> visibleIndices;
+	// Validation, instance indices of one range the GPU culled
+	std::vector<uint32_t> rangeIndices;
+
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	VkPipeline compactPipeline = VK_NULL_HANDLE;
+
+	void createDescriptorSetLayout();
+	void createDescriptorSets();
+	void createPipelines();
+	void prepareFrame(Frame& frame, Scene* scene);
+	void cullOnGpu(VkCommandBuffer commandBuffer, Frame& frame, Scene* scene, uint32_t frameIndex, const Frustum& frustum, PHASE phase);
+	void writeDescriptorSet(VkDescriptorSet descriptorSet, Frame& frame, Scene* scene, uint32_t frameIndex, VkBuffer indirectBuffer);
+	// drawCount is the count written into indirectBuffer, only read without drawIndirectCount
+	void drawIndirect(VkCommandBuffer commandBuffer, Frame& frame, VkBuffer indirectBuffer, uint32_t drawCount);
+	// Returns the draw count, commands are written in mesh order
+	uint32_t cullOnCpu(Scene* scene, const Frustum& frustum, InstanceData* culledInstances, VkDrawIndexedIndirectCommand* commands);
+	// Compares the GPU results of the frame's last culling with the CPU's, the frame's fence must have signaled
+	void validate(Frame& frame);
+	void ensureBuffer(FrameBuffer& frameBuffer, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+	void destroyBuffer(FrameBuffer& frameBuffer);
+};
@@ -1,38 +1,35 @@
 #pragma once
 
-// std
-#include <array>
-
-#include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
+/*
+	Point light, its color fades out to nothing at radius.
+*/
 class Light
 {
 public:
 
+	// std430 layout of the light buffer in shaders/second.frag
 	struct Properties
 	{
-		alignas(0)	glm::vec3 position;
+		alignas(16) glm::vec3 position;
+		float radius;
 		alignas(16) glm::vec3 color;
+		float padding;
 	};
 	
-	Light(VkDevice device, VkPhysicalDevice physicalDevice, glm::vec3 position, glm::vec3 color);
-	~Light();
+	Light(glm::vec3 position, glm::vec3 color, float radius);
+
+	void setPosition(glm::vec3 position) { properties.position = position; }
 
 	// Getters
-	glm::vec3 getPostion() { return properties.position; }
-	glm::vec3 getColor() { return properties.color; }
-	VkBuffer getBuffer() { return buffer; }
+	glm::vec3 getPostion() const { return properties.position; }
+	glm::vec3 getColor() const { return properties.color; }
+	float getRadius() const { return properties.radius; }
+	// Written to the light buffer every frame by the light grid
+	const Properties& getProperties() const { return properties; }
 
 private:
 
 	Properties properties;
-	
-	VkDevice device;
-	VkPhysicalDevice physicalDevice;
-	VkBuffer buffer;
-	VkDeviceMemory bufferMemory;
-
-	void createBuffer();
 };
-
@@ -0,0 +1,182 @@
+#include "LightGrid.h"
+
+// std
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#include "Frustum.h"
+#include "CpuProfiler.h"
+
+#define AMBIENT_LIGHT 0.1f
+
+LightGrid::LightGrid(VkDevice device, MemoryAllocator* allocator, uint32_t frameCount)
+{
+	this->device = device;
+	this->allocator = allocator;
+
+	frames.resize(frameCount);
+
+	info.tileSize = TILE_SIZE;
+	info.ambient = glm::vec4(glm::vec3(AMBIENT_LIGHT), 1.0f);
+}
+
+LightGrid::~LightGrid()
+{
+	for (Frame& frame : frames) {
+		destroyBuffer(frame.lights);
+		destroyBuffer(frame.tiles);
+		destroyBuffer(frame.indices);
+	}
+}
+
+void LightGrid::update(uint32_t frameIndex, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent)
+{
+	PROFILE_FUNCTION();
+
+	Frame& frame = frames[frameIndex];
+	uint32_t lightCount = static_cast<uint32_t>(lights.size());
+
+	info.tileCountX = (extent.width + TILE_SIZE - 1) / TILE_SIZE;
+	info.tileCountY = (extent.height + TILE_SIZE - 1) / TILE_SIZE;
+	info.lightCount = lightCount;
+	uint32_t tileCount = info.tileCountX * info.tileCountY;
+
+	// Lights outside of the view reach no tile
+	culler.resize(lightCount);
+	for (uint32_t i = 0; i < lightCount; i++) {
+		culler.setSphere(i, lights[i].getPostion(), lights[i].getRadius());
+	}
+	uint32_t visibleCount = culler.cull(Frustum(projection * view), visibleIndices);
+
+	tileRects.clear();
+	tiles.assign(tileCount, { 0, 0 });
+
+	for (uint32_t i = 0; i < visibleCount; i++) {
+		TileRect tileRect;
+		tileRect.lightIndex = visibleIndices[i];
+		if (!getTileRect(lights[tileRect.lightIndex], view, projection, extent, tileRect)) {
+			continue;
+		}
+
+		for (uint32_t y = tileRect.minY; y <= tileRect.maxY; y++) {
+			for (uint32_t x = tileRect.minX; x <= tileRect.maxX; x++) {
+				tiles[y * info.tileCountX + x].lightCount++;
+			}
+		}
+		tileRects.push_back(tileRect);
+	}
+
+	// Tile lists are packed back to back in tile order
+	indexCount = 0;
+	for (Tile& tile : tiles) {
+		tile.firstIndex = indexCount;
+		indexCount += tile.lightCount;
+		tile.lightCount = 0;
+	}
+
+	// Sizes never reach 0, so there always is a buffer to bind
+	ensureBuffer(frame.lights, std::max<VkDeviceSize>(1, lightCount) * sizeof(Light::Properties));
+	ensureBuffer(frame.tiles, std::max<VkDeviceSize>(1, tileCount) * sizeof(Tile));
+	ensureBuffer(frame.indices, std::max<VkDeviceSize>(1, indexCount) * sizeof(uint32_t));
+
+	Light::Properties* mappedLights = static_cast<Light::Properties*>(frame.lights.allocation.mapped);
+	for (uint32_t i = 0; i < lightCount; i++) {
+		mappedLights[i] = lights[i].getProperties();
+	}
+
+	uint32_t* mappedIndices = static_cast<uint32_t*>(frame.indices.allocation.mapped);
+	for (const TileRect& tileRect : tileRects) {
+		for (uint32_t y = tileRect.minY; y <= tileRect.maxY; y++) {
+			for (uint32_t x = tileRect.minX; x <= tileRect.maxX; x++) {
+				Tile& tile = tiles[y * info.tileCountX + x];
+				mappedIndices[tile.firstIndex + tile.lightCount++] = tileRect.lightIndex;
+			}
+		}
+	}
+
+	if (tileCount > 0) {
+		memcpy(frame.tiles.allocation.mapped, tiles.data(), tileCount * sizeof(Tile));
+	}
+}
+
+bool LightGrid::getTileRect(const Light& light, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent, TileRect& tileRect)
+{
+	/*
+		The screen bounds of the box around the sphere in view space hold the sphere's. A sphere
+		reaching through the near plane would project past infinity, it gets every tile instead.
+	*/
+	glm::vec3 center = glm::vec3(view * glm::vec4(light.getPostion(), 1.0f));
+	float radius = light.getRadius();
+	// Near plane of a zero to one depth perspective projection
+	float nearPlane = projection[3][2] / projection[2][2];
+
+	glm::vec2 boundsMin(1.0f);
+	glm::vec2 boundsMax(-1.0f);
+
+	if (center.z + radius > -nearPlane) {
+		boundsMin = glm::vec2(-1.0f);
+		boundsMax = glm::vec2(1.0f);
+	}
+	else {
+		for (int i = 0; i < 8; i++) {
+			glm::vec3 corner = center + radius * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+			glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+			glm::vec2 ndc = glm::vec2(clip) / clip.w;
+			boundsMin = glm::min(boundsMin, ndc);
+			boundsMax = glm::max(boundsMax, ndc);
+		}
+	}
+
+	boundsMin = glm::clamp(boundsMin * 0.5f + 0.5f, 0.0f, 1.0f);
+	boundsMax = glm::clamp(boundsMax * 0.5f + 0.5f, 0.0f, 1.0f);
+	if (boundsMin.x >= boundsMax.x || boundsMin.y >= boundsMax.y) {
+		return false;
+	}
+
+	tileRect.minX = std::min(static_cast<uint32_t>(boundsMin.x * extent.width) / TILE_SIZE, info.tileCountX - 1);
+	tileRect.minY = std::min(static_cast<uint32_t>(boundsMin.y * extent.height) / TILE_SIZE, info.tileCountY - 1);
+	tileRect.maxX = std::min(static_cast<uint32_t>(boundsMax.x * extent.width) / TILE_SIZE, info.tileCountX - 1);
+	tileRect.maxY = std::min(static_cast<uint32_t>(boundsMax.y * extent.height) / TILE_SIZE, info.tileCountY - 1);
+
+	return true;
+}
+
+void LightGrid::ensureBuffer(FrameBuffer& frameBuffer, VkDeviceSize size)
+{
+	if (frameBuffer.size >= size) {
+		return;
+	}
+
+	// Before destroying, which zeroes the size
+	size = std::max(size, frameBuffer.size * 2);
+	// The frame's fence was waited on, so the old buffer can go right away
+	destroyBuffer(frameBuffer);
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &frameBuffer.buffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Light Grid Buffer.");
+	}
+
+	frameBuffer.allocation = allocator->allocateBuffer(frameBuffer.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	frameBuffer.size = size;
+}
+
+void LightGrid::destroyBuffer(FrameBuffer& frameBuffer)
+{
+	if (frameBuffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDestroyBuffer(device, frameBuffer.buffer, nullptr);
+	allocator->free(frameBuffer.allocation);
+
+	frameBuffer.buffer = VK_NULL_HANDLE;
+	frameBuffer.size = 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "MemoryAllocator.h"
+#include "Light.h"
+#include "FrustumCuller.h"
+
+/*
+	Screen tiles with the lists of point lights that reach them, for tiled deferred lighting.
+
+	Every frame the lights are frustum culled with FrustumCuller's SIMD loops, the screen bounds of
+	the survivors' spheres are binned into TILE_SIZE x TILE_SIZE pixel tiles and the per tile lists
+	are packed into one index buffer. The lighting subpass looks up the tile of its pixel and only
+	shades the lights in its list, so its cost follows how many lights overlap a pixel, not how many
+	the scene has.
+
+	Buffers are host visible and per frame in flight, written after the frame's fence was waited on:
+	the lights, a (first index, light count) pair per tile, and the light indices of all tiles.
+*/
+class LightGrid
+{
+public:
+
+	static const uint32_t TILE_SIZE = 16;
+
+	// std140 layout of the grid uniform of shaders/second.frag
+	struct Info
+	{
+		uint32_t tileSize;
+		uint32_t tileCountX;
+		uint32_t tileCountY;
+		uint32_t lightCount;
+		glm::vec4 ambient;
+	};
+
+	LightGrid(VkDevice device, MemoryAllocator* allocator, uint32_t frameCount);
+	~LightGrid();
+
+	// Lights are in the space of the G-buffer positions, view and projection are the camera's
+	void update(uint32_t frameIndex, const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent);
+
+	// Getters
+	const Info& getInfo() { return info; }
+	VkBuffer getLightBuffer(uint32_t frameIndex) { return frames[frameIndex].lights.buffer; }
+	VkBuffer getTileBuffer(uint32_t frameIndex) { return frames[frameIndex].tiles.buffer; }
+	VkBuffer getIndexBuffer(uint32_t frameIndex) { return frames[frameIndex].indices.buffer; }
+	// Of the last update, summed over the tiles
+	uint32_t getIndexCount() { return indexCount; }
+
+private:
+
+	// Light list of a tile in the index buffer
+	struct Tile
+	{
+		uint32_t firstIndex;
+		uint32_t lightCount;
+	};
+
+	// Tiles touched by a light, inclusive
+	struct TileRect
+	{
+		uint32_t lightIndex;
+		uint32_t minX;
+		uint32_t minY;
+		uint32_t maxX;
+		uint32_t maxY;
+	};
+
+	struct FrameBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		VkDeviceSize size = 0;
+	};
+
+	struct Frame
+	{
+		FrameBuffer lights;
+		FrameBuffer tiles;
+		FrameBuffer indices;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+
+	std::vector<Frame> frames;
+	Info info = {};
+	uint32_t indexCount = 0;
+
+	FrustumCuller culler;
+	std::vector<uint32_t> visibleIndices;
+	std::vector<TileRect> tileRects;
+	std::vector<Tile> tiles;
+
+	bool getTileRect(const Light& light, const glm::mat4& view, const glm::mat4& projection, VkExtent2D extent, TileRect& tileRect);
+	void ensureBuffer(FrameBuffer& frameBuffer, VkDeviceSize size);
+	void destroyBuffer(FrameBuffer& frameBuffer);
+};
@@ -0,0 +1,281 @@
+#include "MemoryAllocator.h"
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+{
+	this->device = device;
+	this->blockSize = blockSize;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties = {};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	bufferImageGranularity = std::max<VkDeviceSize>(1, deviceProperties.limits.bufferImageGranularity);
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (Block* block : blocks) {
+		destroyBlock(block);
+	}
+	blocks.clear();
+}
+
+MemoryAllocator::Allocation MemoryAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryRequirements memRequirements = {};
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	Allocation allocation = allocate(memRequirements, properties, true);
+
+	VkResult result = vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot bind Buffer Memory.");
+	}
+
+	return allocation;
+}
+
+MemoryAllocator::Allocation MemoryAllocator::allocateImage(VkImage image, VkMemoryPropertyFlags properties)
+{
+	VkMemoryRequirements memRequirements = {};
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+	// Every image in this renderer uses VK_IMAGE_TILING_OPTIMAL
+	Allocation allocation = allocate(memRequirements, properties, false);
+
+	VkResult result = vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot bind Image Memory.");
+	}
+
+	return allocation;
+}
+
+MemoryAllocator::Allocation MemoryAllocator::allocate(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool isLinear)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+	Block* target = nullptr;
+	VkDeviceSize offset = 0;
+
+	if (requirements.size > blockSize / 2) {
+		target = createBlock(memoryType, requirements.size, true);
+		allocateFromBlock(*target, requirements.size, requirements.alignment, isLinear, offset);
+	}
+	else {
+		for (Block* block : blocks) {
+			if (block->memoryType == memoryType && !block->isDedicated
+				&& allocateFromBlock(*block, requirements.size, requirements.alignment, isLinear, offset)) {
+				target = block;
+				break;
+			}
+		}
+
+		if (!target) {
+			target = createBlock(memoryType, blockSize, false);
+			allocateFromBlock(*target, requirements.size, requirements.alignment, isLinear, offset);
+		}
+	}
+
+	allocationCount++;
+
+	Allocation allocation = {};
+	allocation.memory = target->memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.mapped = target->mapped ? static_cast<char*>(target->mapped) + offset : nullptr;
+
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto blockIt = std::find_if(blocks.begin(), blocks.end(), [&allocation](Block* block) {
+		return block->memory == allocation.memory;
+	});
+	if (blockIt == blocks.end()) {
+		throw std::runtime_error("ERROR: cannot free memory that was not allocated by MemoryAllocator.");
+	}
+
+	Block* block = *blockIt;
+	auto it = block->ranges.find(allocation.offset);
+	it->second.isFree = true;
+
+	// Merge with the free neighbours
+	auto next = std::next(it);
+	if (next != block->ranges.end() && next->second.isFree) {
+		it->second.size += next->second.size;
+		block->ranges.erase(next);
+	}
+
+	if (it != block->ranges.begin()) {
+		auto previous = std::prev(it);
+		if (previous->second.isFree) {
+			previous->second.size += it->second.size;
+			block->ranges.erase(it);
+		}
+	}
+
+	allocationCount--;
+	allocation = {};
+
+	if (block->isDedicated) {
+		destroyBlock(block);
+		blocks.erase(blockIt);
+	}
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("ERROR: cannot find suitable memory!");
+}
+
+bool MemoryAllocator::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MemoryAllocator::Block* MemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool isDedicated)
+{
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryType;
+
+	VkDeviceMemory memory;
+	VkResult result = vkAllocateMemory(device, &allocateInfo, nullptr, &memory);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot allocate Memory Block.");
+	}
+
+	void* mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+		if (result != VK_SUCCESS) {
+			vkFreeMemory(device, memory, nullptr);
+			throw std::runtime_error("ERROR: cannot map Memory Block.");
+		}
+	}
+
+	Block* block = new Block();
+	block->memory = memory;
+	block->size = size;
+	block->memoryType = memoryType;
+	block->mapped = mapped;
+	block->isDedicated = isDedicated;
+	block->ranges[0] = { size, true, false };
+
+	blocks.push_back(block);
+
+	if (!isDedicated) {
+		std::cout << "MemoryAllocator >> new " << size / (1024 * 1024) << " MiB block in memory type " << memoryType
+			<< ", " << blocks.size() << " blocks total" << std::endl;
+	}
+
+	return block;
+}
+
+void MemoryAllocator::destroyBlock(Block* block)
+{
+	if (block->mapped) {
+		vkUnmapMemory(device, block->memory);
+	}
+	vkFreeMemory(device, block->memory, nullptr);
+
+	delete block;
+}
+
+bool MemoryAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, bool isLinear, VkDeviceSize& offset)
+{
+	for (auto it = block.ranges.begin(); it != block.ranges.end(); it++) {
+		if (!it->second.isFree || it->second.size < size) {
+			continue;
+		}
+
+		VkDeviceSize rangeStart = it->first;
+		VkDeviceSize rangeEnd = it->first + it->second.size;
+
+		VkDeviceSize start = alignUp(rangeStart, alignment);
+
+		/*
+			Small ranges put several on one page, so every used range on the allocation's first or last page
+			is checked, not only the neighbours. Ranges are sorted, the walks stop at the first range off the page.
+		*/
+		for (auto previous = it; previous != block.ranges.begin();) {
+			previous--;
+			if (!isOnSamePage(previous->first + previous->second.size - 1, start)) {
+				break;
+			}
+			if (!previous->second.isFree && previous->second.isLinear != isLinear) {
+				start = alignUp(start, bufferImageGranularity);
+				break;
+			}
+		}
+
+		VkDeviceSize end = start + size;
+		if (end > rangeEnd) {
+			continue;
+		}
+
+		bool isConflicting = false;
+		for (auto next = std::next(it); next != block.ranges.end() && isOnSamePage(end - 1, next->first); next++) {
+			if (!next->second.isFree && next->second.isLinear != isLinear) {
+				isConflicting = true;
+				break;
+			}
+		}
+		if (isConflicting) {
+			continue;
+		}
+
+		// Split into [padding][allocation][remainder], padding and remainder stay free
+		block.ranges.erase(it);
+		if (start > rangeStart) {
+			block.ranges[rangeStart] = { start - rangeStart, true, false };
+		}
+		block.ranges[start] = { size, false, isLinear };
+		if (rangeEnd > end) {
+			block.ranges[end] = { rangeEnd - end, true, false };
+		}
+
+		offset = start;
+		return true;
+	}
+
+	return false;
+}
+
+bool MemoryAllocator::isOnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond)
+{
+	return endOfFirst / bufferImageGranularity == startOfSecond / bufferImageGranularity;
+}
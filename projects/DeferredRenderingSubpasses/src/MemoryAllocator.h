@@ -0,0 +1,83 @@
+#pragma once
+
+// std
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include <vulkan/vulkan.h>
+
+/*
+	Sub-allocates buffers and images from a few large VkDeviceMemory blocks per memory type,
+	instead of one vkAllocateMemory per resource (which is slow and capped by maxMemoryAllocationCount).
+
+	Every block keeps an ordered list of ranges covering it. Allocation is first fit over the free ranges,
+	aligned to the resource and padded to bufferImageGranularity where a buffer and an optimal image would
+	share a page. Freed ranges merge with free neighbours. Host visible blocks stay mapped for their lifetime.
+*/
+class MemoryAllocator
+{
+public:
+
+	// Handle to a sub-allocation, returned by allocate*() and given back to free()
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// Host pointer to offset, only set for host visible memory
+		void* mapped = nullptr;
+	};
+
+	MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = 64 * 1024 * 1024);
+	~MemoryAllocator();
+
+	// Allocate and bind memory for the resource
+	Allocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+	Allocation allocateImage(VkImage image, VkMemoryPropertyFlags properties);
+
+	Allocation allocate(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool isLinear);
+	void free(Allocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	// For optional properties, where findMemoryType would throw
+	bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+	uint32_t getBlockCount() { return static_cast<uint32_t>(blocks.size()); }
+	uint32_t getAllocationCount() { return allocationCount; }
+
+private:
+
+	struct Range
+	{
+		VkDeviceSize size;
+		bool isFree;
+		// Buffers and linear images, as opposed to optimal tiling images
+		bool isLinear;
+	};
+
+	struct Block
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memoryType;
+		void* mapped;
+		// Resources bigger than half a block get a block of their own, released with the resource
+		bool isDedicated;
+		std::map<VkDeviceSize, Range> ranges;
+	};
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize blockSize;
+	VkDeviceSize bufferImageGranularity;
+
+	std::vector<Block*> blocks;
+	uint32_t allocationCount = 0;
+	std::mutex mutex;
+
+	Block* createBlock(uint32_t memoryType, VkDeviceSize size, bool isDedicated);
+	void destroyBlock(Block* block);
+	bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, bool isLinear, VkDeviceSize& offset);
+	bool isOnSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond);
+};
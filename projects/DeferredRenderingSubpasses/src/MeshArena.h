@@ -0,0 +1,80 @@
+#pragma once
+
+// std
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+
+/*
+	One vertex buffer and one index buffer shared by every mesh.
+
+	Meshes are appended at the end of the buffers and addressed by the vertexOffset and firstIndex
+	of their draws, so any number of meshes renders with the same bindings (which indirect draws need).
+	Full buffers are replaced by ones twice as big and the old contents copied over. Meshes are loaded
+	before rendering starts, so no command buffer is using the buffers when they are replaced.
+*/
+class MeshArena
+{
+public:
+
+	/*
+		DEVICE_LOCAL uploads geometry through a staging buffer into memory the GPU reads fastest.
+		HOST_VISIBLE writes geometry straight into mapped memory. It is meant for unified-memory
+		devices, where device-local memory is host-visible anyway and the extra copy is wasted.
+	*/
+	enum MEMORY_MODE {
+		DEVICE_LOCAL,
+		HOST_VISIBLE
+	};
+
+	MeshArena(
+		VkDevice device,
+		MemoryAllocator* allocator,
+		VkCommandPool commandPool,
+		VkQueue queue,
+		uint32_t vertexStride,
+		MEMORY_MODE memoryMode = DEVICE_LOCAL,
+		uint32_t vertexCapacity = 64 * 1024,
+		uint32_t indexCapacity = 256 * 1024
+	);
+	~MeshArena();
+
+	// Append vertices, returns the vertexOffset of the first one
+	uint32_t addVertices(const void* vertexData, uint32_t vertexCount);
+	// Append indices, returns the firstIndex of the first one
+	uint32_t addIndices(const uint32_t* indexData, uint32_t indexCount);
+
+	// Getters
+	VkBuffer getVertexBuffer() { return vertexBuffer.buffer; }
+	VkBuffer getIndexBuffer() { return indexBuffer.buffer; }
+	uint32_t getVertexCount() { return vertexBuffer.count; }
+	uint32_t getIndexCount() { return indexBuffer.count; }
+
+private:
+
+	struct ArenaBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		VkBufferUsageFlags usage;
+		uint32_t stride;
+		uint32_t capacity = 0;
+		uint32_t count = 0;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+	VkCommandPool commandPool;
+	VkQueue queue;
+	MEMORY_MODE memoryMode;
+
+	ArenaBuffer vertexBuffer;
+	ArenaBuffer indexBuffer;
+
+	uint32_t append(ArenaBuffer& arenaBuffer, const void* data, uint32_t count);
+	void grow(ArenaBuffer& arenaBuffer, uint32_t capacity);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocator::Allocation& bufferAllocation);
+	void copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+};
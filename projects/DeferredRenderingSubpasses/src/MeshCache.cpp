@@ -0,0 +1,256 @@
+#include "MeshCache.h"
+
+// std
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#define MESH_CACHE_VERSION 5
+
+static const char MESH_CACHE_MAGIC[4] = { 'V', 'L', 'M', 'C' };
+
+static uint64_t hashString(const std::string& string)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : string) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+MeshCache::MeshCache(std::string sourcePath, uint32_t vertexLayout, uint32_t vertexStride)
+{
+	this->sourcePath = sourcePath;
+	this->cachePath = sourcePath + ".meshcache";
+
+	header.vertexLayout = vertexLayout;
+	header.vertexStride = vertexStride;
+}
+
+MeshCache::~MeshCache()
+{
+	release();
+}
+
+bool MeshCache::load()
+{
+	Header expected = header;
+	if (!readSourceStamp(expected)) {
+		return false;
+	}
+
+	if (!mapFile()) {
+		return false;
+	}
+
+	if (mappedSize < sizeof(Header)) {
+		unmapFile();
+		return false;
+	}
+
+	Header stored;
+	memcpy(&stored, mappedData, sizeof(Header));
+
+	uint64_t vertexBytes = uint64_t(stored.vertexCount) * stored.vertexStride;
+	uint64_t indexBytes = uint64_t(stored.indexCount) * sizeof(uint32_t);
+
+	bool isValid = memcmp(stored.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+		&& stored.version == MESH_CACHE_VERSION
+		&& stored.sourcePathHash == expected.sourcePathHash
+		&& stored.sourceSize == expected.sourceSize
+		&& stored.sourceModifyTime == expected.sourceModifyTime
+		&& stored.vertexLayout == expected.vertexLayout
+		&& stored.vertexStride == expected.vertexStride
+		&& stored.vertexOffset + vertexBytes <= mappedSize
+		&& stored.indexOffset % alignof(uint32_t) == 0
+		&& stored.indexOffset + indexBytes <= mappedSize;
+
+	if (!isValid) {
+		unmapFile();
+		return false;
+	}
+
+	header = stored;
+	return true;
+}
+
+void MeshCache::save(const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount, uint32_t emittedVertexCount, const void* vertexDecode, const void* boundingSphere, const void* boundingBox)
+{
+	Header stored = header;
+	if (!readSourceStamp(stored)) {
+		return;
+	}
+
+	memcpy(stored.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	stored.version = MESH_CACHE_VERSION;
+	stored.vertexCount = vertexCount;
+	stored.indexCount = indexCount;
+	stored.emittedVertexCount = emittedVertexCount;
+	stored.reserved = 0;
+	memcpy(stored.vertexDecode, vertexDecode, sizeof(stored.vertexDecode));
+	memcpy(stored.boundingSphere, boundingSphere, sizeof(stored.boundingSphere));
+	memcpy(stored.boundingBox, boundingBox, sizeof(stored.boundingBox));
+	stored.vertexOffset = sizeof(Header);
+	stored.indexOffset = stored.vertexOffset + uint64_t(vertexCount) * stored.vertexStride;
+
+	/*
+		Write to a temporary file and rename it over the old cache, so a crash in the middle
+		of writing never leaves a truncated cache behind that matches the source stamp.
+	*/
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "WARNING: cannot write mesh cache \"" << cachePath << "\"." << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&stored), sizeof(Header));
+		file.write(reinterpret_cast<const char*>(vertexData), uint64_t(vertexCount) * stored.vertexStride);
+		file.write(reinterpret_cast<const char*>(indexData), uint64_t(indexCount) * sizeof(uint32_t));
+
+		if (!file.good()) {
+			std::cerr << "WARNING: cannot write mesh cache \"" << cachePath << "\"." << std::endl;
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		std::cerr << "WARNING: cannot write mesh cache \"" << cachePath << "\"." << std::endl;
+	}
+}
+
+void MeshCache::release()
+{
+	unmapFile();
+}
+
+bool MeshCache::readSourceStamp(Header& stamp)
+{
+	std::error_code error;
+
+	uint64_t size = std::filesystem::file_size(sourcePath, error);
+	if (error) {
+		return false;
+	}
+
+	auto modifyTime = std::filesystem::last_write_time(sourcePath, error);
+	if (error) {
+		return false;
+	}
+
+	stamp.sourcePathHash = hashString(std::filesystem::absolute(sourcePath).lexically_normal().string());
+	stamp.sourceSize = size;
+	stamp.sourceModifyTime = static_cast<int64_t>(modifyTime.time_since_epoch().count());
+
+	return true;
+}
+
+#ifdef _WIN32
+
+bool MeshCache::mapFile()
+{
+	HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	mappedData = static_cast<const uint8_t*>(view);
+	mappedSize = static_cast<size_t>(size.QuadPart);
+
+	return true;
+}
+
+void MeshCache::unmapFile()
+{
+	if (mappedData) {
+		UnmapViewOfFile(mappedData);
+		CloseHandle(static_cast<HANDLE>(mappingHandle));
+		CloseHandle(static_cast<HANDLE>(fileHandle));
+	}
+
+	mappedData = nullptr;
+	mappedSize = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+}
+
+#else
+
+bool MeshCache::mapFile()
+{
+	int file = open(cachePath.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		close(file);
+		return false;
+	}
+
+	fileDescriptor = file;
+	mappedData = static_cast<const uint8_t*>(view);
+	mappedSize = static_cast<size_t>(fileStat.st_size);
+
+	return true;
+}
+
+void MeshCache::unmapFile()
+{
+	if (mappedData) {
+		munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+		close(fileDescriptor);
+	}
+
+	mappedData = nullptr;
+	mappedSize = 0;
+	fileDescriptor = -1;
+}
+
+#endif
@@ -0,0 +1,298 @@
+#include "MeshOptimizer.h"
+
+// std
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+// Post-transform cache modelled for the ACMR/ATVR numbers and the overdraw clusters
+#define FIFO_CACHE_SIZE 16
+// LRU cache size Forsyth's scoring is tuned for
+#define SCORE_CACHE_SIZE 32
+
+MeshOptimizer::MeshOptimizer(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	: vertices(vertices), indices(indices)
+{
+	statsBefore = analyzeVertexCache(FIFO_CACHE_SIZE);
+
+	optimizeVertexCache();
+	optimizeOverdraw(1.05f);
+	optimizeVertexFetch();
+
+	statsAfter = analyzeVertexCache(FIFO_CACHE_SIZE);
+}
+
+MeshOptimizer::Stats MeshOptimizer::analyzeVertexCache(uint32_t cacheSize)
+{
+	std::vector<uint32_t> cacheTimestamps(vertices.size(), 0);
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t misses = 0;
+
+	// A vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+	for (uint32_t index : indices) {
+		if (timestamp - cacheTimestamps[index] > cacheSize) {
+			cacheTimestamps[index] = timestamp++;
+			misses++;
+		}
+	}
+
+	Stats stats = {};
+	stats.acmr = indices.empty() ? 0.0f : float(misses) / float(indices.size() / 3);
+	stats.atvr = vertices.empty() ? 0.0f : float(misses) / float(vertices.size());
+
+	return stats;
+}
+
+static float scoreVertex(int32_t cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0) {
+		// The vertices of the last triangle get a fixed score, so it is not simply continued as a strip
+		if (cachePosition < 3) {
+			score = 0.75f;
+		}
+		else {
+			float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+		}
+	}
+
+	// Prefer vertices with few triangles left, so lone triangles do not get stranded
+	score += 2.0f / std::sqrt(float(remainingTriangles));
+
+	return score;
+}
+
+void MeshOptimizer::optimizeVertexCache()
+{
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles adjacent to every vertex, packed into one array
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : indices) {
+		adjacencyOffsets[index + 1]++;
+	}
+	std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+		for (uint32_t corner = 0; corner < 3; corner++) {
+			uint32_t vertex = indices[3 * triangle + corner];
+			adjacency[adjacencyOffsets[vertex] + remainingTriangles[vertex]++] = triangle;
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; vertex++) {
+		vertexScores[vertex] = scoreVertex(-1, remainingTriangles[vertex]);
+	}
+
+	std::vector<bool> isEmitted(triangleCount, false);
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(SCORE_CACHE_SIZE + 3);
+	newCache.reserve(SCORE_CACHE_SIZE + 3);
+
+	std::vector<uint32_t> optimizedIndices;
+	optimizedIndices.reserve(indices.size());
+
+	int64_t bestTriangle = -1;
+	size_t nextUnemitted = 0;
+
+	for (size_t emitted = 0; emitted < triangleCount; emitted++) {
+		/*
+			Nothing in the cache is adjacent to a remaining triangle, so restart from
+			the next triangle in input order instead of scanning the whole mesh.
+		*/
+		if (bestTriangle < 0) {
+			while (isEmitted[nextUnemitted]) {
+				nextUnemitted++;
+			}
+			bestTriangle = static_cast<int64_t>(nextUnemitted);
+		}
+
+		uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+		const uint32_t* triangleIndices = &indices[3 * triangle];
+		isEmitted[triangle] = true;
+
+		optimizedIndices.insert(optimizedIndices.end(), triangleIndices, triangleIndices + 3);
+
+		// Drop the triangle from the adjacency of its vertices
+		for (uint32_t corner = 0; corner < 3; corner++) {
+			uint32_t vertex = triangleIndices[corner];
+			uint32_t* begin = &adjacency[adjacencyOffsets[vertex]];
+			uint32_t* end = begin + remainingTriangles[vertex];
+			*std::find(begin, end, triangle) = *(end - 1);
+			remainingTriangles[vertex]--;
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache
+		newCache.assign(triangleIndices, triangleIndices + 3);
+		for (uint32_t vertex : cache) {
+			if (vertex != triangleIndices[0] && vertex != triangleIndices[1] && vertex != triangleIndices[2]) {
+				newCache.push_back(vertex);
+			}
+		}
+		std::swap(cache, newCache);
+
+		// Rescore everything in the cache, evicted vertices fall back to their valence score
+		for (size_t position = 0; position < cache.size(); position++) {
+			uint32_t vertex = cache[position];
+			int32_t cachePosition = position < SCORE_CACHE_SIZE ? static_cast<int32_t>(position) : -1;
+			vertexScores[vertex] = scoreVertex(cachePosition, remainingTriangles[vertex]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (uint32_t vertex : cache) {
+			for (uint32_t i = 0; i < remainingTriangles[vertex]; i++) {
+				uint32_t adjacent = adjacency[adjacencyOffsets[vertex] + i];
+				float score = vertexScores[indices[3 * adjacent + 0]]
+					+ vertexScores[indices[3 * adjacent + 1]]
+					+ vertexScores[indices[3 * adjacent + 2]];
+
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = adjacent;
+				}
+			}
+		}
+
+		if (cache.size() > SCORE_CACHE_SIZE) {
+			cache.resize(SCORE_CACHE_SIZE);
+		}
+	}
+
+	indices = std::move(optimizedIndices);
+}
+
+void MeshOptimizer::optimizeOverdraw(float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	if (triangleCount == 0) {
+		return;
+	}
+
+	/*
+		Cut the triangle order wherever the FIFO cache has gone cold (all three vertices miss).
+		Clusters can then be drawn in any order without losing much vertex reuse.
+	*/
+	std::vector<uint32_t> clusterStarts;
+	{
+		std::vector<uint32_t> cacheTimestamps(vertices.size(), 0);
+		uint32_t timestamp = FIFO_CACHE_SIZE + 1;
+
+		for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+			uint32_t misses = 0;
+			for (uint32_t corner = 0; corner < 3; corner++) {
+				uint32_t index = indices[3 * triangle + corner];
+				if (timestamp - cacheTimestamps[index] > FIFO_CACHE_SIZE) {
+					cacheTimestamps[index] = timestamp++;
+					misses++;
+				}
+			}
+
+			if (triangle == 0 || misses == 3) {
+				clusterStarts.push_back(triangle);
+			}
+		}
+	}
+
+	size_t clusterCount = clusterStarts.size();
+	clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+	// Area weighted centroid and normal of every cluster
+	std::vector<glm::vec3> clusterCentroids(clusterCount);
+	std::vector<glm::vec3> clusterNormals(clusterCount);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+
+		for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; triangle++) {
+			const glm::vec3& p0 = vertices[indices[3 * triangle + 0]].position;
+			const glm::vec3& p1 = vertices[indices[3 * triangle + 1]].position;
+			const glm::vec3& p2 = vertices[indices[3 * triangle + 2]].position;
+
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangleArea = glm::length(cross);
+
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+
+		clusterCentroids[cluster] = area > 0.0f ? centroid / area : centroid;
+		clusterNormals[cluster] = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters facing away from the center of the mesh are most likely to be in front, so they go first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t cluster = 0; cluster < clusterCount; cluster++) {
+		sortKeys[cluster] = glm::dot(clusterCentroids[cluster] - meshCentroid, clusterNormals[cluster]);
+	}
+
+	std::vector<uint32_t> clusterOrder(clusterCount);
+	std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys](uint32_t a, uint32_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> sortedIndices;
+	sortedIndices.reserve(indices.size());
+	for (uint32_t cluster : clusterOrder) {
+		sortedIndices.insert(
+			sortedIndices.end(),
+			indices.begin() + 3 * clusterStarts[cluster],
+			indices.begin() + 3 * clusterStarts[cluster + 1]
+		);
+	}
+
+	// Keep the cache optimized order if the sort would cost too much vertex reuse
+	float acmr = analyzeVertexCache(FIFO_CACHE_SIZE).acmr;
+	std::swap(indices, sortedIndices);
+	if (analyzeVertexCache(FIFO_CACHE_SIZE).acmr > acmr * threshold) {
+		std::swap(indices, sortedIndices);
+	}
+}
+
+void MeshOptimizer::optimizeVertexFetch()
+{
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> orderedVertices;
+	orderedVertices.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(orderedVertices.size());
+			orderedVertices.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices = std::move(orderedVertices);
+}
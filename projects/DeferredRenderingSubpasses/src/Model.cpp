@@ -5,156 +5,285 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <chrono>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/gtc/packing.hpp>
+
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "MeshOptimizer.h"
+
+static_assert(sizeof(VertexDecode) == sizeof(MeshCache::Header::vertexDecode), "VertexDecode must fit the mesh cache header");
+static_assert(sizeof(glm::vec4) == sizeof(MeshCache::Header::boundingSphere), "Bounding sphere must fit the mesh cache header");
+static_assert(sizeof(BoundingBox) == sizeof(MeshCache::Header::boundingBox), "Bounding box must fit the mesh cache header");
+
+Model::Model(
+	std::string modelPath,
+	std::string texturePath,
+	MeshArena* arena,
+	VERTEX_FORMAT vertexFormat)
+{
+	this->arena = arena;
+	this->vertexFormat = vertexFormat;
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tinyobjloader/tiny_obj_loader.h>
+	auto startTime = std::chrono::high_resolution_clock::now();
 
-#include "utils.hpp"
+	MeshCache meshCache(modelPath, getLayoutHash(vertexFormat), getBindingDescription(vertexFormat).stride);
+	bool isCached = meshCache.load();
 
-Model::Model(std::string modelPath, std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice)
-{
-	this->device = device;
-	this->physicalDevice = physicalDevice;
+	if (isCached) {
+		vertexCount = meshCache.getVertexCount();
+		indexCount = meshCache.getIndexCount();
+		emittedVertexCount = meshCache.getEmittedVertexCount();
+		memcpy(&vertexDecode, meshCache.getVertexDecode(), sizeof(VertexDecode));
+		memcpy(&boundingSphere, meshCache.getBoundingSphere(), sizeof(glm::vec4));
+		memcpy(&boundingBox, meshCache.getBoundingBox(), sizeof(BoundingBox));
+
+		vertexOffset = arena->addVertices(meshCache.getVertexData(), vertexCount);
+		firstIndex = arena->addIndices(meshCache.getIndexData(), indexCount);
+		meshCache.release();
+	}
+	else {
+		loadModel(modelPath);
+		computeBounds();
+
+		MeshOptimizer optimizer(vertices, indices);
+		vertexCount = static_cast<uint32_t>(vertices.size());
+
+		std::cout << "Model >> \"" << modelPath << "\" optimized, ACMR " << optimizer.getStatsBefore().acmr << " -> " << optimizer.getStatsAfter().acmr
+			<< ", ATVR " << optimizer.getStatsBefore().atvr << " -> " << optimizer.getStatsAfter().atvr << std::endl;
+
+		const void* vertexData = vertices.data();
+		if (vertexFormat != VERTEX_FORMAT_FLOAT) {
+			packVertices();
+			vertexData = packedVertices.data();
+		}
 
-	loadModel(modelPath);
-	createVertexBuffer();
-	createIndexBuffer();
+		meshCache.save(vertexData, vertexCount, indices.data(), indexCount, emittedVertexCount, &vertexDecode, &boundingSphere, &boundingBox);
+
+		vertexOffset = arena->addVertices(vertexData, vertexCount);
+		firstIndex = arena->addIndices(indices.data(), indexCount);
+	}
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	float loadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count();
+
+	std::cout << "Model >> \"" << modelPath << "\" " << (isCached ? "loaded from cache" : "parsed") << " in " << loadTime << " ms, "
+		<< vertexCount << " unique / " << emittedVertexCount << " emitted vertices, "
+		<< getBindingDescription(vertexFormat).stride << " bytes per vertex" << std::endl;
 }
 
 Model::~Model()
 {
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+}
+
+VkVertexInputBindingDescription Model::getBindingDescription(VERTEX_FORMAT vertexFormat)
+{
+	if (vertexFormat == VERTEX_FORMAT_FLOAT) {
+		return Vertex::getBindingDescription();
+	}
+
+	return PackedVertex::getBindingDescription();
+}
+
+std::vector<VkVertexInputAttributeDescription> Model::getAttributeDescriptions(VERTEX_FORMAT vertexFormat)
+{
+	if (vertexFormat == VERTEX_FORMAT_FLOAT) {
+		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+		return std::vector<VkVertexInputAttributeDescription>(attributeDescriptions.begin(), attributeDescriptions.end());
+	}
 
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
+	auto attributeDescriptions = PackedVertex::getAttributeDescriptions(vertexFormat);
+	return std::vector<VkVertexInputAttributeDescription>(attributeDescriptions.begin(), attributeDescriptions.end());
+}
+
+uint32_t Model::getLayoutHash(VERTEX_FORMAT vertexFormat)
+{
+	uint32_t hash = 2166136261u;
+	auto combine = [&hash](uint32_t value) {
+		hash ^= value;
+		hash *= 16777619u;
+	};
+
+	combine(getBindingDescription(vertexFormat).stride);
+	for (const auto& attribute : getAttributeDescriptions(vertexFormat)) {
+		combine(attribute.location);
+		combine(static_cast<uint32_t>(attribute.format));
+		combine(attribute.offset);
+	}
+
+	return hash;
 }
 
 VkBuffer Model::getVertexBuffer()
 {
-	return vertexBuffer;
+	return arena->getVertexBuffer();
 }
 
 uint32_t Model::getVertexCount()
 {
-	return static_cast<uint32_t>(vertices.size());
+	return vertexCount;
+}
+
+int32_t Model::getVertexOffset()
+{
+	return static_cast<int32_t>(vertexOffset);
 }
 
 VkBuffer Model::getIndexBuffer()
 {
-	return indexBuffer;
+	return arena->getIndexBuffer();
 }
 
 uint32_t Model::getIndexCount()
 {
-	return static_cast<uint32_t>(indices.size());
+	return indexCount;
 }
 
-
-void Model::loadModel(const std::string& modelPath)
+uint32_t Model::getFirstIndex()
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
+	return firstIndex;
+}
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelPath.c_str())) {
-		throw std::runtime_error("ERROR: cannot read model \"" + modelPath + "\".");
-	}
+uint32_t Model::getEmittedVertexCount()
+{
+	return emittedVertexCount;
+}
 
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex = {};
+const VertexDecode& Model::getVertexDecode()
+{
+	return vertexDecode;
+}
 
-			vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
-			vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
-			vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
+const glm::vec4& Model::getBoundingSphere()
+{
+	return boundingSphere;
+}
 
-			vertex.texCoord.x = attrib.texcoords[2 * index.texcoord_index + 0];
-			vertex.texCoord.y = 1 - attrib.texcoords[2 * index.texcoord_index + 1];
+const BoundingBox& Model::getBoundingBox()
+{
+	return boundingBox;
+}
 
-			vertex.norm.x = attrib.normals[3 * index.normal_index + 0];
-			vertex.norm.y = attrib.normals[3 * index.normal_index + 1];
-			vertex.norm.z = attrib.normals[3 * index.normal_index + 2];
 
-			vertices.push_back(vertex);
-			indices.push_back(indices.size());
-		}
-	}
+void Model::loadModel(const std::string& modelPath)
+{
+	/*
+		OBJ faces reference position, texCoord and normal separately, so the same corner
+		shows up once per face that uses it. ObjParser welds vertices by value to build
+		a real index buffer and let the post-transform cache reuse shaded vertices.
+	*/
+	ObjParser parser(modelPath);
+
+	vertices = std::move(parser.getVertices());
+	indices = std::move(parser.getIndices());
+
+	vertexCount = static_cast<uint32_t>(vertices.size());
+	indexCount = static_cast<uint32_t>(indices.size());
+	emittedVertexCount = indexCount;
 }
 
-void Model::createVertexBuffer()
+void Model::computeBounds()
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(vertices[0]) * vertices.size();
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	result = vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Vertex Buffer.");
+	if (vertices.empty()) {
+		boundingBox.min = boundingBox.max = glm::vec3(0.0f);
+		return;
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &vertexBufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Vertex Buffer Memory.");
+	for (const auto& vertex : vertices) {
+		boundingBox.grow(vertex.position);
 	}
 
-	vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+	// Centered on the box, not the smallest sphere, but it only takes two passes over the vertices
+	glm::vec3 center = boundingBox.getCenter();
+	float radiusSquared = 0.0f;
+	for (const auto& vertex : vertices) {
+		glm::vec3 offset = vertex.position - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
 
-	void* data;
-	vkMapMemory(device, vertexBufferMemory, 0, bufferInfo.size, 0, &data);
-		memcpy(data, vertices.data(), (size_t)bufferInfo.size);
-	vkUnmapMemory(device, vertexBufferMemory);
+	boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
 }
 
-void Model::createIndexBuffer()
+static glm::vec2 encodeOctahedral(glm::vec3 norm)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(indices[0]) * indices.size();
-	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	float sum = std::abs(norm.x) + std::abs(norm.y) + std::abs(norm.z);
+	if (sum == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+
+	norm /= sum;
+	glm::vec2 encoded(norm.x, norm.y);
 
-	result = vkCreateBuffer(device, &bufferInfo, nullptr, &indexBuffer);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Index Buffer.");
+	// Fold the lower hemisphere over the diagonals of the square
+	if (norm.z < 0.0f) {
+		encoded.x = (1.0f - std::abs(norm.y)) * (norm.x >= 0.0f ? 1.0f : -1.0f);
+		encoded.y = (1.0f - std::abs(norm.x)) * (norm.y >= 0.0f ? 1.0f : -1.0f);
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, indexBuffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &indexBufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Index Buffer Memory.");
+	return encoded;
+}
+
+void Model::packVertices()
+{
+	glm::vec3 minPosition(FLT_MAX), maxPosition(-FLT_MAX);
+	glm::vec2 minTexCoord(FLT_MAX), maxTexCoord(-FLT_MAX);
+
+	for (const auto& vertex : vertices) {
+		minPosition = glm::min(minPosition, vertex.position);
+		maxPosition = glm::max(maxPosition, vertex.position);
+		minTexCoord = glm::min(minTexCoord, vertex.texCoord);
+		maxTexCoord = glm::max(maxTexCoord, vertex.texCoord);
 	}
 
-	vkBindBufferMemory(device, indexBuffer, indexBufferMemory, 0);
+	/*
+		Fixed point spreads the 16 bits over the bounds of the mesh, which is more precise than
+		half floats for anything not centered around the origin. Flat axes get a scale of 1 so
+		the encoding never divides by zero.
+	*/
+	if (vertexFormat == VERTEX_FORMAT_PACKED_FIXED && !vertices.empty()) {
+		glm::vec3 positionScale = maxPosition - minPosition;
+		glm::vec2 texCoordScale = maxTexCoord - minTexCoord;
+		positionScale = glm::mix(positionScale, glm::vec3(1.0f), glm::equal(positionScale, glm::vec3(0.0f)));
+		texCoordScale = glm::mix(texCoordScale, glm::vec2(1.0f), glm::equal(texCoordScale, glm::vec2(0.0f)));
+
+		vertexDecode.positionScale = glm::vec4(positionScale, 0.0f);
+		vertexDecode.positionOffset = glm::vec4(minPosition, 0.0f);
+		vertexDecode.texCoordScaleOffset = glm::vec4(texCoordScale, minTexCoord);
+	}
 
-	void* data;
-	vkMapMemory(device, indexBufferMemory, 0, bufferInfo.size, 0, &data);
-		memcpy(data, indices.data(), (size_t)bufferInfo.size);
-	vkUnmapMemory(device, indexBufferMemory);
+	packedVertices.resize(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const Vertex& vertex = vertices[i];
+		PackedVertex& packed = packedVertices[i];
+
+		if (vertexFormat == VERTEX_FORMAT_PACKED_FIXED) {
+			glm::vec3 position = (vertex.position - glm::vec3(vertexDecode.positionOffset)) / glm::vec3(vertexDecode.positionScale);
+			glm::vec2 texCoord = (vertex.texCoord - glm::vec2(vertexDecode.texCoordScaleOffset.z, vertexDecode.texCoordScaleOffset.w))
+				/ glm::vec2(vertexDecode.texCoordScaleOffset.x, vertexDecode.texCoordScaleOffset.y);
+
+			packed.position[0] = glm::packUnorm1x16(position.x);
+			packed.position[1] = glm::packUnorm1x16(position.y);
+			packed.position[2] = glm::packUnorm1x16(position.z);
+			packed.texCoord[0] = glm::packUnorm1x16(texCoord.x);
+			packed.texCoord[1] = glm::packUnorm1x16(texCoord.y);
+		}
+		else {
+			packed.position[0] = glm::packHalf1x16(vertex.position.x);
+			packed.position[1] = glm::packHalf1x16(vertex.position.y);
+			packed.position[2] = glm::packHalf1x16(vertex.position.z);
+			packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+			packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+		}
+		packed.position[3] = 0;
+
+		glm::vec2 norm = encodeOctahedral(vertex.norm);
+		packed.norm[0] = static_cast<int16_t>(glm::packSnorm1x16(norm.x));
+		packed.norm[1] = static_cast<int16_t>(glm::packSnorm1x16(norm.y));
+	}
 }
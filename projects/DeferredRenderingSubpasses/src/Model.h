@@ -5,9 +5,28 @@
 #include <vector>
 #include <array>
 
+#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
 #include <vulkan/vulkan.h>
 
+#include "MeshArena.h"
+#include "BoundingBox.h"
+
+/*
+	Layout of the vertex buffer a Model uploads.
+
+	VERTEX_FORMAT_FLOAT is the 44 byte fp32 Vertex the mesh is parsed into.
+	The packed formats drop color, store UVs and positions in 16 bit (half floats, or unorm fixed point
+	against the mesh bounds) and octahedral encode the normal into two snorm16, for 16 bytes per vertex.
+	Fixed point needs the mesh's VertexDecode (see Scene::getMeshBuffer()) to map the values back into model space.
+*/
+enum VERTEX_FORMAT {
+	VERTEX_FORMAT_FLOAT,
+	VERTEX_FORMAT_PACKED_HALF,
+	VERTEX_FORMAT_PACKED_FIXED
+};
+
 struct Vertex
 {
 	glm::vec3 position;
@@ -51,6 +70,118 @@ struct Vertex
 
 		return attributeDescriptors;
 	}
+
+	bool operator==(const Vertex& other) const
+	{
+		return position == other.position
+			&& color == other.color
+			&& texCoord == other.texCoord
+			&& norm == other.norm;
+	}
+};
+
+namespace std
+{
+	template<> struct hash<Vertex>
+	{
+		size_t operator()(const Vertex& vertex) const
+		{
+			size_t seed = hash<glm::vec3>()(vertex.position);
+			seed ^= hash<glm::vec2>()(vertex.texCoord) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			seed ^= hash<glm::vec3>()(vertex.norm) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+	};
+}
+
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint16_t texCoord[2];
+	int16_t norm[2];
+
+	static VkVertexInputBindingDescription	getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 0;
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		bindingDescription.stride = sizeof(PackedVertex);
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions(VERTEX_FORMAT format)
+	{
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptors = {};
+
+		attributeDescriptors[0].binding = 0;
+		attributeDescriptors[0].location = 0;
+		attributeDescriptors[0].format = format == VERTEX_FORMAT_PACKED_FIXED ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R16G16B16A16_SFLOAT;
+		attributeDescriptors[0].offset = offsetof(PackedVertex, position);
+
+		attributeDescriptors[1].binding = 0;
+		attributeDescriptors[1].location = 2;
+		attributeDescriptors[1].format = format == VERTEX_FORMAT_PACKED_FIXED ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16_SFLOAT;
+		attributeDescriptors[1].offset = offsetof(PackedVertex, texCoord);
+
+		attributeDescriptors[2].binding = 0;
+		attributeDescriptors[2].location = 3;
+		attributeDescriptors[2].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptors[2].offset = offsetof(PackedVertex, norm);
+
+		return attributeDescriptors;
+	}
+};
+
+// Per mesh in a vertex shader storage buffer, position = offset + scale * stored position (same for texCoord)
+struct VertexDecode
+{
+	alignas(16) glm::vec4 positionScale;
+	alignas(16) glm::vec4 positionOffset;
+	alignas(16) glm::vec4 texCoordScaleOffset;
+};
+
+/*
+	Per-instance vertex data, read at instance rate from binding 1 next to the mesh's vertices.
+	Padded to the std430 size of the same struct, so compute shaders can read and write it too.
+*/
+struct InstanceData
+{
+	glm::mat4 transform;
+	uint32_t meshIndex;
+	// Scene's index of the instance, tells culled copies apart
+	uint32_t instanceIndex;
+	uint32_t padding[2];
+
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 1;
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+		bindingDescription.stride = sizeof(InstanceData);
+
+		return bindingDescription;
+	}
+
+	// A mat4 takes one location per column, after the vertex attributes (locations 4 to 7), then the mesh index (location 8)
+	static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
+	{
+		std::array<VkVertexInputAttributeDescription, 5> attributeDescriptors = {};
+
+		for (uint32_t i = 0; i < 4; i++) {
+			attributeDescriptors[i].binding = 1;
+			attributeDescriptors[i].location = 4 + i;
+			attributeDescriptors[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptors[i].offset = offsetof(InstanceData, transform) + i * sizeof(glm::vec4);
+		}
+
+		attributeDescriptors[4].binding = 1;
+		attributeDescriptors[4].location = 8;
+		attributeDescriptors[4].format = VK_FORMAT_R32_UINT;
+		attributeDescriptors[4].offset = offsetof(InstanceData, meshIndex);
+
+		return attributeDescriptors;
+	}
 };
 
 class Model
@@ -58,30 +189,52 @@ class Model
 public:
 
 	Model() {};
-	Model(std::string modelPath, std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice);
+	// Geometry is appended to the arena, which owns it
+	Model(
+		std::string modelPath,
+		std::string texturePath,
+		MeshArena* arena,
+		VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT
+	);
 	~Model();
 
+	static VkVertexInputBindingDescription getBindingDescription(VERTEX_FORMAT vertexFormat);
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VERTEX_FORMAT vertexFormat);
+	// Identifies the memory layout of the vertex, so binary mesh caches written with a different layout are rejected
+	static uint32_t getLayoutHash(VERTEX_FORMAT vertexFormat);
+
 	VkBuffer getVertexBuffer();
 	uint32_t getVertexCount();
+	// Location of the mesh in the arena buffers, vertexOffset and firstIndex of its draws
+	int32_t getVertexOffset();
 	VkBuffer getIndexBuffer();
 	uint32_t getIndexCount();
+	uint32_t getFirstIndex();
+	uint32_t getEmittedVertexCount();
+	const VertexDecode& getVertexDecode();
+	// Center (xyz) and radius (w) in model space
+	const glm::vec4& getBoundingSphere();
+	const BoundingBox& getBoundingBox();
 
 private:
 
-	VkDevice device;
-	VkPhysicalDevice physicalDevice;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-	
-	VkResult result;
+	MeshArena* arena;
+	VERTEX_FORMAT vertexFormat;
+	VertexDecode vertexDecode = { glm::vec4(1.0f), glm::vec4(0.0f), glm::vec4(1.0f, 1.0f, 0.0f, 0.0f) };
+	glm::vec4 boundingSphere = glm::vec4(0.0f);
+	BoundingBox boundingBox;
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	std::vector<PackedVertex> packedVertices;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t vertexOffset = 0;
+	uint32_t firstIndex = 0;
+	// Number of vertices the OBJ faces reference before welding
+	uint32_t emittedVertexCount = 0;
 
 	void loadModel(const std::string& modelPath);
-	void createVertexBuffer();
-	void createIndexBuffer();
+	void computeBounds();
+	void packVertices();
 };
-
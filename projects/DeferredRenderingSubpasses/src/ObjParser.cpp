@@ -0,0 +1,434 @@
+#include "ObjParser.h"
+
+// std
+#include <stdexcept>
+#include <fstream>
+#include <thread>
+#include <charconv>
+#include <unordered_set>
+#include <algorithm>
+
+#define POSITION_RELATIVE_BIT 1u
+#define TEXCOORD_RELATIVE_BIT 2u
+#define NORMAL_RELATIVE_BIT 4u
+
+static bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skipSpaces(const char*& p, const char* end)
+{
+	while (p < end && isSpace(*p)) {
+		p++;
+	}
+}
+
+static bool parseFloat(const char*& p, const char* end, float& value)
+{
+	skipSpaces(p, end);
+	if (p < end && *p == '+') {
+		p++;
+	}
+
+	double parsed;
+	auto result = std::from_chars(p, end, parsed);
+	if (result.ec != std::errc()) {
+		return false;
+	}
+
+	value = static_cast<float>(parsed);
+	p = result.ptr;
+	return true;
+}
+
+static bool parseInt(const char*& p, const char* end, int32_t& value)
+{
+	if (p < end && *p == '+') {
+		p++;
+	}
+
+	auto result = std::from_chars(p, end, value);
+	if (result.ec != std::errc()) {
+		return false;
+	}
+
+	p = result.ptr;
+	return true;
+}
+
+ObjParser::ObjParser(std::string modelPath, uint32_t threadCount)
+{
+	this->modelPath = modelPath;
+	this->threadCount = threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+
+	readFile();
+	splitChunks();
+	parallelFor(chunks.size(), [this](size_t i) { parseChunk(chunks[i]); });
+
+	for (const auto& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			throw std::runtime_error("ERROR: cannot read model \"" + modelPath + "\". " + chunk.error);
+		}
+	}
+
+	mergeChunks();
+	weldVertices();
+}
+
+void ObjParser::readFile()
+{
+	std::ifstream file(modelPath, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("ERROR: cannot read model \"" + modelPath + "\".");
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	fileData.resize(fileSize);
+
+	file.seekg(0);
+	file.read(fileData.data(), fileSize);
+
+	file.close();
+}
+
+void ObjParser::splitChunks()
+{
+	/*
+		Chunks are a few times smaller than fileSize / threadCount, so a thread that
+		got a chunk full of cheap records does not sit idle while others finish.
+	*/
+	const size_t minChunkSize = 256 * 1024;
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount * 4, fileData.size() / minChunkSize));
+	size_t chunkSize = fileData.size() / chunkCount + 1;
+
+	const char* fileBegin = fileData.data();
+	const char* fileEnd = fileData.data() + fileData.size();
+
+	const char* begin = fileBegin;
+	while (begin < fileEnd) {
+		const char* end = std::min(begin + chunkSize, fileEnd);
+		end = std::find(end, fileEnd, '\n');
+		if (end < fileEnd) {
+			end++;
+		}
+
+		Chunk chunk = {};
+		chunk.begin = begin;
+		chunk.end = end;
+		chunks.push_back(chunk);
+
+		begin = end;
+	}
+}
+
+void ObjParser::parseChunk(Chunk& chunk)
+{
+	std::vector<Corner> faceCorners;
+
+	const char* lineBegin = chunk.begin;
+	while (lineBegin < chunk.end) {
+		const char* lineEnd = std::find(lineBegin, chunk.end, '\n');
+		const char* p = lineBegin;
+		lineBegin = lineEnd + 1;
+
+		skipSpaces(p, lineEnd);
+		if (lineEnd - p < 2) {
+			continue;
+		}
+
+		if (p[0] == 'v' && isSpace(p[1])) {
+			p += 1;
+			float x, y, z;
+			if (!parseFloat(p, lineEnd, x) || !parseFloat(p, lineEnd, y) || !parseFloat(p, lineEnd, z)) {
+				chunk.error = "Malformed \"v\" record.";
+				return;
+			}
+			chunk.positions.insert(chunk.positions.end(), { x, y, z });
+		}
+		else if (p[0] == 'v' && p[1] == 't') {
+			p += 2;
+			float u, v;
+			if (!parseFloat(p, lineEnd, u) || !parseFloat(p, lineEnd, v)) {
+				chunk.error = "Malformed \"vt\" record.";
+				return;
+			}
+			chunk.texCoords.insert(chunk.texCoords.end(), { u, v });
+		}
+		else if (p[0] == 'v' && p[1] == 'n') {
+			p += 2;
+			float x, y, z;
+			if (!parseFloat(p, lineEnd, x) || !parseFloat(p, lineEnd, y) || !parseFloat(p, lineEnd, z)) {
+				chunk.error = "Malformed \"vn\" record.";
+				return;
+			}
+			chunk.normals.insert(chunk.normals.end(), { x, y, z });
+		}
+		else if (p[0] == 'f' && isSpace(p[1])) {
+			p += 1;
+			faceCorners.clear();
+
+			int32_t positionCount = static_cast<int32_t>(chunk.positions.size() / 3);
+			int32_t texCoordCount = static_cast<int32_t>(chunk.texCoords.size() / 2);
+			int32_t normalCount = static_cast<int32_t>(chunk.normals.size() / 3);
+
+			// Positive indices are 1-based and global, negative ones count back from the last record read so far
+			auto resolve = [](int32_t index, int32_t localCount, int32_t& resolved, uint32_t relativeBit, uint32_t& relativeMask) {
+				if (index > 0) {
+					resolved = index - 1;
+				}
+				else {
+					resolved = localCount + index;
+					relativeMask |= relativeBit;
+				}
+			};
+
+			skipSpaces(p, lineEnd);
+			while (p < lineEnd) {
+				Corner corner = { -1, -1, -1, 0 };
+				int32_t index;
+
+				if (!parseInt(p, lineEnd, index) || index == 0) {
+					chunk.error = "Malformed \"f\" record.";
+					return;
+				}
+				resolve(index, positionCount, corner.position, POSITION_RELATIVE_BIT, corner.relativeMask);
+
+				if (p < lineEnd && *p == '/') {
+					p++;
+					if (p < lineEnd && *p != '/') {
+						if (!parseInt(p, lineEnd, index) || index == 0) {
+							chunk.error = "Malformed \"f\" record.";
+							return;
+						}
+						resolve(index, texCoordCount, corner.texCoord, TEXCOORD_RELATIVE_BIT, corner.relativeMask);
+					}
+					if (p < lineEnd && *p == '/') {
+						p++;
+						if (!parseInt(p, lineEnd, index) || index == 0) {
+							chunk.error = "Malformed \"f\" record.";
+							return;
+						}
+						resolve(index, normalCount, corner.normal, NORMAL_RELATIVE_BIT, corner.relativeMask);
+					}
+				}
+
+				faceCorners.push_back(corner);
+				skipSpaces(p, lineEnd);
+			}
+
+			// Quads are split along the shorter diagonal once positions are known, see splitQuads()
+			if (faceCorners.size() == 4) {
+				chunk.quads.push_back(chunk.corners.size());
+			}
+
+			// Larger polygons are assumed convex and triangulated as a fan
+			for (size_t i = 2; i < faceCorners.size(); i++) {
+				chunk.corners.push_back(faceCorners[0]);
+				chunk.corners.push_back(faceCorners[i - 1]);
+				chunk.corners.push_back(faceCorners[i]);
+			}
+		}
+	}
+}
+
+void ObjParser::mergeChunks()
+{
+	size_t positionCount = 0;
+	size_t texCoordCount = 0;
+	size_t normalCount = 0;
+	size_t cornerCount = 0;
+
+	for (auto& chunk : chunks) {
+		chunk.positionOffset = positionCount;
+		chunk.texCoordOffset = texCoordCount;
+		chunk.normalOffset = normalCount;
+		chunk.cornerOffset = cornerCount;
+
+		positionCount += chunk.positions.size();
+		texCoordCount += chunk.texCoords.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+	}
+
+	positions.resize(positionCount);
+	texCoords.resize(texCoordCount);
+	normals.resize(normalCount);
+	cornerVertices.resize(cornerCount);
+
+	parallelFor(chunks.size(), [this](size_t i) {
+		Chunk& chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionOffset);
+		std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + chunk.texCoordOffset);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalOffset);
+	});
+
+	parallelFor(chunks.size(), [this](size_t i) {
+		Chunk& chunk = chunks[i];
+
+		int64_t chunkPositionBase = static_cast<int64_t>(chunk.positionOffset / 3);
+		int64_t chunkTexCoordBase = static_cast<int64_t>(chunk.texCoordOffset / 2);
+		int64_t chunkNormalBase = static_cast<int64_t>(chunk.normalOffset / 3);
+
+		for (size_t c = 0; c < chunk.corners.size(); c++) {
+			const Corner& corner = chunk.corners[c];
+			Vertex vertex = {};
+
+			int64_t position = corner.position + ((corner.relativeMask & POSITION_RELATIVE_BIT) ? chunkPositionBase : 0);
+			if (position < 0 || 3 * position + 2 >= static_cast<int64_t>(positions.size())) {
+				chunk.error = "Face references a missing position.";
+				return;
+			}
+			vertex.position.x = positions[3 * position + 0];
+			vertex.position.y = positions[3 * position + 1];
+			vertex.position.z = positions[3 * position + 2];
+
+			if (corner.texCoord >= 0 || (corner.relativeMask & TEXCOORD_RELATIVE_BIT)) {
+				int64_t texCoord = corner.texCoord + ((corner.relativeMask & TEXCOORD_RELATIVE_BIT) ? chunkTexCoordBase : 0);
+				if (texCoord < 0 || 2 * texCoord + 1 >= static_cast<int64_t>(texCoords.size())) {
+					chunk.error = "Face references a missing texture coordinate.";
+					return;
+				}
+				vertex.texCoord.x = texCoords[2 * texCoord + 0];
+				vertex.texCoord.y = 1 - texCoords[2 * texCoord + 1];
+			}
+
+			if (corner.normal >= 0 || (corner.relativeMask & NORMAL_RELATIVE_BIT)) {
+				int64_t normal = corner.normal + ((corner.relativeMask & NORMAL_RELATIVE_BIT) ? chunkNormalBase : 0);
+				if (normal < 0 || 3 * normal + 2 >= static_cast<int64_t>(normals.size())) {
+					chunk.error = "Face references a missing normal.";
+					return;
+				}
+				vertex.norm.x = normals[3 * normal + 0];
+				vertex.norm.y = normals[3 * normal + 1];
+				vertex.norm.z = normals[3 * normal + 2];
+			}
+
+			cornerVertices[chunk.cornerOffset + c] = vertex;
+		}
+
+		splitQuads(chunk);
+	});
+
+	for (const auto& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			throw std::runtime_error("ERROR: cannot read model \"" + modelPath + "\". " + chunk.error);
+		}
+	}
+
+	chunks.clear();
+	fileData.clear();
+	fileData.shrink_to_fit();
+}
+
+void ObjParser::splitQuads(Chunk& chunk)
+{
+	/*
+		A quad was emitted as [0, 1, 2], [0, 2, 3]. Like tinyobj, keep that split when the
+		0-2 diagonal is the shorter one and switch to [0, 1, 3], [1, 2, 3] otherwise.
+	*/
+	for (size_t quad : chunk.quads) {
+		Vertex* corners = cornerVertices.data() + chunk.cornerOffset + quad;
+
+		Vertex v0 = corners[0];
+		Vertex v1 = corners[1];
+		Vertex v2 = corners[2];
+		Vertex v3 = corners[5];
+
+		glm::vec3 e02 = v2.position - v0.position;
+		glm::vec3 e13 = v3.position - v1.position;
+
+		float sqr02 = e02.x * e02.x + e02.y * e02.y + e02.z * e02.z;
+		float sqr13 = e13.x * e13.x + e13.y * e13.y + e13.z * e13.z;
+
+		if (!(sqr02 < sqr13)) {
+			corners[0] = v0;
+			corners[1] = v1;
+			corners[2] = v3;
+			corners[3] = v1;
+			corners[4] = v2;
+			corners[5] = v3;
+		}
+	}
+}
+
+void ObjParser::weldVertices()
+{
+	/*
+		Welding has to give the same result as a single threaded pass, where vertices are
+		numbered in order of their first appearance. Every thread owns a hash partition and
+		finds the first corner with the same value for each corner in its partition.
+		A serial pass then hands out vertex indices in corner order.
+	*/
+	size_t cornerCount = cornerVertices.size();
+
+	std::vector<size_t> hashes(cornerCount);
+	parallelFor(threadCount, [&](size_t thread) {
+		size_t begin = cornerCount * thread / threadCount;
+		size_t end = cornerCount * (thread + 1) / threadCount;
+		for (size_t c = begin; c < end; c++) {
+			hashes[c] = std::hash<Vertex>()(cornerVertices[c]);
+		}
+	});
+
+	auto cornerHash = [&hashes](uint32_t corner) { return hashes[corner]; };
+	auto cornerEqual = [this](uint32_t a, uint32_t b) { return cornerVertices[a] == cornerVertices[b]; };
+
+	std::vector<uint32_t> firstCorner(cornerCount);
+	parallelFor(threadCount, [&](size_t thread) {
+		std::unordered_set<uint32_t, decltype(cornerHash), decltype(cornerEqual)> seen(cornerCount / threadCount + 1, cornerHash, cornerEqual);
+
+		for (uint32_t c = 0; c < cornerCount; c++) {
+			uint64_t partition = (static_cast<uint64_t>(hashes[c]) * 0x9E3779B97F4A7C15ull) >> 32;
+			if (partition % threadCount != thread) {
+				continue;
+			}
+
+			firstCorner[c] = *seen.insert(c).first;
+		}
+	});
+
+	std::vector<uint32_t> cornerToVertex(cornerCount);
+	indices.resize(cornerCount);
+
+	for (uint32_t c = 0; c < cornerCount; c++) {
+		if (firstCorner[c] == c) {
+			cornerToVertex[c] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(cornerVertices[c]);
+		}
+		else {
+			cornerToVertex[c] = cornerToVertex[firstCorner[c]];
+		}
+
+		indices[c] = cornerToVertex[c];
+	}
+
+	cornerVertices.clear();
+	cornerVertices.shrink_to_fit();
+}
+
+template<typename Function>
+void ObjParser::parallelFor(size_t count, Function function)
+{
+	size_t workerCount = std::min<size_t>(threadCount, count);
+	if (workerCount <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			function(i);
+		}
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for (size_t worker = 0; worker < workerCount; worker++) {
+		workers.emplace_back([&, worker]() {
+			for (size_t i = worker; i < count; i += workerCount) {
+				function(i);
+			}
+		});
+	}
+
+	for (auto& thread : workers) {
+		thread.join();
+	}
+}
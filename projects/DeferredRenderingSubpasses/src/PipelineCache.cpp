@@ -0,0 +1,207 @@
+#include "PipelineCache.h"
+
+// std
+#include <stdexcept>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+#define PIPELINE_CACHE_VERSION 1
+
+static const char PIPELINE_CACHE_MAGIC[4] = { 'V', 'L', 'P', 'C' };
+
+static uint64_t hashData(const char* data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	this->device = device;
+
+	VkPhysicalDeviceProperties deviceProperties = {};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC));
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = deviceProperties.vendorID;
+	header.deviceID = deviceProperties.deviceID;
+	header.driverVersion = deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	std::stringstream path;
+	path << "pipeline_" << std::hex << header.vendorID << "_" << header.deviceID << ".pipelinecache";
+	cachePath = path.str();
+
+	std::vector<char> data;
+	isLoaded = load(data);
+
+	createCache(data);
+}
+
+PipelineCache::~PipelineCache()
+{
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+}
+
+void PipelineCache::logCreateTime(float milliseconds)
+{
+	if (!isLoaded || header.coldCreateTime <= 0.0f) {
+		header.coldCreateTime = milliseconds;
+		std::cout << "PipelineCache >> pipelines created in " << milliseconds << " ms without cache" << std::endl;
+		return;
+	}
+
+	std::cout << "PipelineCache >> pipelines created in " << milliseconds << " ms, "
+		<< header.coldCreateTime - milliseconds << " ms saved (" << header.coldCreateTime << " ms without cache)" << std::endl;
+}
+
+void PipelineCache::save()
+{
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+	if (result != VK_SUCCESS) {
+		std::cerr << "WARNING: cannot get Pipeline Cache data." << std::endl;
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data());
+	if (result != VK_SUCCESS) {
+		std::cerr << "WARNING: cannot get Pipeline Cache data." << std::endl;
+		return;
+	}
+
+	Header stored = header;
+	stored.dataSize = dataSize;
+	stored.dataHash = hashData(data.data(), dataSize);
+
+	// Same temporary file and rename as MeshCache, a partial write never replaces a good cache
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "WARNING: cannot write pipeline cache \"" << cachePath << "\"." << std::endl;
+			return;
+		}
+
+		file.write(reinterpret_cast<const char*>(&stored), sizeof(Header));
+		file.write(data.data(), dataSize);
+
+		if (!file.good()) {
+			std::cerr << "WARNING: cannot write pipeline cache \"" << cachePath << "\"." << std::endl;
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		std::cerr << "WARNING: cannot write pipeline cache \"" << cachePath << "\"." << std::endl;
+	}
+}
+
+bool PipelineCache::load(std::vector<char>& data)
+{
+	std::ifstream file(cachePath, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	Header stored = {};
+	if (fileSize < sizeof(Header) || !file.read(reinterpret_cast<char*>(&stored), sizeof(Header))) {
+		std::cerr << "WARNING: pipeline cache \"" << cachePath << "\" is corrupt, it will be rebuilt." << std::endl;
+		return false;
+	}
+
+	bool isCompatible = memcmp(stored.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC)) == 0
+		&& stored.version == PIPELINE_CACHE_VERSION
+		&& stored.vendorID == header.vendorID
+		&& stored.deviceID == header.deviceID
+		&& stored.driverVersion == header.driverVersion
+		&& memcmp(stored.pipelineCacheUUID, header.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+	// Written by another driver or an older build, not an error
+	if (!isCompatible) {
+		std::cout << "PipelineCache >> \"" << cachePath << "\" was written by another driver, it will be rebuilt" << std::endl;
+		return false;
+	}
+
+	if (stored.dataSize != fileSize - sizeof(Header)) {
+		std::cerr << "WARNING: pipeline cache \"" << cachePath << "\" is corrupt, it will be rebuilt." << std::endl;
+		return false;
+	}
+
+	data.resize(stored.dataSize);
+	if (!file.read(data.data(), stored.dataSize)
+		|| hashData(data.data(), data.size()) != stored.dataHash
+		|| !isDataHeaderValid(data)) {
+		std::cerr << "WARNING: pipeline cache \"" << cachePath << "\" is corrupt, it will be rebuilt." << std::endl;
+		data.clear();
+		return false;
+	}
+
+	header.coldCreateTime = stored.coldCreateTime;
+
+	std::cout << "PipelineCache >> loaded " << data.size() << " bytes from \"" << cachePath << "\"" << std::endl;
+	return true;
+}
+
+bool PipelineCache::isDataHeaderValid(const std::vector<char>& data)
+{
+	/*
+		The blob starts with the header defined by the Vulkan spec. Drivers are required to reject
+		incompatible data themselves, but not all of them handle garbage gracefully, so check it here.
+	*/
+	VkPipelineCacheHeaderVersionOne dataHeader = {};
+	if (data.size() < sizeof(dataHeader)) {
+		return false;
+	}
+	memcpy(&dataHeader, data.data(), sizeof(dataHeader));
+
+	return dataHeader.headerSize >= sizeof(dataHeader)
+		&& dataHeader.headerSize <= data.size()
+		&& dataHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& dataHeader.vendorID == header.vendorID
+		&& dataHeader.deviceID == header.deviceID
+		&& memcmp(dataHeader.pipelineCacheUUID, header.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::createCache(const std::vector<char>& data)
+{
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkResult result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+	if (result == VK_SUCCESS) {
+		return;
+	}
+
+	if (!data.empty()) {
+		// The driver refused the data, start with an empty cache
+		std::cerr << "WARNING: pipeline cache \"" << cachePath << "\" was rejected by the driver, it will be rebuilt." << std::endl;
+		isLoaded = false;
+
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+	}
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Pipeline Cache.");
+	}
+}
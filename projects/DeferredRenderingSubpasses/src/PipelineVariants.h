@@ -0,0 +1,68 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+/*
+	Graphics pipelines built from the static state they need, each variant only once.
+
+	Viewport and scissor are always dynamic, so no pipeline depends on the swapchain's size. With extended
+	dynamic state (Vulkan 1.3 devices) cull mode and depth test, write and compare op are dynamic too and
+	descriptions that differ only in them share a pipeline. Without it they are static and part of the variant.
+
+	A variant is found by the FNV-1a hash of the description's static state. setDynamicState() records the rest
+	of the description after the pipeline is bound. Every pipeline lives as long as the PipelineVariants.
+*/
+class PipelineVariants
+{
+public:
+
+	struct Description
+	{
+		std::string vertShaderPath;
+		std::string fragShaderPath;
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+		uint32_t colorAttachmentCount = 1;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		// Whether the subpass has a depth attachment, depth state is ignored without one
+		bool hasDepth = false;
+
+		// Dynamic with extended dynamic state
+		VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+		bool depthTestEnable = false;
+		bool depthWriteEnable = false;
+		VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	};
+
+	PipelineVariants(VkDevice device, VkPipelineCache pipelineCache, bool isExtendedDynamicState);
+	~PipelineVariants();
+
+	// Builds the variant the first time it is asked for
+	VkPipeline get(const Description& description);
+	// After binding the description's pipeline, in every command buffer that draws with it
+	void setDynamicState(VkCommandBuffer commandBuffer, const Description& description, VkExtent2D extent);
+
+	// Getters
+	uint32_t getVariantCount() { return static_cast<uint32_t>(pipelines.size()); }
+	bool isExtendedDynamicState() { return extendedDynamicState; }
+
+private:
+
+	VkDevice device;
+	VkPipelineCache pipelineCache;
+	bool extendedDynamicState;
+
+	std::unordered_map<uint64_t, VkPipeline> pipelines;
+
+	uint64_t hashStaticState(const Description& description);
+	VkPipeline createPipeline(const Description& description);
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+// std
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "Model.h"
+#include "Texture.h"
+#include "MemoryAllocator.h"
+#include "Bvh.h"
+
+/*
+	Meshes and the instances placed in the world.
+
+	Instances are grouped by mesh, so every mesh is drawn with one instanced vkCmdDrawIndexed
+	no matter how many copies of it there are. The transforms of a group are contiguous in the
+	instance buffer of the frame, starting at the group's firstInstance.
+
+	Every frame in flight has a persistently mapped instance buffer of its own. update() rewrites it
+	after the frame's fence was waited on, and only when instances changed since it was last written,
+	so a static scene costs nothing per frame however many instances it has.
+
+	The VertexDecode of every mesh sits in a storage buffer that vertex shaders index with the instance's
+	meshIndex, so one indirect draw can render packed meshes with different bounds. Meshes are added before
+	rendering starts, so the buffer is simply replaced when it fills up.
+
+	A BVH over the instance boxes serves visibility and picking queries. Added instances rebuild it,
+	moved instances refit it, until the refit tree's root grew past twice the area it was built with.
+*/
+class Scene
+{
+public:
+
+	// Instances of one mesh, drawn with a single instanced draw
+	struct Batch
+	{
+		uint32_t meshIndex;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	Scene(VkDevice device, MemoryAllocator* allocator, uint32_t frameCount);
+	~Scene();
+
+	// The scene takes ownership of model and texture, returns the mesh index
+	uint32_t addMesh(Model* model, Texture* texture);
+	// Returns the instance index
+	uint32_t addInstance(uint32_t meshIndex, const glm::mat4& transform);
+	void setTransform(uint32_t instanceIndex, const glm::mat4& transform);
+
+	// Bring the instance buffer of the given frame and the BVH up to date
+	void update(uint32_t frameIndex);
+
+	// Nearest instance whose box the ray enters, returns the instance index (valid after update())
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, uint32_t& instanceIndex, float& distance);
+
+	// Getters
+	Model* getModel(uint32_t meshIndex) { return meshes[meshIndex].model; }
+	Texture* getTexture(uint32_t meshIndex) { return meshes[meshIndex].texture; }
+	uint32_t getMeshCount() { return static_cast<uint32_t>(meshes.size()); }
+	uint32_t getInstanceCount() { return static_cast<uint32_t>(instances.size()); }
+	uint32_t getMeshIndex(uint32_t instanceIndex) { return instances[instanceIndex].meshIndex; }
+	const std::vector<Batch>& getBatches() { return batches; }
+	// Instances in batch order, as in the instance buffers (valid after update())
+	const std::vector<InstanceData>& getInstanceData() { return instanceData; }
+	VkBuffer getInstanceBuffer(uint32_t frameIndex) { return instanceBuffers[frameIndex].buffer; }
+	// VertexDecode per mesh, by mesh index
+	VkBuffer getMeshBuffer() { return meshBuffer.buffer; }
+	// Changes whenever instances are added or moved
+	uint64_t getVersion() { return version; }
+	// Items are positions in getInstanceData() (valid after update())
+	const Bvh& getBvh() { return bvh; }
+	// World boxes, in the order of getInstanceData() (valid after update())
+	const std::vector<BoundingBox>& getInstanceBounds() { return instanceBounds; }
+
+private:
+
+	struct Mesh
+	{
+		Model* model;
+		Texture* texture;
+	};
+
+	struct Instance
+	{
+		uint32_t meshIndex;
+		glm::mat4 transform;
+	};
+
+	struct InstanceBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		uint32_t capacity = 0;
+		// Scene version the buffer holds
+		uint64_t version = 0;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+
+	std::vector<Mesh> meshes;
+	std::vector<Instance> instances;
+	std::vector<Batch> batches;
+	// Instance indices in batch order
+	std::vector<uint32_t> drawOrder;
+	std::vector<InstanceData> instanceData;
+	bool isBatchesDirty = false;
+	bool isInstanceDataDirty = false;
+
+	Bvh bvh;
+	// World space boxes in batch order
+	std::vector<BoundingBox> instanceBounds;
+	bool isBvhDirty = false;
+	// Root area of the last build, refits past twice this rebuild
+	float bvhBuildArea = 0.0f;
+	// Bumped on every change to the instances
+	uint64_t version = 1;
+
+	std::vector<InstanceBuffer> instanceBuffers;
+
+	struct {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		uint32_t capacity = 0;
+	} meshBuffer;
+
+	void buildBatches();
+	void updateBvh();
+	void createInstanceBuffer(InstanceBuffer& instanceBuffer, uint32_t capacity);
+	void destroyInstanceBuffer(InstanceBuffer& instanceBuffer);
+	void createMeshBuffer(uint32_t capacity);
+	void destroyMeshBuffer();
+};
@@ -5,15 +5,36 @@
 
 #include <vulkan/vulkan.h>
 
+#include "MemoryAllocator.h"
+
+/*
+	R8G8B8A8_SRGB image with a full mip chain, its view and sampler.
+
+	TextureStreamer creates the image once the file is decoded and uploads its pixels. Until isResident()
+	the contents are undefined and the renderer samples the streamer's placeholder instead.
+*/
 class Texture
 {
 public:
 
-	Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, uint32_t graphicsQueueIndex, VkQueue queue);
+	// Nothing is created until create()
+	Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* allocator);
 	~Texture();
 
+	void create(uint32_t width, uint32_t height);
+	// Releases whatever create() made, also after it failed halfway, and leaves the texture not created
+	void destroy();
+	// Once the upload is complete
+	void setResident() { resident = true; }
+
+	// Getters
 	VkImageView getImageView();
 	VkSampler getSampler();
+	VkImage getImage() { return textureImage; }
+	VkExtent3D getExtent() { return textureExtent; }
+	uint32_t getMipLevels() { return mipLevels; }
+	std::string getPath() { return texturePath; }
+	bool isResident() { return resident; }
 
 private:
 	
@@ -21,31 +42,19 @@ private:
 	
 	VkDevice device;
 	VkPhysicalDevice physicalDevice;
-	VkCommandPool commandPool;
-	uint32_t graphicsQueueIndex;
-	VkQueue queue;
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	VkCommandBuffer copyCommandBuffer;
+	MemoryAllocator* allocator;
 
 	std::string texturePath;
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
-	VkSampler textureSampler;
-	VkExtent3D textureExtent;
+	VkImage textureImage = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation textureImageAllocation;
+	VkImageView textureImageView = VK_NULL_HANDLE;
+	VkSampler textureSampler = VK_NULL_HANDLE;
+	VkExtent3D textureExtent = {};
 
-	uint32_t mipLevels;
+	uint32_t mipLevels = 1;
+	bool resident = false;
 
 	void createTextureImage();
 	void createTextureImageView();
 	void createTextureSampler();
-	void createStagingBuffer(VkDeviceSize bufferSize);
-	void createCopyCommandBuffer();
-	void copyBufferToImage(VkBuffer buffer, VkImage image, VkExtent3D imageExtent);
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void generateMipMaps(VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 };
-
@@ -0,0 +1,551 @@
+#include "TextureStreamer.h"
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "CpuProfiler.h"
+
+// One submit per frame at most, so a big scene streams in over several frames
+#define MAX_TEXTURES_PER_BATCH 16
+
+TextureStreamer::TextureStreamer(
+	VkDevice device,
+	VkPhysicalDevice physicalDevice,
+	MemoryAllocator* allocator,
+	uint32_t graphicsQueueIndex,
+	VkQueue graphicsQueue,
+	uint32_t transferQueueIndex,
+	VkQueue transferQueue,
+	uint32_t decodeThreadCount
+)
+{
+	this->device = device;
+	this->physicalDevice = physicalDevice;
+	this->allocator = allocator;
+	this->graphicsQueueIndex = graphicsQueueIndex;
+	this->graphicsQueue = graphicsQueue;
+	this->transferQueueIndex = transferQueueIndex;
+	this->transferQueue = transferQueue;
+	this->hasTransferQueue = transferQueueIndex != graphicsQueueIndex;
+
+	/*
+		Image copies on a queue family have to respect its minImageTransferGranularity. Only families that
+		copy at any texel granularity get the uploads, others leave them to the graphics queue.
+	*/
+	if (hasTransferQueue) {
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+		VkExtent3D granularity = families[transferQueueIndex].minImageTransferGranularity;
+		if (granularity.width != 1 || granularity.height != 1 || granularity.depth != 1) {
+			std::cout << "TextureStreamer >> transfer queue granularity " << granularity.width << "x" << granularity.height << "x" << granularity.depth << ", copying on the graphics queue" << std::endl;
+			hasTransferQueue = false;
+		}
+	}
+
+	graphicsCommandPool = createCommandPool(graphicsQueueIndex);
+	if (hasTransferQueue) {
+		transferCommandPool = createCommandPool(transferQueueIndex);
+	}
+
+	// Uploaded like any other texture, but waited for, every descriptor points at it until the real ones arrive
+	const uint8_t grey[4] = { 128, 128, 128, 255 };
+	placeholder = new Texture("placeholder", device, physicalDevice, allocator);
+	std::vector<Upload> uploads = { createUpload(placeholder, grey, 1, 1) };
+	submitBatch(uploads);
+
+	vkWaitForFences(device, 1, &batches.back().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	retireBatch(batches.back());
+	batches.pop_back();
+
+	for (uint32_t i = 0; i < std::max(1u, decodeThreadCount); i++) {
+		workers.emplace_back(&TextureStreamer::workerLoop, this);
+	}
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	requestCondition.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	for (Batch& batch : batches) {
+		vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		retireBatch(batch);
+	}
+	for (Upload& upload : decoded) {
+		destroyUpload(upload);
+	}
+
+	delete placeholder;
+
+	vkDestroyCommandPool(device, graphicsCommandPool, nullptr);
+	if (hasTransferQueue) {
+		vkDestroyCommandPool(device, transferCommandPool, nullptr);
+	}
+}
+
+Texture* TextureStreamer::request(std::string texturePath)
+{
+	Texture* texture = new Texture(texturePath, device, physicalDevice, allocator);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(texture);
+		decodingCount++;
+	}
+	requestCondition.notify_one();
+
+	return texture;
+}
+
+void TextureStreamer::update()
+{
+	PROFILE_FUNCTION();
+
+	for (size_t i = 0; i < batches.size();) {
+		if (vkGetFenceStatus(device, batches[i].fence) == VK_SUCCESS) {
+			retireBatch(batches[i]);
+			batches.erase(batches.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+
+	std::vector<Upload> uploads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t count = std::min(decoded.size(), static_cast<size_t>(MAX_TEXTURES_PER_BATCH));
+		uploads.assign(decoded.begin(), decoded.begin() + count);
+		decoded.erase(decoded.begin(), decoded.begin() + count);
+	}
+
+	if (!uploads.empty()) {
+		submitBatch(uploads);
+	}
+}
+
+void TextureStreamer::flush()
+{
+	PROFILE_FUNCTION();
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		decodedCondition.wait(lock, [this]() { return decodingCount == 0; });
+	}
+
+	bool isSubmitted = false;
+	while (!isSubmitted) {
+		update();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		isSubmitted = decoded.empty();
+	}
+
+	for (Batch& batch : batches) {
+		vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	update();
+}
+
+void TextureStreamer::workerLoop()
+{
+	while (true) {
+		Texture* texture;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			requestCondition.wait(lock, [this]() { return isStopping || !requests.empty(); });
+			if (isStopping) {
+				return;
+			}
+
+			texture = requests.front();
+			requests.pop_front();
+		}
+
+		// A texture that cannot be loaded keeps showing the placeholder
+		Upload upload;
+		int texWidth;
+		int texHeight;
+		int texChannels;
+		stbi_uc* pixels = stbi_load(texture->getPath().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		if (pixels) {
+			try {
+				upload = createUpload(texture, pixels, texWidth, texHeight);
+			}
+			catch (const std::exception& exception) {
+				std::cerr << exception.what() << std::endl;
+			}
+			stbi_image_free(pixels);
+		}
+		else {
+			std::cerr << "WARNING: cannot read texture file \"" << texture->getPath() << "\", using the placeholder." << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (upload.texture) {
+				decoded.push_back(upload);
+			}
+			decodingCount--;
+		}
+		decodedCondition.notify_all();
+	}
+}
+
+TextureStreamer::Upload TextureStreamer::createUpload(Texture* texture, const void* pixels, uint32_t width, uint32_t height)
+{
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(width) * height * 4;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = bufferSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Runs on the decode threads, which must not share result
+	Upload upload;
+	try {
+		texture->create(width, height);
+
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &upload.stagingBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot create Staging Buffer for Texture.");
+		}
+
+		upload.stagingBufferAllocation = allocator->allocateBuffer(upload.stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+	catch (...) {
+		// Nothing half made is left behind, the texture stays not created and keeps showing the placeholder
+		destroyUpload(upload);
+		texture->destroy();
+		throw;
+	}
+
+	memcpy(upload.stagingBufferAllocation.mapped, pixels, bufferSize);
+
+	upload.texture = texture;
+
+	return upload;
+}
+
+void TextureStreamer::destroyUpload(Upload& upload)
+{
+	vkDestroyBuffer(device, upload.stagingBuffer, nullptr);
+	allocator->free(upload.stagingBufferAllocation);
+}
+
+VkCommandPool TextureStreamer::createCommandPool(uint32_t queueIndex)
+{
+	VkCommandPoolCreateInfo commandPoolInfo = {};
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	commandPoolInfo.queueFamilyIndex = queueIndex;
+
+	VkCommandPool commandPool;
+	result = vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Texture Streamer Command Pool.");
+	}
+
+	return commandPool;
+}
+
+VkCommandBuffer TextureStreamer::beginCommandBuffer(VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	result = vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot allocate Texture Upload Command Buffer.");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void TextureStreamer::submitBatch(std::vector<Upload>& uploads)
+{
+	PROFILE_FUNCTION();
+
+	Batch batch;
+	batch.uploads = uploads;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	result = vkCreateFence(device, &fenceInfo, nullptr, &batch.fence);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Texture Upload Fence.");
+	}
+
+	if (hasTransferQueue) {
+		batch.transferCommandBuffer = beginCommandBuffer(transferCommandPool);
+			for (Upload& upload : batch.uploads) {
+				recordCopy(batch.transferCommandBuffer, upload);
+				recordOwnershipTransfer(batch.transferCommandBuffer, upload.texture, true);
+			}
+		vkEndCommandBuffer(batch.transferCommandBuffer);
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		result = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.releaseSemaphore);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot create Texture Release Semaphore.");
+		}
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch.releaseSemaphore;
+
+		result = vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot submit Transfer Queue.");
+		}
+	}
+
+	batch.graphicsCommandBuffer = beginCommandBuffer(graphicsCommandPool);
+		for (Upload& upload : batch.uploads) {
+			if (hasTransferQueue) {
+				recordOwnershipTransfer(batch.graphicsCommandBuffer, upload.texture, false);
+			}
+			else {
+				recordCopy(batch.graphicsCommandBuffer, upload);
+			}
+			recordMipMaps(batch.graphicsCommandBuffer, upload.texture);
+		}
+	vkEndCommandBuffer(batch.graphicsCommandBuffer);
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = hasTransferQueue ? 1 : 0;
+	submitInfo.pWaitSemaphores = &batch.releaseSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.graphicsCommandBuffer;
+
+	result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot submit Graphics Queue.");
+	}
+
+	batches.push_back(batch);
+}
+
+void TextureStreamer::retireBatch(Batch& batch)
+{
+	for (Upload& upload : batch.uploads) {
+		destroyUpload(upload);
+		upload.texture->setResident();
+	}
+	residentVersion++;
+
+	vkFreeCommandBuffers(device, graphicsCommandPool, 1, &batch.graphicsCommandBuffer);
+	if (hasTransferQueue) {
+		vkFreeCommandBuffers(device, transferCommandPool, 1, &batch.transferCommandBuffer);
+		vkDestroySemaphore(device, batch.releaseSemaphore, nullptr);
+	}
+	vkDestroyFence(device, batch.fence, nullptr);
+}
+
+void TextureStreamer::recordCopy(VkCommandBuffer commandBuffer, Upload& upload)
+{
+	Texture* texture = upload.texture;
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture->getImage();
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.levelCount = texture->getMipLevels();
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.mipLevel = 0;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = texture->getExtent();
+
+	vkCmdCopyBufferToImage(
+		commandBuffer,
+		upload.stagingBuffer,
+		texture->getImage(),
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1,
+		&region
+	);
+}
+
+void TextureStreamer::recordOwnershipTransfer(VkCommandBuffer commandBuffer, Texture* texture, bool isRelease)
+{
+	/*
+		Both halves name the same families and layouts. The release makes the copy available,
+		the acquire makes it visible to the blits. Each side ignores the access mask of the other.
+	*/
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = transferQueueIndex;
+	barrier.dstQueueFamilyIndex = graphicsQueueIndex;
+	barrier.image = texture->getImage();
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.levelCount = texture->getMipLevels();
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.srcAccessMask = isRelease ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+	barrier.dstAccessMask = isRelease ? 0 : VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		isRelease ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		isRelease ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+}
+
+void TextureStreamer::recordMipMaps(VkCommandBuffer commandBuffer, Texture* texture)
+{
+	VkImage image = texture->getImage();
+	uint32_t mipLevels = texture->getMipLevels();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t mipWidth = static_cast<int32_t>(texture->getExtent().width);
+	int32_t mipHeight = static_cast<int32_t>(texture->getExtent().height);
+
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+
+		VkImageBlit imageBlit = {};
+		imageBlit.srcOffsets[0] = { 0, 0, 0 };
+		imageBlit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBlit.srcSubresource.layerCount = 1;
+		imageBlit.srcSubresource.baseArrayLayer = 0;
+		imageBlit.srcSubresource.mipLevel = i - 1;
+		imageBlit.dstOffsets[0] = { 0, 0, 0 };
+		imageBlit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+		imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBlit.dstSubresource.layerCount = 1;
+		imageBlit.dstSubresource.baseArrayLayer = 0;
+		imageBlit.dstSubresource.mipLevel = i;
+
+		vkCmdBlitImage(
+			commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &imageBlit,
+			VK_FILTER_LINEAR
+		);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+
+		if (mipWidth > 1) { mipWidth /= 2; }
+		if (mipHeight > 1) { mipHeight /= 2; }
+	}
+
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+#include "Texture.h"
+
+/*
+	Uploads textures in the background while frames keep rendering.
+
+	request() returns the Texture right away and queues its file. Decode threads read it, create the image
+	and fill a staging buffer. update() runs on the render thread once a frame: it retires the batches whose
+	fence signaled and submits up to MAX_TEXTURES_PER_BATCH decoded textures in one new batch.
+
+	With a transfer-only queue family that copies at a (1,1,1) granularity the copies run there and the
+	images are released to the graphics family, which acquires them and blits the mip chains, blits need a
+	graphics queue. A semaphore orders the two submits. Without one the graphics queue does both. Until a
+	texture is resident the renderer samples getPlaceholder() in its place, a texture whose upload could
+	not be created keeps it.
+*/
+class TextureStreamer
+{
+public:
+
+	// transferQueueIndex equal to graphicsQueueIndex means there is no dedicated transfer queue
+	TextureStreamer(
+		VkDevice device,
+		VkPhysicalDevice physicalDevice,
+		MemoryAllocator* allocator,
+		uint32_t graphicsQueueIndex,
+		VkQueue graphicsQueue,
+		uint32_t transferQueueIndex,
+		VkQueue transferQueue,
+		uint32_t decodeThreadCount = 2
+	);
+	~TextureStreamer();
+
+	// The caller owns the texture and deletes it after the streamer
+	Texture* request(std::string texturePath);
+	// Render thread only, the graphics queue must not be used by another thread meanwhile
+	void update();
+	// Blocks until every requested texture is resident or failed to load
+	void flush();
+
+	// Getters
+	Texture* getPlaceholder() { return placeholder; }
+	// Changes whenever textures turn resident
+	uint64_t getResidentVersion() { return residentVersion; }
+	bool isTransferQueueDedicated() { return hasTransferQueue; }
+
+private:
+
+	struct Upload {
+		Texture* texture = nullptr;
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation stagingBufferAllocation;
+	};
+
+	struct Batch {
+		std::vector<Upload> uploads;
+		VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+		// Signaled by the transfer submit, waited on by the graphics submit
+		VkSemaphore releaseSemaphore = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+	};
+
+	VkResult result;
+
+	VkDevice device;
+	VkPhysicalDevice physicalDevice;
+	MemoryAllocator* allocator;
+	uint32_t graphicsQueueIndex;
+	VkQueue graphicsQueue;
+	uint32_t transferQueueIndex;
+	VkQueue transferQueue;
+	bool hasTransferQueue;
+
+	VkCommandPool graphicsCommandPool;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+
+	// 1x1 grey, resident from the start
+	Texture* placeholder = nullptr;
+	uint64_t residentVersion = 0;
+	// Submitted, in submission order
+	std::vector<Batch> batches;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable requestCondition;
+	std::condition_variable decodedCondition;
+	std::deque<Texture*> requests;
+	std::vector<Upload> decoded;
+	// Requested, not decoded yet
+	uint32_t decodingCount = 0;
+	bool isStopping = false;
+
+	void workerLoop();
+	Upload createUpload(Texture* texture, const void* pixels, uint32_t width, uint32_t height);
+	void destroyUpload(Upload& upload);
+	VkCommandPool createCommandPool(uint32_t queueIndex);
+	VkCommandBuffer beginCommandBuffer(VkCommandPool commandPool);
+	void submitBatch(std::vector<Upload>& uploads);
+	void retireBatch(Batch& batch);
+	void recordCopy(VkCommandBuffer commandBuffer, Upload& upload);
+	// Release on the transfer queue, acquire on the graphics queue
+	void recordOwnershipTransfer(VkCommandBuffer commandBuffer, Texture* texture, bool isRelease);
+	// Level 0 in TRANSFER_DST_OPTIMAL, leaves every level in SHADER_READ_ONLY_OPTIMAL
+	void recordMipMaps(VkCommandBuffer commandBuffer, Texture* texture);
+};
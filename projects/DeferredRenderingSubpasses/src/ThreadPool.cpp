@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+
+// std
+#include <algorithm>
+
+#include "CpuProfiler.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (uint32_t i = 1; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(uint32_t jobCount, const std::function<void(uint32_t jobIndex, uint32_t threadIndex)>& function)
+{
+	if (jobCount == 0) {
+		return;
+	}
+
+	// A single job is not worth waking anyone up
+	if (jobCount == 1 || workers.empty()) {
+		for (uint32_t i = 0; i < jobCount; i++) {
+			function(i, 0);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->function = &function;
+		this->jobCount = jobCount;
+		nextJob.store(0);
+		busyWorkers = static_cast<uint32_t>(workers.size());
+		exception = nullptr;
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	runJobs(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]() { return busyWorkers == 0; });
+	this->function = nullptr;
+
+	if (exception) {
+		std::rethrow_exception(exception);
+	}
+}
+
+void ThreadPool::workerLoop(uint32_t threadIndex)
+{
+	uint64_t seenGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this, seenGeneration]() { return isStopping || generation != seenGeneration; });
+			if (isStopping) {
+				return;
+			}
+			seenGeneration = generation;
+		}
+
+		runJobs(threadIndex);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		busyWorkers--;
+		if (busyWorkers == 0) {
+			doneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::runJobs(uint32_t threadIndex)
+{
+	PROFILE_SCOPE("ThreadPool::runJobs");
+
+	for (uint32_t job = nextJob.fetch_add(1); job < jobCount; job = nextJob.fetch_add(1)) {
+		try {
+			(*function)(job, threadIndex);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!exception) {
+				exception = std::current_exception();
+			}
+		}
+	}
+}
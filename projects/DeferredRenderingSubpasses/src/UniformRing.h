@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+
+/*
+	Ring of per-frame uniform data in one persistently mapped buffer.
+
+	The buffer is split into one region per frame in flight. At the start of a frame the region of that
+	frame is reset (its fence was waited on, so the GPU is done reading it) and per-frame data is bump
+	allocated from it. Returned offsets are aligned to minUniformBufferOffsetAlignment and are meant
+	to be passed as dynamic offsets to descriptors of type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC.
+*/
+class UniformRing
+{
+public:
+
+	UniformRing(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* allocator, uint32_t frameCount, VkDeviceSize frameSize = 64 * 1024);
+	~UniformRing();
+
+	// Start writing to the region of the given frame, everything allocated from it before is discarded
+	void beginFrame(uint32_t frameIndex);
+
+	// Copy data to the current frame region, returns its dynamic offset
+	uint32_t allocate(const void* data, VkDeviceSize size);
+
+	template<typename T>
+	uint32_t push(const T& data) { return allocate(&data, sizeof(T)); }
+
+	// Getters
+	VkBuffer getBuffer() { return buffer; }
+
+private:
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+
+	VkBuffer buffer;
+	MemoryAllocator::Allocation bufferAllocation;
+
+	VkDeviceSize alignment;
+	VkDeviceSize frameSize;
+	VkDeviceSize frameBegin = 0;
+	VkDeviceSize head = 0;
+
+	void createBuffer(uint32_t frameCount);
+};
@@ -7,22 +7,35 @@
 #include <algorithm>
 #include <set>
 #include <chrono>
+#include <cmath>
+#include <random>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include "Utils.hpp"
-#include "Shader.h"
+#include "CpuProfiler.h"
 #include "Model.h"
+#include "Frustum.h"
 
 #define FRAMES_IN_FLIGHT 2
+// Smallest share of the scene's instances worth recording on a thread of its own
+#define MIN_INSTANCES_PER_THREAD 64
 #define MSSA_SAMPLES VK_SAMPLE_COUNT_1_BIT
+// Size of the texture array of the G-buffer pass, keep in sync with shaders/phong.frag
+#define MAX_SCENE_TEXTURES 16
 
-VulkanRenderer::VulkanRenderer(bool enableValidationLayers)
+VulkanRenderer::VulkanRenderer(bool enableValidationLayers, uint32_t instanceCount, CULLING_MODE cullingMode, bool enableOcclusionCulling, uint32_t lightCount, bool enableCullingValidation, VERTEX_FORMAT vertexFormat, GBUFFER_LAYOUT gbufferLayout)
 {
 	this->enableValidationLayers = enableValidationLayers;
+	this->instanceCount = instanceCount;
+	this->cullingMode = cullingMode;
+	this->enableOcclusionCulling = enableOcclusionCulling;
+	this->lightCount = lightCount;
+	this->enableCullingValidation = enableCullingValidation;
+	this->vertexFormat = vertexFormat;
+	this->gbufferLayout = gbufferLayout;
 }
 
 void VulkanRenderer::start(int windowWidth, int windowHeight, const char* windowTitle)
@@ -39,50 +52,110 @@ void VulkanRenderer::start(int windowWidth, int windowHeight, const char* window
 	initVulkan();
 	loop();
 	cleanup();
+
+	PROFILE_WRITE_TRACE("cpu_trace.json");
+}
+
+void VulkanRenderer::startHeadless(int width, int height, uint32_t frameCount, uint32_t warmupFrames, std::string outputPath)
+{
+	isHeadless = true;
+	offscreenExtent.width = static_cast<uint32_t>(width);
+	offscreenExtent.height = static_cast<uint32_t>(height);
+	camera = new Camera(
+		glm::vec3(0.0f, 0.0f, -5.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		45.0f,
+		height / float(width),
+		0.1f
+	);
+	benchmark = new Benchmark(frameCount, warmupFrames);
+	initVulkan();
+	benchmarkLoop();
+	benchmark->report(outputPath);
+	cleanup();
+
+	PROFILE_WRITE_TRACE("cpu_trace.json");
 }
 
 void VulkanRenderer::initVulkan()
 {
+	PROFILE_FUNCTION();
+
 	createInstance();
 	setupDebugMessenger();
-	createSurface();
+	if (!isHeadless) {
+		createSurface();
+	}
 	choosePhysicalDevice();
 	createLogicalDevice();
-	createSwapchain();
+
+	allocator = new MemoryAllocator(device, device.physicalDevice);
+	uniformRing = new UniformRing(device, device.physicalDevice, allocator, FRAMES_IN_FLIGHT);
+	pipelineCache = new PipelineCache(device, device.physicalDevice);
+	pipelineVariants = new PipelineVariants(device, pipelineCache->getCache(), isExtendedDynamicStateSupported);
+
+	if (isHeadless) {
+		createOffscreenImages();
+	}
+	else {
+		createSwapchain();
+	}
 	createSwapchainImageViews();
+	chooseGBufferFormats();
 	createRenderPass();
 	createColorAttachments();
 	createNormAttachments();
-	createPositionAttachments();
 	createDepthResources();
 	createSwapchainFramebuffers();
 	createDescriptorSetLayout();
 	createInputDescriptorSetLayout();
 	createLightDescriptorSetLayout();
+	auto pipelineStartTime = std::chrono::high_resolution_clock::now();
 	createGraphicsPipeline();
 	createSecondPipeline();
+	pipelineCache->logCreateTime(std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - pipelineStartTime).count());
+	std::cout << "Pipelines >> " << pipelineVariants->getVariantCount() << " variants, extended dynamic state " << (pipelineVariants->isExtendedDynamicState() ? "yes" : "no") << std::endl;
 	createCommandPool();
 	createCommandBuffers();
 
-	light = new Light(
+	threadPool = new ThreadPool();
+	createThreadCommandPools();
+
+	textureStreamer = new TextureStreamer(
 		device,
 		device.physicalDevice,
-		glm::vec3(1.0f, 1.0f, -3.0f),
-		glm::vec3(1.0f)
+		allocator,
+		queues.graphicsQueueIndex.value(),
+		queues.graphicsQueue,
+		queues.transferQueueIndex.value_or(queues.graphicsQueueIndex.value()),
+		queues.transferQueueIndex.has_value() ? queues.transferQueue : queues.graphicsQueue
 	);
+	std::cout << "Textures >> streamed through the " << (textureStreamer->isTransferQueueDedicated() ? "transfer" : "graphics") << " queue" << std::endl;
 
-	std::string modelsPath = MODELS_DIR;
-	std::string texturesPath = TEXTURES_DIR;
-
-	createModel(modelsPath + "/head.obj", texturesPath + "/head.tga");
-	createMVPBuffer();
+	createScene();
+	// Every measured frame should sample the same textures
+	if (isHeadless) {
+		textureStreamer->flush();
+	}
+	createLights();
+	if (enableOcclusionCulling) {
+		depthPyramid = new DepthPyramid(device, allocator, pipelineCache->getCache(), depthImageView, swapchainExtent);
+	}
+	if (cullingMode != CULLING_OFF) {
+		indirectCulling = new IndirectCulling(device, allocator, pipelineCache->getCache(), FRAMES_IN_FLIGHT, cullingMode == CULLING_GPU, isDrawCountSupported, isMultiDrawSupported, depthPyramid, enableCullingValidation);
+	}
 	createDescriptorPool();
 	createInputDescriptorPool();
 	createLightDescriptorPool();
-	createDescriptorSet();
+	createDescriptorSets();
 	createInputDescriptorSet();
 	createLightDescriptorSets();
 	createSyncTools();
+
+	gpuProfiler = new GpuProfiler(device, device.physicalDevice, queues.graphicsQueueIndex.value(), FRAMES_IN_FLIGHT);
+	if (!isHeadless) {
+		gpuProfiler->openLog("gpu_profile.csv");
+	}
 }
 
 void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* windowTitle)
@@ -91,7 +164,7 @@ void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* w
 
 	// GLFW was initialy created for OpenGL. So we should say GLFW that we don't want to use API
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(windowWidth, windowHeight, windowTitle, nullptr, nullptr);
 
@@ -103,6 +176,7 @@ void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* w
 
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window, mouseCallback);
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 }
 
 void VulkanRenderer::loop()
@@ -115,7 +189,7 @@ void VulkanRenderer::loop()
 		float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 		startTime = std::chrono::high_resolution_clock::now();
 		processInput(deltaTime);
-		//fpsCounter(deltaTime);
+		fpsCounter(deltaTime);
 		draw();
 	}
 
@@ -124,8 +198,45 @@ void VulkanRenderer::loop()
 	vkDeviceWaitIdle(device);
 }
 
+void VulkanRenderer::benchmarkLoop()
+{
+	/*
+		Same frames as loop(), but the camera follows the benchmark path instead of input.
+		CPU time is the time spent in draw() minus the wait for the frame's fence,
+		frame time is the wall time between the ends of two frames.
+	*/
+	auto previousTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < benchmark->getFrameCount(); i++) {
+		glm::vec3 position;
+		glm::vec3 target;
+		benchmark->getCameraPose(i, position, target);
+		camera->lookAt(position, target);
+
+		auto drawStartTime = std::chrono::high_resolution_clock::now();
+		draw();
+		auto currentTime = std::chrono::high_resolution_clock::now();
+
+		float frameTime = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - previousTime).count();
+		float drawTime = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - drawStartTime).count();
+		benchmark->setCpuTimes(i, frameTime, drawTime - fenceWaitTime);
+		previousTime = currentTime;
+	}
+
+	vkDeviceWaitIdle(device);
+
+	// Timestamps of the last frames in flight
+	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		readFrameTimestamps(i);
+	}
+
+	gpuProfiler->flushAverages();
+	std::cout << "Benchmark >> " << gpuProfiler->getSummary() << std::endl;
+}
+
 void VulkanRenderer::processInput(float deltaTime)
 {
+	PROFILE_FUNCTION();
+
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
@@ -185,6 +296,45 @@ void VulkanRenderer::processInput(float deltaTime)
 	if (glfwGetKey(window, GLFW_KEY_4) == GLFW_RELEASE) {
 		FOUR_IS_PRESSED = false;
 	}
+
+	static bool FIVE_IS_PRESSED = false;
+	if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) {
+		if (FIVE_IS_PRESSED == false) {
+			pushConstant.mode = 4;
+			FIVE_IS_PRESSED = true;
+		}
+	}
+	if (glfwGetKey(window, GLFW_KEY_5) == GLFW_RELEASE) {
+		FIVE_IS_PRESSED = false;
+	}
+
+	// The cursor is captured by the camera, so picking goes through the middle of the view
+	static bool LEFT_BUTTON_IS_PRESSED = false;
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+		if (LEFT_BUTTON_IS_PRESSED == false) {
+			pickInstance(0.0f, 0.0f);
+			LEFT_BUTTON_IS_PRESSED = true;
+		}
+	}
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE) {
+		LEFT_BUTTON_IS_PRESSED = false;
+	}
+}
+
+void VulkanRenderer::pickInstance(float x, float y)
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	camera->getRay(x, y, swapchainExtent.width / (float)swapchainExtent.height, origin, direction);
+
+	uint32_t instanceIndex;
+	float distance;
+	if (scene->raycast(origin, direction, instanceIndex, distance)) {
+		std::cout << "Pick >> instance " << instanceIndex << " of mesh " << scene->getMeshIndex(instanceIndex) << " at " << distance << std::endl;
+	}
+	else {
+		std::cout << "Pick >> nothing" << std::endl;
+	}
 }
 
 void VulkanRenderer::mouseCallback(GLFWwindow* window, double xpos, double ypos)
@@ -210,6 +360,13 @@ void VulkanRenderer::mouseCallback(GLFWwindow* window, double xpos, double ypos)
 	obj->camera->rotateByMouse(xoffset, yoffset);
 }
 
+void VulkanRenderer::framebufferResizeCallback(GLFWwindow* window, int, int)
+{
+	// Not every platform reports a resize as VK_ERROR_OUT_OF_DATE_KHR
+	VulkanRenderer* obj = (VulkanRenderer*)glfwGetWindowUserPointer(window);
+	obj->isFramebufferResized = true;
+}
+
 void VulkanRenderer::fpsCounter(float deltaTime)
 {
 	static float time = 0;
@@ -219,7 +376,8 @@ void VulkanRenderer::fpsCounter(float deltaTime)
 	if (time >= 1.0f) {
 		std::string msPerFrame = std::to_string(1000.0 / nFrames);
 		std::string FPS = std::to_string(nFrames / time);
-		std::string result = windowTitle + " " + msPerFrame + " ms" + " | " + FPS + " FPS";
+		gpuProfiler->flushAverages();
+		std::string result = windowTitle + " " + msPerFrame + " ms" + " | " + FPS + " FPS | " + gpuProfiler->getSummary();
 		glfwSetWindowTitle(window, result.c_str());
 		nFrames = 0;
 		time = 0.0f;
@@ -228,6 +386,8 @@ void VulkanRenderer::fpsCounter(float deltaTime)
 
 void VulkanRenderer::createInstance()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Instance is a connection point between an app and the vulkan library.
 		All states that specify an application are stored in Instance.
@@ -283,6 +443,8 @@ void VulkanRenderer::createInstance()
 
 void VulkanRenderer::setupDebugMessenger()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		By default Vulkan have no debug information. It is optimization decision.
 		But we can on such features by adding validation layers to out instance.
@@ -302,6 +464,8 @@ void VulkanRenderer::setupDebugMessenger()
 
 void VulkanRenderer::createLogicalDevice()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Logical Device is an interface to the Physical Device.
 	
@@ -313,6 +477,9 @@ void VulkanRenderer::createLogicalDevice()
 		queues.graphicsQueueIndex.value(),
 		queues.presentQueueIndex.value(),
 	};
+	if (queues.transferQueueIndex.has_value()) {
+		uniqueQueueIndecis.insert(queues.transferQueueIndex.value());
+	}
 
 	std::vector<VkDeviceQueueCreateInfo> queueInfos;
 
@@ -326,16 +493,79 @@ void VulkanRenderer::createLogicalDevice()
 		queueInfos.push_back(queueInfo);
 	}
 
-	VkPhysicalDeviceFeatures deviceFeature = {};
-	deviceFeature.samplerAnisotropy = VK_TRUE;
+	/*
+		Indirect draws of several meshes need multiDrawIndirect and drawIndirectFirstInstance,
+		GPU culling needs drawIndirectCount to leave the draw count on the GPU. Culling falls back
+		to what the device has: without drawIndirectCount the CPU culls, without firstInstance
+		instances cannot be addressed from indirect commands and culling is off.
+	*/
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+
+	VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+	supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures = {};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	bool isVulkan12 = properties.apiVersion >= VK_API_VERSION_1_2;
+	if (isVulkan12) {
+		supportedFeatures.pNext = &supportedFeatures12;
+		vkGetPhysicalDeviceFeatures2(device.physicalDevice, &supportedFeatures);
+	}
+	else {
+		vkGetPhysicalDeviceFeatures(device.physicalDevice, &supportedFeatures.features);
+	}
+
+	isMultiDrawSupported = supportedFeatures.features.multiDrawIndirect == VK_TRUE;
+	isDrawCountSupported = supportedFeatures12.drawIndirectCount == VK_TRUE;
+	// Extended dynamic state is core in 1.3 and needs no feature there
+	isExtendedDynamicStateSupported = properties.apiVersion >= VK_API_VERSION_1_3;
+
+	if (cullingMode == CULLING_GPU && !isDrawCountSupported) {
+		std::cerr << "WARNING: drawIndirectCount is not supported, culling on the CPU." << std::endl;
+		cullingMode = CULLING_CPU;
+	}
+	if (cullingMode != CULLING_OFF && supportedFeatures.features.drawIndirectFirstInstance != VK_TRUE) {
+		std::cerr << "WARNING: drawIndirectFirstInstance is not supported, culling is off." << std::endl;
+		cullingMode = CULLING_OFF;
+	}
+	if (enableOcclusionCulling && cullingMode != CULLING_GPU) {
+		std::cerr << "WARNING: occlusion culling needs GPU culling, it is off." << std::endl;
+		enableOcclusionCulling = false;
+	}
+	if (enableCullingValidation && (cullingMode != CULLING_GPU || enableOcclusionCulling)) {
+		std::cerr << "WARNING: culling validation needs GPU culling without occlusion culling, it is off." << std::endl;
+		enableCullingValidation = false;
+	}
+	if (supportedFeatures.features.shaderSampledImageArrayDynamicIndexing != VK_TRUE) {
+		throw std::runtime_error("ERROR: Physical Device cannot index texture arrays.");
+	}
+
+	VkPhysicalDeviceVulkan12Features deviceFeature12 = {};
+	deviceFeature12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	deviceFeature12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+
+	VkPhysicalDeviceFeatures2 deviceFeature = {};
+	deviceFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeature.pNext = isVulkan12 ? &deviceFeature12 : nullptr;
+	deviceFeature.features.samplerAnisotropy = VK_TRUE;
+	deviceFeature.features.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+	deviceFeature.features.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+	deviceFeature.features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+	const char* cullingNames[] = { "off", "CPU", "GPU" };
+	std::cout << "Culling >> " << cullingNames[cullingMode] << ", drawIndirectCount " << (isDrawCountSupported ? "yes" : "no") << ", multiDrawIndirect " << (isMultiDrawSupported ? "yes" : "no") << ", occlusion " << (enableOcclusionCulling ? "yes" : "no") << ", validation " << (enableCullingValidation ? "yes" : "no") << std::endl;
 
 	VkDeviceCreateInfo deviceInfo = {};
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
 	deviceInfo.pQueueCreateInfos = queueInfos.data();
-	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
-	deviceInfo.pEnabledFeatures = &deviceFeature;
+	// Headless mode never presents, so it does not need the swapchain extension
+	deviceInfo.enabledExtensionCount = isHeadless ? 0 : static_cast<uint32_t>(deviceExtensions.size());
+	deviceInfo.ppEnabledExtensionNames = isHeadless ? nullptr : deviceExtensions.data();
+	// Features go through pNext, so the 1.2 features can chain after them
+	deviceInfo.pNext = &deviceFeature;
+	deviceInfo.pEnabledFeatures = nullptr;
 
 	result = vkCreateDevice(device.physicalDevice, &deviceInfo, nullptr, &device.logicalDevice);
 	if (result != VK_SUCCESS) {
@@ -344,10 +574,15 @@ void VulkanRenderer::createLogicalDevice()
 
 	vkGetDeviceQueue(device, queues.graphicsQueueIndex.value(), 0, &queues.graphicsQueue);
 	vkGetDeviceQueue(device, queues.presentQueueIndex.value(), 0, &queues.presentQueue);
+	if (queues.transferQueueIndex.has_value()) {
+		vkGetDeviceQueue(device, queues.transferQueueIndex.value(), 0, &queues.transferQueue);
+	}
 }
 
 void VulkanRenderer::createSurface()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		The Surface is an object that represents where we want to represent rendered image.
 
@@ -362,6 +597,8 @@ void VulkanRenderer::createSurface()
 
 void VulkanRenderer::createSwapchain()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Swapchain define how images that we present to surface are handeled.
 		It is like a array of images that are waiting to be presented to the screnn.
@@ -413,13 +650,19 @@ void VulkanRenderer::createSwapchain()
 	swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapchainInfo.presentMode = presentMode;
 	swapchainInfo.clipped = VK_TRUE;
-	swapchainInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Lets the presentation engine hand the old swapchain's resources over, it is retired either way
+	VkSwapchainKHR oldSwapchain = swapchain;
+	swapchainInfo.oldSwapchain = oldSwapchain;
 
 	result = vkCreateSwapchainKHR(device, &swapchainInfo, nullptr, &swapchain);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot create Swapchain.");
 	}
 
+	if (oldSwapchain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+	}
+
 	uint32_t swapchainImageCount;
 	vkGetSwapchainImagesKHR(device, swapchain, &swapchainImageCount, nullptr);
 
@@ -430,246 +673,255 @@ void VulkanRenderer::createSwapchain()
 	swapchainExtent = extent;
 }
 
-void VulkanRenderer::createSwapchainImageViews()
+void VulkanRenderer::recreateSwapchain()
 {
-	/*
-		Image View is an discription of an Image. Image view contain
-		information about Image, such as type (1D, 2D, 3D),
-		format of the Image, aspect (Color or Depth), etc
+	PROFILE_FUNCTION();
 
-		So we have to create Image View for every Swapchain`s Image.
+	/*
+		A minimized window has a framebuffer of size zero, which no swapchain can have,
+		so rendering waits until it is shown again.
 	*/
-	swapchainImageViews.resize(swapchainImages.size());
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while (width == 0 || height == 0) {
+		glfwWaitEvents();
+		glfwGetFramebufferSize(window, &width, &height);
+	}
 
-	for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-		VkImageViewCreateInfo imageViewInfo = {};
-		imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewInfo.image = swapchainImages[i];
-		imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewInfo.format = swapchainImageFormat;
-		imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewInfo.subresourceRange.baseMipLevel = 0;
-		imageViewInfo.subresourceRange.levelCount = 1;
-		imageViewInfo.subresourceRange.baseArrayLayer = 0;
-		imageViewInfo.subresourceRange.layerCount = 1;
+	auto recreateStartTime = std::chrono::high_resolution_clock::now();
 
-		result = vkCreateImageView(device, &imageViewInfo, nullptr, &swapchainImageViews[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Swapchain Image Views.");
-		}
-	}
-}
+	// The shared G-buffer and every framebuffer may still be in use by the frames in flight
+	vkDeviceWaitIdle(device);
 
-void VulkanRenderer::createColorAttachments()
-{
-	colorImages.resize(swapchainImages.size());
-	colorImageViews.resize(swapchainImages.size());
-	colorImageMemories.resize(swapchainImages.size());
+	destroySwapchainResources();
 
-	for (size_t i = 0; i < colorImages.size(); i++) {
-		VkImageCreateInfo imageInfo = {};
-		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.format = swapchainImageFormat;
-		imageInfo.extent.height = swapchainExtent.height;
-		imageInfo.extent.width = swapchainExtent.width;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = 1;
-		imageInfo.samples = MSSA_SAMPLES;
-		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
-		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	/*
+		The surface format comes from the same surface, so the render passes and the pipelines
+		made for them stay valid. The lighting push constants and the light grid follow
+		swapchainExtent every frame.
+	*/
+	createSwapchain();
+	createSwapchainImageViews();
+	createColorAttachments();
+	createNormAttachments();
+	createDepthResources();
+	createSwapchainFramebuffers();
 
-		result = vkCreateImage(device, &imageInfo, nullptr, &colorImages[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Color Image.");
-		}
+	vkResetDescriptorPool(device, inputDescriptorPool, 0);
+	createInputDescriptorSet();
 
-		VkMemoryRequirements memRequirements = {};
-		vkGetImageMemoryRequirements(device, colorImages[i], &memRequirements);
+	if (depthPyramid != nullptr) {
+		depthPyramid->resize(depthImageView, swapchainExtent);
+	}
 
-		VkMemoryAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = memRequirements.size;
-		allocateInfo.memoryTypeIndex = findMemoryType(
-			device.physicalDevice,
-			memRequirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		);
+	isFramebufferResized = false;
 
-		result = vkAllocateMemory(device, &allocateInfo, nullptr, &colorImageMemories[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot allocate Color Image Memory.");
-		}
+	float recreateTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recreateStartTime).count();
+	std::cout << "Swapchain >> " << swapchainExtent.width << "x" << swapchainExtent.height << " in " << recreateTime << " ms" << std::endl;
+}
 
-		vkBindImageMemory(device, colorImages[i], colorImageMemories[i], 0);
+void VulkanRenderer::destroySwapchainResources()
+{
+	for (const auto& framebuffer : swapchainFramebuffer) {
+		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	}
 
-		VkImageViewCreateInfo imageViewInfo = {};
-		imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewInfo.image = colorImages[i];
-		imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewInfo.format = swapchainImageFormat;
-		imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-		imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-		imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-		imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
-		imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewInfo.subresourceRange.layerCount = 1;
-		imageViewInfo.subresourceRange.baseArrayLayer = 0;
-		imageViewInfo.subresourceRange.levelCount = 1;
-		imageViewInfo.subresourceRange.baseMipLevel = 0;
+	vkDestroyImageView(device, depthImageView, nullptr);
+	allocator->free(depthImageAllocation);
+	vkDestroyImage(device, depthImage, nullptr);
 
-		result = vkCreateImageView(device, &imageViewInfo, nullptr, &colorImageViews[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Color Image View.");
-		}
+	vkDestroyImageView(device, normImageView, nullptr);
+	allocator->free(normImageAllocation);
+	vkDestroyImage(device, normImage, nullptr);
+
+	vkDestroyImageView(device, colorImageView, nullptr);
+	allocator->free(colorImageAllocation);
+	vkDestroyImage(device, colorImage, nullptr);
+
+	for (const auto& imageView : swapchainImageViews) {
+		vkDestroyImageView(device, imageView, nullptr);
 	}
 }
 
-void VulkanRenderer::createNormAttachments()
+void VulkanRenderer::createOffscreenImages()
 {
-	normImages.resize(swapchainImages.size());
-	normImageViews.resize(swapchainImages.size());
-	normImageMemories.resize(swapchainImages.size());
+	PROFILE_FUNCTION();
 
-	for (size_t i = 0; i < normImages.size(); i++) {
+	/*
+		Without a surface there is no swapchain, so headless mode renders to images of its own.
+		Every frame in flight gets one, in the format the swapchain would most likely have.
+	*/
+	swapchainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+	swapchainExtent = offscreenExtent;
+
+	swapchainImages.resize(FRAMES_IN_FLIGHT);
+	offscreenImageAllocations.resize(FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < swapchainImages.size(); i++) {
 		VkImageCreateInfo imageInfo = {};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		imageInfo.extent.width = swapchainExtent.width;
+		imageInfo.format = swapchainImageFormat;
 		imageInfo.extent.height = swapchainExtent.height;
+		imageInfo.extent.width = swapchainExtent.width;
 		imageInfo.extent.depth = 1;
 		imageInfo.mipLevels = 1;
 		imageInfo.arrayLayers = 1;
 		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-		result = vkCreateImage(device, &imageInfo, nullptr, &normImages[i]);
+		result = vkCreateImage(device, &imageInfo, nullptr, &swapchainImages[i]);
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Norm Image.");
+			throw std::runtime_error("ERROR: cannot create Offscreen Image.");
 		}
 
-		VkMemoryRequirements memRequirements = {};
-		vkGetImageMemoryRequirements(device, normImages[i], &memRequirements);
+		offscreenImageAllocations[i] = allocator->allocateImage(swapchainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+}
 
-		VkMemoryAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = memRequirements.size;
-		allocateInfo.memoryTypeIndex = findMemoryType(
-			device.physicalDevice,
-			memRequirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		);
+void VulkanRenderer::createSwapchainImageViews()
+{
+	PROFILE_FUNCTION();
 
-		result = vkAllocateMemory(device, &allocateInfo, nullptr, &normImageMemories[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot allocate Norm Image Memory.");
-		}
+	/*
+		Image View is an discription of an Image. Image view contain
+		information about Image, such as type (1D, 2D, 3D),
+		format of the Image, aspect (Color or Depth), etc
 
-		vkBindImageMemory(device, normImages[i], normImageMemories[i], 0);
+		So we have to create Image View for every Swapchain`s Image.
+	*/
+	swapchainImageViews.resize(swapchainImages.size());
 
+	for (size_t i = 0; i < swapchainImageViews.size(); i++) {
 		VkImageViewCreateInfo imageViewInfo = {};
 		imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewInfo.image = normImages[i];
+		imageViewInfo.image = swapchainImages[i];
 		imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-		imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-		imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-		imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+		imageViewInfo.format = swapchainImageFormat;
+		imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 		imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewInfo.subresourceRange.levelCount = 1;
 		imageViewInfo.subresourceRange.baseMipLevel = 0;
-		imageViewInfo.subresourceRange.layerCount = 1;
+		imageViewInfo.subresourceRange.levelCount = 1;
 		imageViewInfo.subresourceRange.baseArrayLayer = 0;
+		imageViewInfo.subresourceRange.layerCount = 1;
 
-		result = vkCreateImageView(device, &imageViewInfo, nullptr, &normImageViews[i]);
+		result = vkCreateImageView(device, &imageViewInfo, nullptr, &swapchainImageViews[i]);
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Norm Image View.");
+			throw std::runtime_error("ERROR: cannot create Swapchain Image Views.");
 		}
 	}
 }
 
-void VulkanRenderer::createPositionAttachments()
+void VulkanRenderer::createColorAttachments()
 {
-	positionImages.resize(swapchainImages.size());
-	positionImageViews.resize(swapchainImages.size());
-	positionImageMemories.resize(swapchainImages.size());
+	PROFILE_FUNCTION();
 
-	for (size_t i = 0; i < positionImages.size(); i++) {
-		VkImageCreateInfo imageInfo = {};
-		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageInfo.imageType = VK_IMAGE_TYPE_2D;
-		imageInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		imageInfo.extent.width = swapchainExtent.width;
-		imageInfo.extent.height = swapchainExtent.height;
-		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1;
-		imageInfo.arrayLayers = 1;
-		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
-		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	/*
+		The G-buffer is only read by the lighting subpass of the pass that wrote it, so every frame and
+		swapchain image shares one. Unless occlusion culling stores it between its two passes it never
+		leaves tile memory on tilers and can be transient.
+	*/
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = albedoFormat;
+	imageInfo.extent.height = swapchainExtent.height;
+	imageInfo.extent.width = swapchainExtent.width;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = MSSA_SAMPLES;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | (enableOcclusionCulling ? 0 : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-		result = vkCreateImage(device, &imageInfo, nullptr, &positionImages[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Position Image.");
-		}
+	result = vkCreateImage(device, &imageInfo, nullptr, &colorImage);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Color Image.");
+	}
 
-		VkMemoryRequirements memRequirements = {};
-		vkGetImageMemoryRequirements(device, positionImages[i], &memRequirements);
+	colorImageAllocation = allocateAttachment(colorImage, !enableOcclusionCulling);
 
-		VkMemoryAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocateInfo.allocationSize = memRequirements.size;
-		allocateInfo.memoryTypeIndex = findMemoryType(
-			device.physicalDevice,
-			memRequirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		);
+	VkImageViewCreateInfo imageViewInfo = {};
+	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewInfo.image = colorImage;
+	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewInfo.format = albedoFormat;
+	imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+	imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+	imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+	imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+	imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewInfo.subresourceRange.layerCount = 1;
+	imageViewInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewInfo.subresourceRange.levelCount = 1;
+	imageViewInfo.subresourceRange.baseMipLevel = 0;
 
-		result = vkAllocateMemory(device, &allocateInfo, nullptr, &positionImageMemories[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot allocate Position Image Memory.");
-		}
+	result = vkCreateImageView(device, &imageViewInfo, nullptr, &colorImageView);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Color Image View.");
+	}
+}
 
-		vkBindImageMemory(device, positionImages[i], positionImageMemories[i], 0);
+void VulkanRenderer::createNormAttachments()
+{
+	PROFILE_FUNCTION();
 
-		VkImageViewCreateInfo imageViewInfo = {};
-		imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewInfo.image = positionImages[i];
-		imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-		imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-		imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-		imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-		imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
-		imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		imageViewInfo.subresourceRange.levelCount = 1;
-		imageViewInfo.subresourceRange.baseMipLevel = 0;
-		imageViewInfo.subresourceRange.layerCount = 1;
-		imageViewInfo.subresourceRange.baseArrayLayer = 0;
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = normFormat;
+	imageInfo.extent.width = swapchainExtent.width;
+	imageInfo.extent.height = swapchainExtent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | (enableOcclusionCulling ? 0 : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-		result = vkCreateImageView(device, &imageViewInfo, nullptr, &positionImageViews[i]);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("ERROR: cannot create Position Image View.");
-		}
+	result = vkCreateImage(device, &imageInfo, nullptr, &normImage);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Norm Image.");
+	}
+
+	normImageAllocation = allocateAttachment(normImage, !enableOcclusionCulling);
+
+	VkImageViewCreateInfo imageViewInfo = {};
+	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewInfo.image = normImage;
+	imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewInfo.format = normFormat;
+	imageViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+	imageViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+	imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+	imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+	imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewInfo.subresourceRange.levelCount = 1;
+	imageViewInfo.subresourceRange.baseMipLevel = 0;
+	imageViewInfo.subresourceRange.layerCount = 1;
+	imageViewInfo.subresourceRange.baseArrayLayer = 0;
+
+	result = vkCreateImageView(device, &imageViewInfo, nullptr, &normImageView);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Norm Image View.");
 	}
 }
 
 void VulkanRenderer::createDepthResources()
 {
+	PROFILE_FUNCTION();
+
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -681,7 +933,9 @@ void VulkanRenderer::createDepthResources()
 	imageInfo.arrayLayers = 1;
 	imageInfo.samples = MSSA_SAMPLES;
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	// The lighting subpass reconstructs positions from depth, the depth pyramid is reduced from it
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT
+		| (enableOcclusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
@@ -690,24 +944,7 @@ void VulkanRenderer::createDepthResources()
 		throw std::runtime_error("ERROR: cannot create Depth Image.");
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(device, depthImage, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		device.physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &depthImageMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Depth Image Memory.");
-	}
-
-	vkBindImageMemory(device, depthImage, depthImageMemory, 0);
+	depthImageAllocation = allocateAttachment(depthImage, !enableOcclusionCulling);
 
 	VkImageViewCreateInfo imageViewInfo = {};
 	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -730,7 +967,72 @@ void VulkanRenderer::createDepthResources()
 	}
 }
 
+MemoryAllocator::Allocation VulkanRenderer::allocateAttachment(VkImage image, bool isTransient)
+{
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	// Tilers back lazily allocated memory only if the attachment has to leave tile memory, which a transient one never does
+	if (isTransient) {
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(device, image, &memRequirements);
+		if (allocator->hasMemoryType(memRequirements.memoryTypeBits, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+	}
+
+	return allocator->allocateImage(image, properties);
+}
+
+void VulkanRenderer::chooseGBufferFormats()
+{
+	PROFILE_FUNCTION();
+
+	// Albedo no longer follows the swapchain, 8 bit sRGB keeps the precision where dark colors need it
+	albedoFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+	switch (gbufferLayout) {
+	case GBUFFER_LAYOUT_FLOAT:
+		normFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+		break;
+	case GBUFFER_LAYOUT_OCTAHEDRAL: {
+		// Rendering to snorm formats is optional, half floats hold the same encoding
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(device.physicalDevice, VK_FORMAT_R16G16_SNORM, &formatProperties);
+		bool isSnormRenderable = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) != 0;
+		normFormat = isSnormRenderable ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R16G16_SFLOAT;
+		break;
+	}
+	case GBUFFER_LAYOUT_PACKED:
+		normFormat = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+		break;
+	}
+
+	// Every format here is uncompressed with a single plane
+	auto getFormatSize = [](VkFormat format) -> uint32_t {
+		switch (format) {
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return 4;
+		}
+	};
+
+	uint32_t bytesPerPixel = getFormatSize(albedoFormat) + getFormatSize(normFormat) + getFormatSize(VK_FORMAT_D32_SFLOAT);
+	const char* layoutNames[] = { "float", "octahedral", "packed" };
+	std::cout << "G-buffer >> " << layoutNames[gbufferLayout] << " normals, " << bytesPerPixel << " bytes per pixel" << std::endl;
+}
+
 void VulkanRenderer::createRenderPass()
+{
+	PROFILE_FUNCTION();
+
+	renderPass = createScenePass(false);
+	if (enableOcclusionCulling) {
+		earlyRenderPass = createScenePass(true);
+	}
+}
+
+VkRenderPass VulkanRenderer::createScenePass(bool isEarlyPass)
 {
 	/*
 		Render Pass is where rendering commands are executed.
@@ -741,56 +1043,59 @@ void VulkanRenderer::createRenderPass()
 		Render Pass can have multiple subpasses. 
 		Subpass is an way to get access to the result of previous rendering.
 		The limitation is that subpass can only access one pixel per time.
+
+		With occlusion culling the early pass renders the G-buffer of the early draws and stores it,
+		its lighting subpass stays empty. The other pass loads that G-buffer, adds the late draws and
+		lights it. Both have the same attachments, subpasses and dependencies, so the framebuffers and
+		pipelines made for one work with the other.
 	*/
+	bool isLoaded = enableOcclusionCulling && !isEarlyPass;
+	VkAttachmentLoadOp gbufferLoadOp = isLoaded ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	VkAttachmentStoreOp gbufferStoreOp = isEarlyPass ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_NONE;
+	VkImageLayout gbufferInitialLayout = isLoaded ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
 	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = swapchainImageFormat;
+	colorAttachment.format = albedoFormat;
 	colorAttachment.samples = MSSA_SAMPLES;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+	colorAttachment.loadOp = gbufferLoadOp;
+	colorAttachment.storeOp = gbufferStoreOp;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.initialLayout = gbufferInitialLayout;
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription normAttachment = {};
-	normAttachment.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	normAttachment.format = normFormat;
 	normAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	normAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	normAttachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+	normAttachment.loadOp = gbufferLoadOp;
+	normAttachment.storeOp = gbufferStoreOp;
 	normAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	normAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	normAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	normAttachment.initialLayout = gbufferInitialLayout;
 	normAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	VkAttachmentDescription positionAttachment = {};
-	positionAttachment.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	positionAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	positionAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	positionAttachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
-	positionAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	positionAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	positionAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	positionAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = VK_FORMAT_D32_SFLOAT;
 	depthAttachment.samples = MSSA_SAMPLES;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.loadOp = isLoaded ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = isEarlyPass ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	// The early depth is read by the depth pyramid's compute pass
+	depthAttachment.initialLayout = isLoaded ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = isEarlyPass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription swapchainAttachment = {};
 	swapchainAttachment.format = swapchainImageFormat;
 	swapchainAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	swapchainAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	swapchainAttachment.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
+	// Nothing is lit in the early pass
+	swapchainAttachment.storeOp = isEarlyPass ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_NONE;
 	swapchainAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	swapchainAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	swapchainAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	swapchainAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Offscreen images are never presented, leave them ready to be copied from
+	swapchainAttachment.finalLayout = isHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorReference = {};
 	colorReference.attachment = 0;
@@ -800,22 +1105,17 @@ void VulkanRenderer::createRenderPass()
 	normReference.attachment = 1;
 	normReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	VkAttachmentReference positionReference = {};
-	positionReference.attachment = 2;
-	positionReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
 	VkAttachmentReference depthReference = {};
-	depthReference.attachment = 3;
+	depthReference.attachment = 2;
 	depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorResolveReference = {};
-	colorResolveReference.attachment = 4;
+	colorResolveReference.attachment = 3;
 	colorResolveReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	std::array<VkAttachmentReference, 3> colorAttachments = {
+	std::array<VkAttachmentReference, 2> colorAttachments = {
 		colorReference,
-		normReference,
-		positionReference
+		normReference
 	};
 
 	std::array<VkSubpassDescription, 2> subpasses = {};
@@ -833,14 +1133,15 @@ void VulkanRenderer::createRenderPass()
 	normInputReference.attachment = 1;
 	normInputReference.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	VkAttachmentReference positionInputReference = {};
-	positionInputReference.attachment = 2;
-	positionInputReference.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	// Positions are reconstructed from depth
+	VkAttachmentReference depthInputReference = {};
+	depthInputReference.attachment = 2;
+	depthInputReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 	std::array<VkAttachmentReference, 3> inputAttachments = {
 		colorInputReference,
 		normInputReference,
-		positionInputReference
+		depthInputReference
 	};
 
 	subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -849,33 +1150,49 @@ void VulkanRenderer::createRenderPass()
 	subpasses[1].inputAttachmentCount = static_cast<uint32_t>(inputAttachments.size());
 	subpasses[1].pInputAttachments = inputAttachments.data();
 
-	std::array<VkSubpassDependency, 3> subpassDependencies = {};
+	// Every frame shares the G-buffer, its writes come after the previous frame's writes and lighting input reads of it
+	std::vector<VkSubpassDependency> subpassDependencies(enableOcclusionCulling ? 4 : 3);
 	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	subpassDependencies[0].dstSubpass = 0;
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[0].srcAccessMask = 0;
+	subpassDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
 	subpassDependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
 	subpassDependencies[1].dstSubpass = 0;
-	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	subpassDependencies[1].srcAccessMask = 0;
+	subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpassDependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	subpassDependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 	subpassDependencies[2].srcSubpass = 0;
 	subpassDependencies[2].dstSubpass = 1;
-	subpassDependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	subpassDependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 	subpassDependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	subpassDependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	subpassDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	subpassDependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+
+	if (enableOcclusionCulling) {
+		// The late draws load the early G-buffer
+		subpassDependencies[0].dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 
+		// The late draws load the early depth after the depth pyramid read it
+		subpassDependencies[1].srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		subpassDependencies[1].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+		// The depth pyramid is built from the early depth, the lighting subpass is its last user and the depth writes reached it through the dependency above
+		subpassDependencies[3].srcSubpass = 1;
+		subpassDependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[3].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		subpassDependencies[3].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		subpassDependencies[3].srcAccessMask = 0;
+		subpassDependencies[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
 
-	std::array<VkAttachmentDescription, 5> attachments = {
+	std::array<VkAttachmentDescription, 4> attachments = {
 		colorAttachment,
 		normAttachment,
-		positionAttachment,
 		depthAttachment,
 		swapchainAttachment
 	};
@@ -889,24 +1206,28 @@ void VulkanRenderer::createRenderPass()
 	renderPassInfo.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
 	renderPassInfo.pDependencies = subpassDependencies.data();
 
-	result = vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass);
+	VkRenderPass scenePass;
+	result = vkCreateRenderPass(device, &renderPassInfo, nullptr, &scenePass);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot create Render Pass.");
 	}
+
+	return scenePass;
 }
 
 void VulkanRenderer::createSwapchainFramebuffers()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Framebuffer represent memory of attachment used in Render Pass.
 	*/
 	swapchainFramebuffer.resize(swapchainImageViews.size());
 
 	for (size_t i = 0; i < swapchainFramebuffer.size(); i++) {
-		std::array<VkImageView, 5> attachments = {
-			colorImageViews[i],
-			normImageViews[i],
-			positionImageViews[i],
+		std::array<VkImageView, 4> attachments = {
+			colorImageView,
+			normImageView,
 			depthImageView,
 			swapchainImageViews[i]
 		};
@@ -929,112 +1250,14 @@ void VulkanRenderer::createSwapchainFramebuffers()
 
 void VulkanRenderer::createGraphicsPipeline()
 {
-	/*
-		Graphics Pipeline is an list of stages required to render image.
-
-		There we describe different stages like shaders, restarization, depth, etc.
-	*/
+	PROFILE_FUNCTION();
 
-	// SHADERS
-	Shader vertShader(device, "shaders/phong_vert.spv");
-	Shader fragShader(device, "shaders/phong_frag.spv");
-
-	VkPipelineShaderStageCreateInfo vertStageInfo = {};
-	vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertStageInfo.module = vertShader.getShaderModule();
-	vertStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragStageInfo = {};
-	fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragStageInfo.module = fragShader.getShaderModule();
-	fragStageInfo.pName = "main";
-
-	std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
-		vertStageInfo,
-		fragStageInfo,
-	};
+	/*
+		Graphics Pipeline is an list of stages required to render image.
 
-	// VERTEX INPUT STATE
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	// INPUT ASSEMBLY STATE
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-	// VIEWPORT STATE
-	VkViewport viewport = {};
-	viewport.x = 0;
-	viewport.y = 0;
-	viewport.width = static_cast<float>(swapchainExtent.width);
-	viewport.height = static_cast<float>(swapchainExtent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.extent = swapchainExtent;
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-
-	VkPipelineViewportStateCreateInfo viewportInfo = {};
-	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportInfo.viewportCount = 1;
-	viewportInfo.pViewports = &viewport;
-	viewportInfo.scissorCount = 1;
-	viewportInfo.pScissors = &scissor;
-
-	// RASTERIZATION STATE
-	VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
-	rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationInfo.depthClampEnable = VK_FALSE;
-	rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizationInfo.depthBiasEnable = VK_FALSE;
-	rasterizationInfo.lineWidth = 1.0f;
-
-	// MULTISAMPLE STATE
-	VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
-	multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleInfo.sampleShadingEnable = VK_FALSE;
-	multisampleInfo.rasterizationSamples = MSSA_SAMPLES;
-
-	// DEPTH STENCIL STATE
-	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
-	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_TRUE;
-	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
-	depthStencilInfo.stencilTestEnable = VK_FALSE;
-
-	// COLOR BLEND STATE
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-		| VK_COLOR_COMPONENT_G_BIT
-		| VK_COLOR_COMPONENT_B_BIT
-		| VK_COLOR_COMPONENT_A_BIT;
-
-	std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(3, colorBlendAttachment);
-
-	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
-	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendInfo.logicOpEnable = VK_FALSE;
-	colorBlendInfo.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
-	colorBlendInfo.pAttachments = blendAttachmentStates.data();
+		There we describe different stages like shaders, restarization, depth, etc.
+		The pipeline itself comes from pipelineVariants, which only builds it for state it has not seen.
+	*/
 
 	// PIPELINE LAYOUT
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
@@ -1049,102 +1272,41 @@ void VulkanRenderer::createGraphicsPipeline()
 		throw std::runtime_error("ERROR: cannot create Pipeline Layout.");
 	}
 
-	// GRAPHICS PIPELINE
-	VkGraphicsPipelineCreateInfo graphicsPipelineInfo = {};
-	graphicsPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	graphicsPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-	graphicsPipelineInfo.pStages = shaderStages.data();
-	graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
-	graphicsPipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-	graphicsPipelineInfo.pTessellationState = nullptr;
-	graphicsPipelineInfo.pViewportState = &viewportInfo;
-	graphicsPipelineInfo.pRasterizationState = &rasterizationInfo;
-	graphicsPipelineInfo.pMultisampleState = &multisampleInfo;
-	graphicsPipelineInfo.pDepthStencilState = &depthStencilInfo;
-	graphicsPipelineInfo.pColorBlendState = &colorBlendInfo;
-	graphicsPipelineInfo.pDynamicState = nullptr;
-	graphicsPipelineInfo.layout = pipelineLayout;
-	graphicsPipelineInfo.subpass = 0;
-	graphicsPipelineInfo.renderPass = renderPass;
-	graphicsPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	graphicsPipelineInfo.basePipelineIndex = -1;
-
-	result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, nullptr, &graphicsPipeline);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Graphics Pipeline.");
-	}
+	// SHADERS
+	const char* fragShaderPaths[] = { "shaders/phong_frag.spv", "shaders/phong_octahedral_frag.spv", "shaders/phong_packed_gbuffer_frag.spv" };
+	gbufferDescription.vertShaderPath = vertexFormat == VERTEX_FORMAT_FLOAT ? "shaders/phong_vert.spv" : "shaders/phong_packed_vert.spv";
+	gbufferDescription.fragShaderPath = fragShaderPaths[gbufferLayout];
+
+	// VERTEX INPUT STATE
+	// Binding 0 is the mesh's vertices, binding 1 the instance transforms
+	gbufferDescription.bindingDescriptions = {
+		Model::getBindingDescription(vertexFormat),
+		InstanceData::getBindingDescription()
+	};
+	auto attributeDescriptions = Model::getAttributeDescriptions(vertexFormat);
+	auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+	attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+	gbufferDescription.attributeDescriptions = attributeDescriptions;
+
+	// Albedo and norm, the early pass is compatible with renderPass and uses the same pipeline
+	gbufferDescription.layout = pipelineLayout;
+	gbufferDescription.renderPass = renderPass;
+	gbufferDescription.subpass = 0;
+	gbufferDescription.colorAttachmentCount = 2;
+	gbufferDescription.samples = MSSA_SAMPLES;
+	gbufferDescription.hasDepth = true;
+
+	gbufferDescription.cullMode = VK_CULL_MODE_BACK_BIT;
+	gbufferDescription.depthTestEnable = true;
+	gbufferDescription.depthWriteEnable = true;
+	gbufferDescription.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	graphicsPipeline = pipelineVariants->get(gbufferDescription);
 }
 
 void VulkanRenderer::createSecondPipeline()
 {
-	Shader vertShader(device, "shaders/second_vert.spv");
-	Shader fragShader(device, "shaders/second_frag.spv");
-
-	VkPipelineShaderStageCreateInfo vertStageInfo = {};
-	vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertStageInfo.module = vertShader.getShaderModule();
-	vertStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragStageInfo = {};
-	fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragStageInfo.module = fragShader.getShaderModule();
-	fragStageInfo.pName = "main";
-
-	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = { vertStageInfo, fragStageInfo };
-
-	VkPipelineVertexInputStateCreateInfo vertexInputStateInfo = {};
-	vertexInputStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputStateInfo.vertexBindingDescriptionCount = 0;
-	vertexInputStateInfo.vertexAttributeDescriptionCount = 0;
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport viewport = {};
-	viewport.width = static_cast<float>(swapchainExtent.width);
-	viewport.height = static_cast<float>(swapchainExtent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 0.0f;
-	viewport.x = 0;
-	viewport.y = 0;
-
-	VkRect2D scissor = {};
-	scissor.extent = swapchainExtent;
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-
-	VkPipelineViewportStateCreateInfo viewportStateInfo = {};
-	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateInfo.viewportCount = 1;
-	viewportStateInfo.pViewports = &viewport;
-	viewportStateInfo.scissorCount = 1;
-	viewportStateInfo.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizationStateInfo = {};
-	rasterizationStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationStateInfo.depthClampEnable = VK_FALSE;
-	rasterizationStateInfo.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationStateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationStateInfo.cullMode = VK_CULL_MODE_NONE;
-	rasterizationStateInfo.depthBiasEnable = VK_FALSE;
-	rasterizationStateInfo.lineWidth = 1.0f;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-		| VK_COLOR_COMPONENT_G_BIT
-		| VK_COLOR_COMPONENT_B_BIT
-		| VK_COLOR_COMPONENT_A_BIT;
-
-	VkPipelineColorBlendStateCreateInfo blendStateInfo = {};
-	blendStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	blendStateInfo.logicOpEnable = VK_FALSE;
-	blendStateInfo.attachmentCount = 1;
-	blendStateInfo.pAttachments = &colorBlendAttachment;
+	PROFILE_FUNCTION();
 
 	std::array<VkDescriptorSetLayout, 2> setLayouts = {
 		inputDescriptorSetLayout,
@@ -1168,31 +1330,25 @@ void VulkanRenderer::createSecondPipeline()
 		throw std::runtime_error("ERROR: cannot create Second Pipeline Layout.");
 	}
 
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-	pipelineInfo.pStages = shaderStages.data();
-	pipelineInfo.pVertexInputState = &vertexInputStateInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-	pipelineInfo.pTessellationState = nullptr;
-	pipelineInfo.pViewportState = &viewportStateInfo;
-	pipelineInfo.pRasterizationState = &rasterizationStateInfo;
-	pipelineInfo.pMultisampleState = nullptr;
-	pipelineInfo.pDepthStencilState = nullptr;
-	pipelineInfo.pColorBlendState = &blendStateInfo;
-	pipelineInfo.pDynamicState = nullptr;
-	pipelineInfo.layout = secondPipelineLayout;
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 1;
-
-	result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &secondPipeline);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Second Pipeline.");
-	}
+	// A full screen triangle made in the vertex shader, it has no vertex input and no depth attachment
+	const char* fragShaderPaths[] = { "shaders/second_frag.spv", "shaders/second_octahedral_frag.spv", "shaders/second_packed_gbuffer_frag.spv" };
+	lightingDescription.vertShaderPath = "shaders/second_vert.spv";
+	lightingDescription.fragShaderPath = fragShaderPaths[gbufferLayout];
+	lightingDescription.layout = secondPipelineLayout;
+	lightingDescription.renderPass = renderPass;
+	lightingDescription.subpass = 1;
+	lightingDescription.colorAttachmentCount = 1;
+	lightingDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+	lightingDescription.hasDepth = false;
+	lightingDescription.cullMode = VK_CULL_MODE_NONE;
+
+	secondPipeline = pipelineVariants->get(lightingDescription);
 }
 
 void VulkanRenderer::createCommandPool()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Command Buffer's memory allocated from Command Pool.
 	*/
@@ -1209,6 +1365,8 @@ void VulkanRenderer::createCommandPool()
 
 void VulkanRenderer::createCommandBuffers()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Command Buffer are object where command are recorded.
 
@@ -1231,6 +1389,8 @@ void VulkanRenderer::createCommandBuffers()
 
 void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+	PROFILE_FUNCTION();
+
 	/*
 		There command are recorded to Command Buffer. Such as begining of render pass
 		(required if we want render something), pipeline binding, draw commands, etc.
@@ -1245,6 +1405,21 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 		throw std::runtime_error("ERROR: cannot begin Command Buffer recording.");
 	}
 
+	gpuProfiler->beginFrame(commandBuffer, currentFrame, frameNumber);
+
+	glm::mat4 viewProjection = mvp.projection * mvp.view * mvp.model;
+	Frustum frustum(viewProjection);
+
+	if (indirectCulling != nullptr) {
+		// Compute culling has to be recorded outside of the render pass
+		gpuProfiler->beginScope(commandBuffer, "Culling");
+		indirectCulling->cull(commandBuffer, currentFrame, scene, frustum);
+		gpuProfiler->endScope(commandBuffer);
+	}
+	else {
+		recordSceneCommandBuffers(imageIndex);
+	}
+
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassBeginInfo.renderPass = renderPass;
@@ -1259,19 +1434,15 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	VkClearValue normClear = {};
 	normClear.color = { 0.0f, 0.0f, 0.0f, 1.0f };
 
-	VkClearValue positionClear = {};
-	positionClear.color = { 0.0f, 0.0f, 0.0f, 1.0f };
-
 	VkClearValue depthClear = {};
 	depthClear.depthStencil = { 1.0, 0 };
 
 	VkClearValue swapchainClear = {};
 	swapchainClear.color = { 0.0f, 1.0f, 0.0f, 1.0f };
 
-	std::array<VkClearValue, 5> clearValues = {
+	std::array<VkClearValue, 4> clearValues = {
 		colorClear,
 		normClear,
-		positionClear,
 		depthClear,
 		swapchainClear
 	};
@@ -1279,55 +1450,236 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassBeginInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	if (depthPyramid != nullptr) {
+		/*
+			The early pass draws what was visible before and leaves its depth for the depth pyramid.
+			The late culling tests every instance against the pyramid and the main pass adds the
+			instances that turned visible to the early G-buffer before lighting it.
+		*/
+		VkRenderPassBeginInfo earlyPassBeginInfo = renderPassBeginInfo;
+		earlyPassBeginInfo.renderPass = earlyRenderPass;
+
+		gpuProfiler->beginScope(commandBuffer, "Early G-buffer");
+		vkCmdBeginRenderPass(commandBuffer, &earlyPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordIndirectDraws(commandBuffer);
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdEndRenderPass(commandBuffer);
+		gpuProfiler->endScope(commandBuffer);
 
-		VkBuffer vertexBuffers[] = {model->getVertexBuffer()};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		gpuProfiler->beginScope(commandBuffer, "Depth pyramid");
+		depthPyramid->build(commandBuffer);
+		gpuProfiler->endScope(commandBuffer);
 
-		VkBuffer indexBuffer = model->getIndexBuffer();
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		gpuProfiler->beginScope(commandBuffer, "Late culling");
+		indirectCulling->cullLate(commandBuffer, currentFrame, scene, frustum, viewProjection);
+		gpuProfiler->endScope(commandBuffer);
+	}
 
-		vkCmdBindDescriptorSets(
-			commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0,
-			1,
-			&descriptorSet,
-			0,
-			nullptr
-		);
+	// Only vkCmdExecuteCommands is allowed in a subpass recorded in Secondary Command Buffers, so the G-buffer scope encloses the render pass begin
+	gpuProfiler->beginScope(commandBuffer, "G-buffer");
 
-		uint32_t indexCount = model->getIndexCount();
-		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+	if (indirectCulling != nullptr) {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordIndirectDraws(commandBuffer, depthPyramid != nullptr);
+	}
+	else {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(sceneCommandBuffers.size()), sceneCommandBuffers.data());
+	}
 
 		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
+		gpuProfiler->endScope(commandBuffer);
+		gpuProfiler->beginScope(commandBuffer, "Lighting");
+
+		// The secondary command buffers leave the primary's dynamic state undefined
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipeline);
+		pipelineVariants->setDynamicState(commandBuffer, lightingDescription, swapchainExtent);
 
 		std::array<VkDescriptorSet, 2> descriptorSets = {
-			inputDescriptorSets[imageIndex],
-			lightDescriptorSets[imageIndex]
+			inputDescriptorSet,
+			lightDescriptorSets[currentFrame]
 		};
 		vkCmdBindDescriptorSets(
 			commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipelineLayout,
-			0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr
+			0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 1, &uniformOffsets.light
 		);
 		vkCmdPushConstants(commandBuffer, secondPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &pushConstant);
 		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+		gpuProfiler->endScope(commandBuffer);
 	vkCmdEndRenderPass(commandBuffer);
 
+	gpuProfiler->endFrame(commandBuffer);
+
 	result = vkEndCommandBuffer(commandBuffer);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot end Command Buffer recording.");
 	}
 }
 
+void VulkanRenderer::createThreadCommandPools()
+{
+	PROFILE_FUNCTION();
+
+	/*
+		Command Pools are not thread safe, so every thread records from a pool of its own.
+		Pools are also per frame in flight, so a whole pool can be reset once the frame's fence signaled.
+	*/
+	threadCommands.resize(FRAMES_IN_FLIGHT);
+
+	for (auto& frameCommands : threadCommands) {
+		frameCommands.resize(threadPool->getThreadCount());
+
+		for (ThreadCommands& commands : frameCommands) {
+			VkCommandPoolCreateInfo commandPoolInfo = {};
+			commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			commandPoolInfo.queueFamilyIndex = queues.graphicsQueueIndex.value();
+
+			result = vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commands.commandPool);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("ERROR: cannot create Thread Command Pool.");
+			}
+		}
+	}
+}
+
+void VulkanRenderer::recordSceneCommandBuffers(uint32_t imageIndex)
+{
+	PROFILE_FUNCTION();
+
+	/*
+		Every scene batch is one instanced draw, and the batches cover the instance buffer back to back.
+		The instances are split into contiguous ranges that worker threads record into Secondary Command
+		Buffers in parallel, so a batch can be drawn in pieces by several threads. The primary executes
+		them in range order in subpass 0.
+	*/
+	std::vector<ThreadCommands>& frameCommands = threadCommands[currentFrame];
+	for (ThreadCommands& commands : frameCommands) {
+		vkResetCommandPool(device, commands.commandPool, 0);
+		commands.usedCount = 0;
+	}
+
+	uint32_t sceneInstanceCount = scene->getInstanceCount();
+	uint32_t jobCount = std::clamp((sceneInstanceCount + MIN_INSTANCES_PER_THREAD - 1) / MIN_INSTANCES_PER_THREAD, 1u, threadPool->getThreadCount());
+
+	sceneCommandBuffers.resize(jobCount);
+
+	threadPool->run(jobCount, [&](uint32_t jobIndex, uint32_t threadIndex) {
+		uint32_t firstInstance = static_cast<uint32_t>(uint64_t(jobIndex) * sceneInstanceCount / jobCount);
+		uint32_t lastInstance = static_cast<uint32_t>(uint64_t(jobIndex + 1) * sceneInstanceCount / jobCount);
+
+		VkCommandBuffer commandBuffer = getSecondaryCommandBuffer(frameCommands[threadIndex]);
+		recordDrawCalls(commandBuffer, imageIndex, firstInstance, lastInstance);
+		sceneCommandBuffers[jobIndex] = commandBuffer;
+	});
+}
+
+VkCommandBuffer VulkanRenderer::getSecondaryCommandBuffer(ThreadCommands& commands)
+{
+	// Buffers survive pool resets, so they are only allocated the first time a thread needs that many
+	if (commands.usedCount == commands.commandBuffers.size()) {
+		VkCommandBufferAllocateInfo commandBufferInfo = {};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.commandPool = commands.commandPool;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		commandBufferInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		VkResult allocateResult = vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer);
+		if (allocateResult != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot allocate Secondary Command Buffer.");
+		}
+
+		commands.commandBuffers.push_back(commandBuffer);
+	}
+
+	return commands.commandBuffers[commands.usedCount++];
+}
+
+void VulkanRenderer::recordDrawCalls(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t lastInstance)
+{
+	PROFILE_FUNCTION();
+
+	// Runs on worker threads, so it keeps its VkResult to itself
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapchainFramebuffer[imageIndex];
+
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkResult recordResult = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (recordResult != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot begin Secondary Command Buffer recording.");
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	pipelineVariants->setDynamicState(commandBuffer, gbufferDescription, swapchainExtent);
+
+	// Every mesh lives in the arena buffers and samples the shared texture array, so they are bound once
+	VkBuffer vertexBuffers[] = { meshArena->getVertexBuffer(), scene->getInstanceBuffer(currentFrame) };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, meshArena->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 1, &uniformOffsets.mvp);
+
+	// firstInstance of a batch indexes the transforms in this frame's instance buffer
+	const std::vector<Scene::Batch>& batches = scene->getBatches();
+
+	for (const Scene::Batch& batch : batches) {
+		// The part of the batch inside this range of instances
+		uint32_t batchFirst = std::max(batch.firstInstance, firstInstance);
+		uint32_t batchLast = std::min(batch.firstInstance + batch.instanceCount, lastInstance);
+		if (batchFirst >= batchLast) {
+			continue;
+		}
+
+		Model* model = scene->getModel(batch.meshIndex);
+
+		vkCmdDrawIndexed(commandBuffer, model->getIndexCount(), batchLast - batchFirst, model->getFirstIndex(), model->getVertexOffset(), batchFirst);
+	}
+
+	recordResult = vkEndCommandBuffer(commandBuffer);
+	if (recordResult != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot end Secondary Command Buffer recording.");
+	}
+}
+
+void VulkanRenderer::recordIndirectDraws(VkCommandBuffer commandBuffer, bool isLatePhase)
+{
+	PROFILE_FUNCTION();
+
+	/*
+		The draws come from the culling's indirect buffer and the instances from its culled instance buffer.
+		Recording costs the same however many instances the scene has.
+	*/
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	pipelineVariants->setDynamicState(commandBuffer, gbufferDescription, swapchainExtent);
+
+	VkBuffer vertexBuffers[] = { meshArena->getVertexBuffer(), indirectCulling->getInstanceBuffer(currentFrame) };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, meshArena->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 1, &uniformOffsets.mvp);
+
+	if (isLatePhase) {
+		indirectCulling->drawLate(commandBuffer, currentFrame);
+	}
+	else {
+		indirectCulling->draw(commandBuffer, currentFrame);
+	}
+}
+
 void VulkanRenderer::createSyncTools()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Vulkan have synchronization tools such as Semaphore and Fence.
 
@@ -1367,74 +1719,102 @@ void VulkanRenderer::createSyncTools()
 	}
 }
 
-void VulkanRenderer::createMVPBuffer()
+void VulkanRenderer::readFrameTimestamps(uint32_t frameIndex)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	bufferInfo.size = sizeof(MVP);
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	result = vkCreateBuffer(device, &bufferInfo, nullptr, &mvpBuffer);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create MVP buffer.");
-	}
-
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, mvpBuffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		device.physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &mvpBufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate MVP Buffer Memory.");
+	if (gpuProfiler->readFrame(frameIndex) && benchmark) {
+		benchmark->setGpuTime(gpuProfiler->getFrameNumber(), gpuProfiler->getFrameTime());
 	}
-
-	vkBindBufferMemory(device, mvpBuffer, mvpBufferMemory, 0);
-
-	vkMapMemory(device, mvpBufferMemory, 0, sizeof(MVP), 0, &mvpBufferMapped);
 }
 
-void VulkanRenderer::updateMVPBuffer()
+void VulkanRenderer::updateUniforms(uint32_t frameIndex)
 {
+	PROFILE_FUNCTION();
+
+	/*
+		Per-frame uniform data is written to the ring region of this frame, which the GPU
+		stopped reading when the frame's fence signaled. The returned offsets are bound as
+		dynamic offsets, so frames in flight never see each other's data.
+	*/
+	uniformRing->beginFrame(frameIndex);
+
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+	// Headless runs animate by frame number at 60 FPS, so every run renders the same frames
+	if (isHeadless) {
+		deltaTime = frameNumber / 60.0f;
+	}
 	
 	mvp.model = glm::mat4(1.0f);
 	mvp.model = glm::rotate(mvp.model, deltaTime * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	mvp.view = camera->getViewMatrix();
-	mvp.projection = glm::perspective(glm::radians(camera->getFOV()), swapchainExtent.width / (float)swapchainExtent.height, 0.1f, 10.f);
+	mvp.projection = glm::perspective(glm::radians(camera->getFOV()), swapchainExtent.width / (float)swapchainExtent.height, 0.1f, farPlane);
 	mvp.projection[1][1] *= -1;
 
-	memcpy(mvpBufferMapped, &mvp, sizeof(MVP));
+	uniformOffsets.mvp = uniformRing->push(mvp);
+
+	// G-buffer positions are after mvp.model, so only the camera is undone
+	pushConstant.inverseViewProjection = glm::inverse(mvp.projection * mvp.view);
+	pushConstant.inverseExtent = glm::vec2(1.0f / swapchainExtent.width, 1.0f / swapchainExtent.height);
+
+	// Lights bob up and down out of step with each other
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		lights[i].setPosition(lightOrigins[i] + glm::vec3(0.0f, 0.5f * std::sin(deltaTime + i), 0.0f));
+	}
+	lightGrid->update(frameIndex, lights, mvp.view, mvp.projection, swapchainExtent);
+	uniformOffsets.light = uniformRing->push(lightGrid->getInfo());
+
+	// The grid's buffers may have been replaced, the frame's set is not in use anymore
+	std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+	bufferInfos[0].buffer = lightGrid->getLightBuffer(frameIndex);
+	bufferInfos[1].buffer = lightGrid->getTileBuffer(frameIndex);
+	bufferInfos[2].buffer = lightGrid->getIndexBuffer(frameIndex);
+
+	std::array<VkWriteDescriptorSet, 3> writeSets = {};
+	for (uint32_t i = 0; i < writeSets.size(); i++) {
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writeSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[i].dstSet = lightDescriptorSets[frameIndex];
+		writeSets[i].dstBinding = i + 1;
+		writeSets[i].dstArrayElement = 0;
+		writeSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeSets[i].descriptorCount = 1;
+		writeSets[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
 }
 
 void VulkanRenderer::createDescriptorSetLayout()
 {
+	PROFILE_FUNCTION();
+
 	VkDescriptorSetLayoutBinding mvpLayoutBinding = {};
 	mvpLayoutBinding.binding = 0;
 	mvpLayoutBinding.descriptorCount = 1;
-	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	mvpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	mvpLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding textureLayoutBinding = {};
 	textureLayoutBinding.binding = 1;
-	textureLayoutBinding.descriptorCount = 1;
+	textureLayoutBinding.descriptorCount = MAX_SCENE_TEXTURES;
 	textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	textureLayoutBinding.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { mvpLayoutBinding, textureLayoutBinding };
+	// VertexDecode of every mesh, picked by the meshIndex of the instance
+	VkDescriptorSetLayoutBinding meshLayoutBinding = {};
+	meshLayoutBinding.binding = 2;
+	meshLayoutBinding.descriptorCount = 1;
+	meshLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	meshLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	meshLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = { mvpLayoutBinding, textureLayoutBinding, meshLayoutBinding };
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1449,6 +1829,8 @@ void VulkanRenderer::createDescriptorSetLayout()
 
 void VulkanRenderer::createInputDescriptorSetLayout()
 {
+	PROFILE_FUNCTION();
+
 	VkDescriptorSetLayoutBinding colorInputBinding = {};
 	colorInputBinding.binding = 0;
 	colorInputBinding.descriptorCount = 1;
@@ -1463,17 +1845,17 @@ void VulkanRenderer::createInputDescriptorSetLayout()
 	normInputBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	normInputBinding.pImmutableSamplers = nullptr;
 
-	VkDescriptorSetLayoutBinding positionInputBinding = {};
-	positionInputBinding.binding = 2;
-	positionInputBinding.descriptorCount = 1;
-	positionInputBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-	positionInputBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	positionInputBinding.pImmutableSamplers = nullptr;
+	VkDescriptorSetLayoutBinding depthInputBinding = {};
+	depthInputBinding.binding = 2;
+	depthInputBinding.descriptorCount = 1;
+	depthInputBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	depthInputBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	depthInputBinding.pImmutableSamplers = nullptr;
 
 	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {
 		colorInputBinding,
 		normInputBinding,
-		positionInputBinding
+		depthInputBinding
 	};
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
@@ -1489,17 +1871,22 @@ void VulkanRenderer::createInputDescriptorSetLayout()
 
 void VulkanRenderer::createLightDescriptorSetLayout()
 {
-	VkDescriptorSetLayoutBinding lightUniformBinding = {};
-	lightUniformBinding.binding = 0;
-	lightUniformBinding.descriptorCount = 1;
-	lightUniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	lightUniformBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	lightUniformBinding.pImmutableSamplers = nullptr;
+	PROFILE_FUNCTION();
+
+	// Grid uniform, then the light grid's lights, tiles and light indices
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 1;
-	layoutInfo.pBindings = &lightUniformBinding;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
 
 	result = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &lightDescriptorSetLayout);
 	if (result != VK_SUCCESS) {
@@ -1509,15 +1896,19 @@ void VulkanRenderer::createLightDescriptorSetLayout()
 
 void VulkanRenderer::createDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].descriptorCount = 1;
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[1].descriptorCount = 1;
+	PROFILE_FUNCTION();
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].descriptorCount = FRAMES_IN_FLIGHT;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = MAX_SCENE_TEXTURES * FRAMES_IN_FLIGHT;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = FRAMES_IN_FLIGHT;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.maxSets = 1;
+	descriptorPoolInfo.maxSets = FRAMES_IN_FLIGHT;
 	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	descriptorPoolInfo.pPoolSizes = poolSizes.data();
 
@@ -1529,13 +1920,16 @@ void VulkanRenderer::createDescriptorPool()
 
 void VulkanRenderer::createInputDescriptorPool()
 {
+	PROFILE_FUNCTION();
+
+	// Color, norm and depth of the shared G-buffer
 	VkDescriptorPoolSize poolSize = {};
-	poolSize.descriptorCount = 1;
+	poolSize.descriptorCount = 3;
 	poolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.maxSets = static_cast<uint32_t>(swapchainImages.size());
+	poolInfo.maxSets = 1;
 	poolInfo.poolSizeCount = 1;
 	poolInfo.pPoolSizes = &poolSize;
 
@@ -1547,15 +1941,20 @@ void VulkanRenderer::createInputDescriptorPool()
 
 void VulkanRenderer::createLightDescriptorPool()
 {
-	VkDescriptorPoolSize poolSize = {};
-	poolSize.descriptorCount = 1;
-	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	PROFILE_FUNCTION();
+
+	// A set per frame in flight, they point at that frame's light grid buffers
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].descriptorCount = FRAMES_IN_FLIGHT;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 3 * FRAMES_IN_FLIGHT;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.maxSets = static_cast<uint32_t>(swapchainImages.size());
-	descriptorPoolInfo.poolSizeCount = 1;
-	descriptorPoolInfo.pPoolSizes = &poolSize;
+	descriptorPoolInfo.maxSets = FRAMES_IN_FLIGHT;
+	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	descriptorPoolInfo.pPoolSizes = poolSizes.data();
 
 	result = vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &lightDescriptorPool);
 	if (result != VK_SUCCESS)
@@ -1564,150 +1963,202 @@ void VulkanRenderer::createLightDescriptorPool()
 	}
 }
 
-void VulkanRenderer::createDescriptorSet()
+void VulkanRenderer::createDescriptorSets()
 {
+	PROFILE_FUNCTION();
+
+	/*
+		A single set per frame serves every mesh, so one indirect draw can render the whole scene.
+		Mesh i samples texture i, slots past the last mesh repeat the first texture.
+	*/
+	if (scene->getMeshCount() > MAX_SCENE_TEXTURES) {
+		throw std::runtime_error("ERROR: Scene has more meshes than MAX_SCENE_TEXTURES.");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(FRAMES_IN_FLIGHT, descriptorSetLayout);
+
 	VkDescriptorSetAllocateInfo allocateInfo = {};
 	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocateInfo.descriptorPool = descriptorPool;
-	allocateInfo.descriptorSetCount = 1;
-	allocateInfo.pSetLayouts = &descriptorSetLayout;
+	allocateInfo.descriptorSetCount = FRAMES_IN_FLIGHT;
+	allocateInfo.pSetLayouts = layouts.data();
 
-	result = vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet);
+	descriptorSets.resize(FRAMES_IN_FLIGHT);
+	result = vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data());
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot allocate Descriptor Set.");
 	}
 
 	VkDescriptorBufferInfo descriptorBufferInfo = {};
-	descriptorBufferInfo.buffer = mvpBuffer;
+	descriptorBufferInfo.buffer = uniformRing->getBuffer();
 	descriptorBufferInfo.offset = 0;
 	descriptorBufferInfo.range = sizeof(MVP);
 
-	VkDescriptorImageInfo descriptorImageInfo = {};
-	descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	descriptorImageInfo.imageView = texture->getImageView();
-	descriptorImageInfo.sampler = texture->getSampler();
-
-	std::array<VkWriteDescriptorSet, 2> writeSets = {};
-
-	writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSets[0].dstSet = descriptorSet;
-	writeSets[0].dstBinding = 0;
-	writeSets[0].dstArrayElement = 0;
-	writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writeSets[0].descriptorCount = 1;
-	writeSets[0].pBufferInfo = &descriptorBufferInfo;
-
-	writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSets[1].dstSet = descriptorSet;
-	writeSets[1].dstBinding = 1;
-	writeSets[1].dstArrayElement = 0;
-	writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeSets[1].descriptorCount = 1;
-	writeSets[1].pImageInfo = &descriptorImageInfo;
+	VkDescriptorBufferInfo meshBufferInfo = {};
+	meshBufferInfo.buffer = scene->getMeshBuffer();
+	meshBufferInfo.offset = 0;
+	meshBufferInfo.range = VK_WHOLE_SIZE;
 
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+	for (size_t i = 0; i < descriptorSets.size(); i++) {
+		std::array<VkWriteDescriptorSet, 2> writeSets = {};
+
+		writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[0].dstSet = descriptorSets[i];
+		writeSets[0].dstBinding = 0;
+		writeSets[0].dstArrayElement = 0;
+		writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeSets[0].descriptorCount = 1;
+		writeSets[0].pBufferInfo = &descriptorBufferInfo;
+
+		writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[1].dstSet = descriptorSets[i];
+		writeSets[1].dstBinding = 2;
+		writeSets[1].dstArrayElement = 0;
+		writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeSets[1].descriptorCount = 1;
+		writeSets[1].pBufferInfo = &meshBufferInfo;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+	}
+
+	// Never matches the streamer's version, so every set gets its textures written
+	descriptorSetTextureVersions.assign(FRAMES_IN_FLIGHT, std::numeric_limits<uint64_t>::max());
+	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		updateTextureDescriptors(i);
+	}
 }
 
-void VulkanRenderer::createInputDescriptorSet()
+void VulkanRenderer::updateTextureDescriptors(uint32_t frameIndex)
 {
-	inputDescriptorSets.resize(swapchainImages.size());
+	PROFILE_FUNCTION();
+
+	if (descriptorSetTextureVersions[frameIndex] == textureStreamer->getResidentVersion()) {
+		return;
+	}
+	descriptorSetTextureVersions[frameIndex] = textureStreamer->getResidentVersion();
+
+	// Textures still streaming in show the placeholder
+	std::array<VkDescriptorImageInfo, MAX_SCENE_TEXTURES> descriptorImageInfos = {};
+	for (uint32_t i = 0; i < descriptorImageInfos.size(); i++) {
+		Texture* texture = scene->getTexture(i < scene->getMeshCount() ? i : 0);
+		if (!texture->isResident()) {
+			texture = textureStreamer->getPlaceholder();
+		}
+
+		descriptorImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		descriptorImageInfos[i].imageView = texture->getImageView();
+		descriptorImageInfos[i].sampler = texture->getSampler();
+	}
+
+	VkWriteDescriptorSet writeSet = {};
+	writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeSet.dstSet = descriptorSets[frameIndex];
+	writeSet.dstBinding = 1;
+	writeSet.dstArrayElement = 0;
+	writeSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writeSet.descriptorCount = static_cast<uint32_t>(descriptorImageInfos.size());
+	writeSet.pImageInfo = descriptorImageInfos.data();
 
-	std::vector<VkDescriptorSetLayout> setLayouts(swapchainImages.size(), inputDescriptorSetLayout);
+	vkUpdateDescriptorSets(device, 1, &writeSet, 0, nullptr);
+}
+
+void VulkanRenderer::createInputDescriptorSet()
+{
+	PROFILE_FUNCTION();
 
 	VkDescriptorSetAllocateInfo setAllocateInfo = {};
 	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	setAllocateInfo.descriptorPool = inputDescriptorPool;
-	setAllocateInfo.descriptorSetCount = static_cast<uint32_t>(inputDescriptorSets.size());
-	setAllocateInfo.pSetLayouts = setLayouts.data();
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &inputDescriptorSetLayout;
 
-	result = vkAllocateDescriptorSets(device, &setAllocateInfo, inputDescriptorSets.data());
+	result = vkAllocateDescriptorSets(device, &setAllocateInfo, &inputDescriptorSet);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot allocate Input Descriptor Set.");
 	}
 
-	for (size_t i = 0; i < swapchainImages.size(); i++) {
-		VkDescriptorImageInfo colorAttachmentDescriptor = {};
-		colorAttachmentDescriptor.sampler = VK_NULL_HANDLE;
-		colorAttachmentDescriptor.imageView = colorImageViews[i];
-		colorAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		VkDescriptorImageInfo normAttachmentDescriptor = {};
-		normAttachmentDescriptor.sampler = VK_NULL_HANDLE;
-		normAttachmentDescriptor.imageView = normImageViews[i];
-		normAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		VkDescriptorImageInfo positionAttachmentDescriptor = {};
-		positionAttachmentDescriptor.sampler = VK_NULL_HANDLE;
-		positionAttachmentDescriptor.imageView = positionImageViews[i];
-		positionAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		VkWriteDescriptorSet colorWrite = {};
-		colorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		colorWrite.dstSet = inputDescriptorSets[i];
-		colorWrite.dstBinding = 0;
-		colorWrite.dstArrayElement = 0;
-		colorWrite.descriptorCount = 1;
-		colorWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-		colorWrite.pImageInfo = &colorAttachmentDescriptor;
-
-		VkWriteDescriptorSet normWrite = {};
-		normWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		normWrite.dstSet = inputDescriptorSets[i];
-		normWrite.dstBinding = 1;
-		normWrite.dstArrayElement = 0;
-		normWrite.descriptorCount = 1;
-		normWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-		normWrite.pImageInfo = &normAttachmentDescriptor;
-
-		VkWriteDescriptorSet positionWrite = {};
-		positionWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		positionWrite.dstSet = inputDescriptorSets[i];
-		positionWrite.dstBinding = 2;
-		positionWrite.dstArrayElement = 0;
-		positionWrite.descriptorCount = 1;
-		positionWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-		positionWrite.pImageInfo = &positionAttachmentDescriptor;
-
-		std::array<VkWriteDescriptorSet, 3> writes = {
-			colorWrite,
-			normWrite,
-			positionWrite
-		};
+	VkDescriptorImageInfo colorAttachmentDescriptor = {};
+	colorAttachmentDescriptor.sampler = VK_NULL_HANDLE;
+	colorAttachmentDescriptor.imageView = colorImageView;
+	colorAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkDescriptorImageInfo normAttachmentDescriptor = {};
+	normAttachmentDescriptor.sampler = VK_NULL_HANDLE;
+	normAttachmentDescriptor.imageView = normImageView;
+	normAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkDescriptorImageInfo depthAttachmentDescriptor = {};
+	depthAttachmentDescriptor.sampler = VK_NULL_HANDLE;
+	depthAttachmentDescriptor.imageView = depthImageView;
+	depthAttachmentDescriptor.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet colorWrite = {};
+	colorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	colorWrite.dstSet = inputDescriptorSet;
+	colorWrite.dstBinding = 0;
+	colorWrite.dstArrayElement = 0;
+	colorWrite.descriptorCount = 1;
+	colorWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	colorWrite.pImageInfo = &colorAttachmentDescriptor;
+
+	VkWriteDescriptorSet normWrite = {};
+	normWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	normWrite.dstSet = inputDescriptorSet;
+	normWrite.dstBinding = 1;
+	normWrite.dstArrayElement = 0;
+	normWrite.descriptorCount = 1;
+	normWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	normWrite.pImageInfo = &normAttachmentDescriptor;
+
+	VkWriteDescriptorSet depthWrite = {};
+	depthWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	depthWrite.dstSet = inputDescriptorSet;
+	depthWrite.dstBinding = 2;
+	depthWrite.dstArrayElement = 0;
+	depthWrite.descriptorCount = 1;
+	depthWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	depthWrite.pImageInfo = &depthAttachmentDescriptor;
+
+	std::array<VkWriteDescriptorSet, 3> writes = {
+		colorWrite,
+		normWrite,
+		depthWrite
+	};
 
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
-	}
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
 void VulkanRenderer::createLightDescriptorSets()
 {
-	lightDescriptorSets.resize(swapchainImages.size());
+	PROFILE_FUNCTION();
 
-	std::vector<VkDescriptorSetLayout> setLayouts(swapchainImages.size(), lightDescriptorSetLayout);
+	lightDescriptorSets.resize(FRAMES_IN_FLIGHT);
+	std::vector<VkDescriptorSetLayout> layouts(FRAMES_IN_FLIGHT, lightDescriptorSetLayout);
 
 	VkDescriptorSetAllocateInfo allocateInfo = {};
 	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocateInfo.descriptorPool = lightDescriptorPool;
-	allocateInfo.descriptorSetCount = static_cast<uint32_t>(lightDescriptorSets.size());
-	allocateInfo.pSetLayouts = setLayouts.data();
+	allocateInfo.descriptorSetCount = FRAMES_IN_FLIGHT;
+	allocateInfo.pSetLayouts = layouts.data();
 
 	result = vkAllocateDescriptorSets(device, &allocateInfo, lightDescriptorSets.data());
 	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Descriptor Set.");
+		throw std::runtime_error("ERROR: cannot allocate Light Descriptor Set.");
 	}
 
-	for (size_t i = 0; i < lightDescriptorSets.size(); i++) {
+	// The light grid buffers are written every frame in updateUniforms
+	for (VkDescriptorSet lightDescriptorSet : lightDescriptorSets) {
 		VkDescriptorBufferInfo descriptorBufferInfo = {};
-		descriptorBufferInfo.buffer = light->getBuffer();
+		descriptorBufferInfo.buffer = uniformRing->getBuffer();
 		descriptorBufferInfo.offset = 0;
-		descriptorBufferInfo.range = sizeof(Light::Properties);
+		descriptorBufferInfo.range = sizeof(LightGrid::Info);
 
 		VkWriteDescriptorSet writeSet = {};
-
 		writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeSet.dstSet = lightDescriptorSets[i];
+		writeSet.dstSet = lightDescriptorSet;
 		writeSet.dstBinding = 0;
 		writeSet.dstArrayElement = 0;
-		writeSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		writeSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		writeSet.descriptorCount = 1;
 		writeSet.pBufferInfo = &descriptorBufferInfo;
 
@@ -1717,6 +2168,8 @@ void VulkanRenderer::createLightDescriptorSets()
 
 void VulkanRenderer::choosePhysicalDevice()
 {
+	PROFILE_FUNCTION();
+
 	/*
 	Physical devices represent GPUs installed in the system.
 	We can obtain properties of GPU and choose what device we want to use.
@@ -1744,35 +2197,19 @@ void VulkanRenderer::cleanup()
 	/*
 		We have to destroy every object that we created using Vulkan (free memory).
 	*/
-	delete light;
+	delete lightGrid;
 	delete camera;
-	delete texture;
-	delete model;
-
-	vkDestroyImageView(device, depthImageView, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
-
-	for (size_t i = 0; i < positionImages.size(); i++) {
-		vkDestroyImage(device, positionImages[i], nullptr);
-		vkFreeMemory(device, positionImageMemories[i], nullptr);
-		vkDestroyImageView(device, positionImageViews[i], nullptr);
-	}
+	delete benchmark;
+	delete indirectCulling;
+	delete depthPyramid;
+	// Before the scene, which owns the textures the streamer may still be decoding
+	delete textureStreamer;
+	delete scene;
+	delete meshArena;
 
-	for (size_t i = 0; i < normImages.size(); i++) {
-		vkDestroyImage(device, normImages[i], nullptr);
-		vkFreeMemory(device, normImageMemories[i], nullptr);
-		vkDestroyImageView(device, normImageViews[i], nullptr);
-	}
-
-	for (size_t i = 0; i < colorImages.size(); i++) {
-		vkDestroyImageView(device, colorImageViews[i], nullptr);
-		vkFreeMemory(device, colorImageMemories[i], nullptr);
-		vkDestroyImage(device, colorImages[i], nullptr);
-	}
+	destroySwapchainResources();
 
-	vkFreeMemory(device, mvpBufferMemory, nullptr);
-	vkDestroyBuffer(device, mvpBuffer, nullptr);
+	delete uniformRing;
 
 	vkDestroyDescriptorPool(device, lightDescriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(device, lightDescriptorSetLayout, nullptr);
@@ -1789,27 +2226,40 @@ void VulkanRenderer::cleanup()
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 	}
 
+	delete gpuProfiler;
+
+	for (auto& frameCommands : threadCommands) {
+		for (ThreadCommands& commands : frameCommands) {
+			vkDestroyCommandPool(device, commands.commandPool, nullptr);
+		}
+	}
+	delete threadPool;
+
 	vkDestroyCommandPool(device, commandPool, nullptr);
 
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipeline(device, secondPipeline, nullptr);
+	delete pipelineVariants;
 
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyPipelineLayout(device, secondPipelineLayout, nullptr);
 
-	for (const auto& framebuffer : swapchainFramebuffer) {
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-	}
-
 	vkDestroyRenderPass(device, renderPass, nullptr);
+	vkDestroyRenderPass(device, earlyRenderPass, nullptr);
 
-	for (const auto& imageView : swapchainImageViews) {
-		vkDestroyImageView(device, imageView, nullptr);
+	if (isHeadless) {
+		for (size_t i = 0; i < swapchainImages.size(); i++) {
+			vkDestroyImage(device, swapchainImages[i], nullptr);
+			allocator->free(offscreenImageAllocations[i]);
+		}
+	}
+	else {
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
+		vkDestroySurfaceKHR(instance, surface, nullptr);
 	}
 
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
+	pipelineCache->save();
+	delete pipelineCache;
 
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	delete allocator;
 
 	vkDestroyDevice(device, nullptr);
 
@@ -1819,13 +2269,16 @@ void VulkanRenderer::cleanup()
 
 	vkDestroyInstance(instance, nullptr);
 
-	glfwDestroyWindow(window);
-
-	glfwTerminate();
+	if (!isHeadless) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 }
 
 void VulkanRenderer::draw()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		This is where rendering and presentation is going.
 
@@ -1835,18 +2288,47 @@ void VulkanRenderer::draw()
 		Or image is available to start rendering.
 	*/
 
-	static uint32_t currentFrame = 0;
-
+	auto fenceWaitStartTime = std::chrono::high_resolution_clock::now();
 	// waits while fence will be in state Singaled
-	vkWaitForFences(device, 1, &bufferFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// reset Fence to Unsignaled state
-	vkResetFences(device, 1, &bufferFences[currentFrame]);
+	{
+		PROFILE_SCOPE("vkWaitForFences");
+		vkWaitForFences(device, 1, &bufferFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	fenceWaitTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - fenceWaitStartTime).count();
 
 	uint32_t imageIndex;
-	// Acquire next image and signals that image is available (change imageAvailableSemaphore).
-	vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (isHeadless) {
+		// Every frame in flight has an offscreen image of its own, which the fence above already guards
+		imageIndex = currentFrame;
+	}
+	else {
+		// Acquire next image and signals that image is available (change imageAvailableSemaphore).
+		PROFILE_SCOPE("vkAcquireNextImageKHR");
+		result = vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+		// Nothing was submitted and the fence is still signaled, so the frame can simply be skipped
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			recreateSwapchain();
+			return;
+		}
+		// A suboptimal swapchain can still be presented to, it is recreated after the present
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("ERROR: cannot acquire Swapchain Image.");
+		}
+	}
 
-	updateMVPBuffer();
+	// reset Fence to Unsignaled state, only once work that signals it is sure to be submitted
+	vkResetFences(device, 1, &bufferFences[currentFrame]);
+
+	// The previous frame in this slot is done, so are its timestamps
+	readFrameTimestamps(currentFrame);
+
+	// Submits decoded textures and retires finished uploads, never waits for either
+	textureStreamer->update();
+	updateTextureDescriptors(currentFrame);
+
+	updateUniforms(currentFrame);
+	scene->update(currentFrame);
 
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
 	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
@@ -1855,12 +2337,12 @@ void VulkanRenderer::draw()
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = isHeadless ? 0 : 1;
 	submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = isHeadless ? 0 : 1;
 	submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
 
 	// Fence become Signaled
@@ -1869,35 +2351,128 @@ void VulkanRenderer::draw()
 		throw std::runtime_error("ERROR: cannot submit Graphics Queue.");
 	}
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &swapchain;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = nullptr;
+	frameNumber++;
 
-	result = vkQueuePresentKHR(queues.presentQueue, &presentInfo);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot Present Image.");
+	if (!isHeadless) {
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &swapchain;
+		presentInfo.pImageIndices = &imageIndex;
+		presentInfo.pResults = nullptr;
+
+		result = vkQueuePresentKHR(queues.presentQueue, &presentInfo);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR) {
+			throw std::runtime_error("ERROR: cannot Present Image.");
+		}
 	}
 
 	currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
+
+	if (!isHeadless && (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR || isFramebufferResized)) {
+		recreateSwapchain();
+	}
+}
+
+void VulkanRenderer::createScene()
+{
+	PROFILE_FUNCTION();
+
+	std::string modelsPath = MODELS_DIR;
+	std::string texturesPath = TEXTURES_DIR;
+
+	// Integrated GPUs share memory with the host, so staging the geometry would only add a copy
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+
+	MeshArena::MEMORY_MODE memoryMode = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+		? MeshArena::HOST_VISIBLE
+		: MeshArena::DEVICE_LOCAL;
+
+	meshArena = new MeshArena(device, allocator, commandPool, queues.graphicsQueue, Model::getBindingDescription(vertexFormat).stride, memoryMode);
+	scene = new Scene(device, allocator, FRAMES_IN_FLIGHT);
+
+	uint32_t headMesh = createModel(modelsPath + "/head.obj", texturesPath + "/head.tga");
+
+	/*
+		Copies of the head go on a square grid in the XZ plane, centered on the origin.
+		They share the mesh, so the whole grid is a single instanced draw.
+	*/
+	const float spacing = 2.5f;
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(float(instanceCount))));
+	float gridOffset = (gridSize - 1) * spacing * 0.5f;
+
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		glm::vec3 position((i % gridSize) * spacing - gridOffset, 0.0f, (i / gridSize) * spacing - gridOffset);
+		scene->addInstance(headMesh, glm::translate(glm::mat4(1.0f), position));
+	}
+
+	farPlane = std::max(farPlane, 10.0f + gridSize * spacing);
+
+	std::cout << "Scene >> " << scene->getInstanceCount() << " instances of " << scene->getMeshCount() << " meshes" << std::endl;
+}
+
+void VulkanRenderer::createLights()
+{
+	PROFILE_FUNCTION();
+
+	lightGrid = new LightGrid(device, allocator, FRAMES_IN_FLIGHT);
+
+	// A single light stays where the old one was, white and reaching the whole scene
+	if (lightCount == 1) {
+		lights.push_back(Light(glm::vec3(1.0f, 1.0f, -3.0f), glm::vec3(1.0f), farPlane));
+		lightOrigins.push_back(lights.back().getPostion());
+		return;
+	}
+
+	/*
+		More lights are scattered over the instance grid with colors around the hue circle.
+		A fixed seed gives every run the same lights.
+	*/
+	const float spacing = 2.5f;
+	float gridExtent = (std::ceil(std::sqrt(float(instanceCount))) + 1) * spacing * 0.5f;
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for (uint32_t i = 0; i < lightCount; i++) {
+		glm::vec3 position(
+			(unit(random) * 2.0f - 1.0f) * gridExtent,
+			0.5f + unit(random) * 1.5f,
+			(unit(random) * 2.0f - 1.0f) * gridExtent
+		);
+		glm::vec3 color = glm::clamp(glm::abs(glm::mod(unit(random) * 6.0f + glm::vec3(0.0f, 4.0f, 2.0f), 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+
+		lights.push_back(Light(position, color, 1.5f + unit(random) * 1.5f));
+		lightOrigins.push_back(position);
+	}
+
+	std::cout << "Lights >> " << lights.size() << " point lights in " << LightGrid::TILE_SIZE << "x" << LightGrid::TILE_SIZE << " pixel tiles" << std::endl;
 }
 
-void VulkanRenderer::createModel(std::string modelPath, std::string texturePath)
+uint32_t VulkanRenderer::createModel(std::string modelPath, std::string texturePath)
 {
-	model = new Model(modelPath, texturePath, device, device.physicalDevice);
-	texture = new Texture(texturePath, device, device.physicalDevice, commandPool, queues.graphicsQueueIndex.value(), queues.graphicsQueue);
+	PROFILE_FUNCTION();
+
+	Model* model = new Model(modelPath, texturePath, meshArena, vertexFormat);
+	Texture* texture = textureStreamer->request(texturePath);
+
+	return scene->addMesh(model, texture);
 }
 
 std::vector<const char*> VulkanRenderer::getRequiredExtensions()
 {
-	uint32_t extensionCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+	std::vector<const char*> extensions;
+
+	// Surface extensions are only needed to present to a window
+	if (!isHeadless) {
+		uint32_t extensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&extensionCount);
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + extensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + extensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1913,6 +2488,11 @@ bool VulkanRenderer::isPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice)
 	
 	findQueueFamilyIndeces(physicalDevice);
 
+	// Headless mode runs on whatever can render, including integrated GPUs and software implementations like lavapipe
+	if (isHeadless) {
+		return queues.isComplete();
+	}
+
 	bool extensionSupported = isDeviceSupportExtensions(physicalDevice);
 
 	bool swapchainAdequate = false;
@@ -1941,8 +2521,14 @@ void VulkanRenderer::findQueueFamilyIndeces(VkPhysicalDevice physicalDevice)
 			queues.graphicsQueueIndex = i;
 		}
 
+		// Nothing is presented in headless mode, the graphics queue stands in for the present queue
 		VkBool32 presentSupported = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupported);
+		if (isHeadless) {
+			presentSupported = (queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupported);
+		}
 
 		if (presentSupported) {
 			queues.presentQueueIndex = i;
@@ -1952,6 +2538,16 @@ void VulkanRenderer::findQueueFamilyIndeces(VkPhysicalDevice physicalDevice)
 			break;
 		}
 	}
+
+	// Usually backed by the copy engines, uploads there run next to rendering
+	queues.transferQueueIndex.reset();
+	for (int i = 0; i < queueFamilyProperties.size(); i++) {
+		VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			queues.transferQueueIndex = i;
+			break;
+		}
+	}
 }
 
 bool VulkanRenderer::checkValidationLayerSupport()
@@ -2091,7 +2687,7 @@ VkExtent2D VulkanRenderer::chooseSwapchainExtent(const VkSurfaceCapabilitiesKHR&
 		};
 
 		extent.width = std::clamp(extent.width, capabilites.minImageExtent.width, capabilites.maxImageExtent.width);
-		extent.height = std::clamp(extent.height, capabilites.minImageExtent.height, capabilites.maxImageExtent.width);
+		extent.height = std::clamp(extent.height, capabilites.minImageExtent.height, capabilites.maxImageExtent.height);
 
 		return extent;
 	}
@@ -10,7 +10,20 @@
 #include "Camera.h"
 #include "Model.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
+#include "Scene.h"
+#include "MeshArena.h"
+#include "IndirectCulling.h"
+#include "DepthPyramid.h"
 #include "Light.h"
+#include "LightGrid.h"
+#include "MemoryAllocator.h"
+#include "UniformRing.h"
+#include "PipelineCache.h"
+#include "PipelineVariants.h"
+#include "Benchmark.h"
+#include "GpuProfiler.h"
+#include "ThreadPool.h"
 
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
@@ -21,6 +34,34 @@ const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
+/*
+	How the scene's instances reach the G-buffer subpass.
+
+	CULLING_OFF records an instanced draw per mesh into Secondary Command Buffers.
+	CULLING_CPU and CULLING_GPU frustum cull the instances and draw the survivors with indirect draws,
+	culling on the host or in a compute pass.
+	CULLING_GPU can also cull occluded instances against a depth pyramid, see IndirectCulling.
+*/
+enum CULLING_MODE {
+	CULLING_OFF,
+	CULLING_CPU,
+	CULLING_GPU
+};
+
+/*
+	What the G-buffer stores per pixel, next to 4 bytes of depth.
+
+	Albedo is always R8G8B8A8_SRGB. GBUFFER_LAYOUT_FLOAT keeps the normal in R32G32B32A32_SFLOAT.
+	GBUFFER_LAYOUT_OCTAHEDRAL octahedral encodes it into R16G16_SNORM, or R16G16_SFLOAT where snorm
+	cannot be rendered to. GBUFFER_LAYOUT_PACKED fits the encoded normal, a roughness and a 2 bit
+	material ID into A2B10G10R10_UNORM.
+*/
+enum GBUFFER_LAYOUT {
+	GBUFFER_LAYOUT_FLOAT,
+	GBUFFER_LAYOUT_OCTAHEDRAL,
+	GBUFFER_LAYOUT_PACKED
+};
+
 struct SwapchainSupportDetails {
 	VkSurfaceCapabilitiesKHR capabilities;
 	std::vector<VkSurfaceFormatKHR> surfaceFormats;
@@ -31,9 +72,12 @@ class VulkanRenderer
 {
 public:
 
-	VulkanRenderer(bool enableValidationLayers = true);
+	// instanceCount copies of the model are laid out on a grid
+	VulkanRenderer(bool enableValidationLayers = true, uint32_t instanceCount = 1, CULLING_MODE cullingMode = CULLING_GPU, bool enableOcclusionCulling = false, uint32_t lightCount = 1, bool enableCullingValidation = false, VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT, GBUFFER_LAYOUT gbufferLayout = GBUFFER_LAYOUT_FLOAT);
 
 	void start(int windowWidth, int windowHeight, const char* windowTitle);
+	// Render frameCount + warmupFrames frames offscreen without a window and report their timings
+	void startHeadless(int width, int height, uint32_t frameCount, uint32_t warmupFrames, std::string outputPath);
 
 private:
 
@@ -42,48 +86,113 @@ private:
 
 	Camera* camera;
 	
-	Model* model = nullptr;
-	Texture* texture = nullptr;
-	Light* light = nullptr;
+	Scene* scene = nullptr;
+	// Geometry of every scene mesh
+	MeshArena* meshArena = nullptr;
+	IndirectCulling* indirectCulling = nullptr;
+	// Falls back to what the device supports when the logical device is created
+	CULLING_MODE cullingMode = CULLING_GPU;
+	// Needs CULLING_GPU, turned off with it
+	bool enableOcclusionCulling = false;
+	// Needs CULLING_GPU without occlusion culling, compares every GPU culling with the CPU's
+	bool enableCullingValidation = false;
+	// Packed formats draw with the *_packed_vert.spv shaders
+	VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT;
+	// Encoded normals draw and light with the *_octahedral_frag.spv or *_packed_gbuffer_frag.spv shaders
+	GBUFFER_LAYOUT gbufferLayout = GBUFFER_LAYOUT_FLOAT;
+	DepthPyramid* depthPyramid = nullptr;
+	bool isDrawCountSupported = false;
+	bool isMultiDrawSupported = false;
+	bool isExtendedDynamicStateSupported = false;
+	uint32_t instanceCount = 1;
+	// Far clip plane, pushed out to fit the scene
+	float farPlane = 10.0f;
+	uint32_t lightCount = 1;
+	std::vector<Light> lights;
+	// Where the lights bob around
+	std::vector<glm::vec3> lightOrigins;
+	LightGrid* lightGrid = nullptr;
+	MemoryAllocator* allocator = nullptr;
+	UniformRing* uniformRing = nullptr;
+	PipelineCache* pipelineCache = nullptr;
+	PipelineVariants* pipelineVariants = nullptr;
+	TextureStreamer* textureStreamer = nullptr;
+	Benchmark* benchmark = nullptr;
+	GpuProfiler* gpuProfiler = nullptr;
+	ThreadPool* threadPool = nullptr;
 	bool gouraudMode = false;
 	
 	VkResult result = VK_SUCCESS;
 	bool enableValidationLayers;
+	bool isHeadless = false;
+	// Set by framebufferResizeCallback, the swapchain is recreated after the next present
+	bool isFramebufferResized = false;
 
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkFormat swapchainImageFormat;
 	VkExtent2D swapchainExtent;
 	std::vector<VkImage> swapchainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	std::vector<VkFramebuffer> swapchainFramebuffer;
+	// Headless mode renders to these instead of swapchain images
+	VkExtent2D offscreenExtent;
+	std::vector<MemoryAllocator::Allocation> offscreenImageAllocations;
 	VkRenderPass renderPass;
+	// Picked for gbufferLayout and what the device can render to
+	VkFormat albedoFormat;
+	VkFormat normFormat;
+	// Occlusion culling only, renders the G-buffer of the early draws that renderPass then continues
+	VkRenderPass earlyRenderPass = VK_NULL_HANDLE;
 
 	VkPipelineLayout pipelineLayout;
 	VkPipelineLayout secondPipelineLayout;
+	// Owned by pipelineVariants, the descriptions also give the dynamic state to record with them
 	VkPipeline graphicsPipeline;
-	VkPipeline gouraudPipeline;
 	VkPipeline secondPipeline;
+	PipelineVariants::Description gbufferDescription;
+	PipelineVariants::Description lightingDescription;
 
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	// Secondary Command Buffers of one thread in one frame in flight
+	struct ThreadCommands {
+		VkCommandPool commandPool;
+		std::vector<VkCommandBuffer> commandBuffers;
+		uint32_t usedCount = 0;
+	};
+	// [frame in flight][thread]
+	std::vector<std::vector<ThreadCommands>> threadCommands;
+	// Recorded for the current frame, executed in this order
+	std::vector<VkCommandBuffer> sceneCommandBuffers;
+
+
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 	std::vector<VkFence> bufferFences;
+	uint32_t currentFrame = 0;
+	uint32_t frameNumber = 0;
+	float fenceWaitTime = 0.0f;
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorSet descriptorSet;
+	// Textures of every scene mesh, picked by the meshIndex of the instance. Per frame in flight,
+	// so a frame can point its set at newly resident textures while the other frame still uses its own
+	std::vector<VkDescriptorSet> descriptorSets;
+	// textureStreamer's resident version each set was written with
+	std::vector<uint64_t> descriptorSetTextureVersions;
 
 	VkDescriptorPool inputDescriptorPool;
 	VkDescriptorSetLayout inputDescriptorSetLayout;
-	std::vector<VkDescriptorSet> inputDescriptorSets;
+	// Shared by every frame, like the G-buffer it reads
+	VkDescriptorSet inputDescriptorSet;
 
 	VkDescriptorPool lightDescriptorPool;
 	VkDescriptorSetLayout lightDescriptorSetLayout;
+	// Per frame in flight
 	std::vector<VkDescriptorSet> lightDescriptorSets;
 
 	struct {
@@ -97,8 +206,11 @@ private:
 	struct {
 		std::optional<uint32_t> graphicsQueueIndex;
 		std::optional<uint32_t> presentQueueIndex;
+		// Transfer only family, if the device has one
+		std::optional<uint32_t> transferQueueIndex;
 		VkQueue graphicsQueue;
 		VkQueue presentQueue;
+		VkQueue transferQueue = VK_NULL_HANDLE;
 
 		bool isComplete() {
 			return graphicsQueueIndex.has_value()
@@ -112,35 +224,42 @@ private:
 		glm::mat4 projection;
 	} mvp;
 
+	// Of the lighting subpass
 	struct PushConstant {
+		// Reconstructs positions from depth
+		glm::mat4 inverseViewProjection;
+		glm::vec2 inverseExtent;
 		int mode = 0;
 	} pushConstant;
 
-	VkBuffer mvpBuffer;
-	VkDeviceMemory mvpBufferMemory;
-	void* mvpBufferMapped;
+	// Dynamic offsets of this frame's uniform data in uniformRing
+	struct {
+		uint32_t mvp;
+		uint32_t light;
+	} uniformOffsets;
 
 	VkImage depthImage;
 	VkImageView depthImageView;
-	VkDeviceMemory depthImageMemory;
+	MemoryAllocator::Allocation depthImageAllocation;
 
-	std::vector<VkImage> colorImages;
-	std::vector<VkImageView> colorImageViews;
-	std::vector<VkDeviceMemory> colorImageMemories;
+	VkImage colorImage;
+	VkImageView colorImageView;
+	MemoryAllocator::Allocation colorImageAllocation;
 
-	std::vector<VkImage> normImages;
-	std::vector<VkImageView> normImageViews;
-	std::vector<VkDeviceMemory> normImageMemories;
+	VkImage normImage;
+	VkImageView normImageView;
+	MemoryAllocator::Allocation normImageAllocation;
 
-	std::vector<VkImage> positionImages;
-	std::vector<VkImageView> positionImageViews;
-	std::vector<VkDeviceMemory> positionImageMemories;
 
 	// Window
 	void initWindow(int windowWidth, int windowHeight, const char* windowTitle);
 	void loop();
+	void benchmarkLoop();
 	void processInput(float deltaTime);
 	static void mouseCallback(GLFWwindow* window, double xpos, double ypos);
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+	// Prints the scene instance under a point of the view, x and y in [-1, 1]
+	void pickInstance(float x, float y);
 	void fpsCounter(float deltaTime);
 
 	// Vulkan
@@ -151,12 +270,19 @@ private:
 	void createLogicalDevice();
 	void createSurface();
 	void createSwapchain();
+	// Keeps the render passes and pipelines, rebuilds what depends on the swapchain's images and size
+	void recreateSwapchain();
+	void destroySwapchainResources();
+	void createOffscreenImages();
 	void createSwapchainImageViews();
+	void chooseGBufferFormats();
 	void createRenderPass();
+	VkRenderPass createScenePass(bool isEarlyPass);
 	void createColorAttachments();
 	void createNormAttachments();
-	void createPositionAttachments();
 	void createDepthResources();
+	// Lazily allocated where the device has it and the attachment is transient
+	MemoryAllocator::Allocation allocateAttachment(VkImage image, bool isTransient);
 	void createSwapchainFramebuffers();
 	void createDescriptorSetLayout();
 	void createInputDescriptorSetLayout();
@@ -164,7 +290,9 @@ private:
 	void createDescriptorPool();
 	void createInputDescriptorPool();
 	void createLightDescriptorPool();
-	void createDescriptorSet();
+	void createDescriptorSets();
+	// Rewrites the frame's textures if more became resident since, the frame's set must not be in use
+	void updateTextureDescriptors(uint32_t frameIndex);
 	void createInputDescriptorSet();
 	void createLightDescriptorSets();
 	void createGraphicsPipeline();
@@ -172,14 +300,21 @@ private:
 	void createCommandPool();
 	void createCommandBuffers();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void createThreadCommandPools();
+	void recordSceneCommandBuffers(uint32_t imageIndex);
+	VkCommandBuffer getSecondaryCommandBuffer(ThreadCommands& commands);
+	void recordDrawCalls(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t lastInstance);
+	void recordIndirectDraws(VkCommandBuffer commandBuffer, bool isLatePhase = false);
 	void createSyncTools();
-	void createMVPBuffer();
-	void updateMVPBuffer();
+	void readFrameTimestamps(uint32_t frameIndex);
+	void updateUniforms(uint32_t frameIndex);
 
 	void cleanup();
 	void draw();
 
-	void createModel(std::string modelPath, std::string texturePath);
+	void createScene();
+	void createLights();
+	uint32_t createModel(std::string modelPath, std::string texturePath);
 
 	// Support methods
 	std::vector<const char*> getRequiredExtensions();
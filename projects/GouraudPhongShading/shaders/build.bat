@@ -1,6 +1,8 @@
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe phong.vert -o phong_vert.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DPACKED_VERTEX phong.vert -o phong_packed_vert.spv
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe phong.frag -o phong_frag.spv
 
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe gouraud.vert -o gouraud_vert.spv
+C:/VulkanSDK/1.3.231.1/Bin/glslc.exe -DPACKED_VERTEX gouraud.vert -o gouraud_packed_vert.spv
 C:/VulkanSDK/1.3.231.1/Bin/glslc.exe gouraud.frag -o gouraud_frag.spv
 pause
\ No newline at end of file
@@ -1,9 +1,32 @@
 #version 450
 
+#ifdef PACKED_VERTEX
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec2 inNorm;
+
+layout(push_constant) uniform VertexDecode {
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;
+} decode;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 norm = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-norm.z, 0.0f);
+    norm.x += norm.x >= 0.0f ? -fold : fold;
+    norm.y += norm.y >= 0.0f ? -fold : fold;
+    return normalize(norm);
+}
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNorm;
+#endif
+
+// Per-instance transform, one column per location
+layout(location = 4) in mat4 inTransform;
 
 layout(binding = 0) uniform MVP {
     mat4 model;
@@ -20,16 +43,29 @@ layout(location = 0) out vec4 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = mvp.projection * mvp.view * mvp.model * vec4(inPosition, 1.0f);
+#ifdef PACKED_VERTEX
+    vec3 position = decode.positionOffset.xyz + decode.positionScale.xyz * inPosition;
+    vec2 texCoord = decode.texCoordScaleOffset.zw + decode.texCoordScaleOffset.xy * inTexCoord;
+    vec3 normal = decodeOctahedral(inNorm);
+#else
+    vec3 position = inPosition;
+    vec2 texCoord = inTexCoord;
+    vec3 normal = inNorm;
+#endif
+
+    mat4 model = mvp.model * inTransform;
+
+    vec3 worldPosition = vec3(model * vec4(position, 1.0f));
+    gl_Position = mvp.projection * mvp.view * vec4(worldPosition, 1.0f);
 
     vec3 ambientLight = 0.1f * light.color;
 
-    vec3 lightDir = normalize(light.position - inPosition);
-    vec3 norm = mat3(mvp.model) * inNorm;
+    vec3 lightDir = normalize(light.position - worldPosition);
+    vec3 norm = mat3(model) * normal;
     float diff = max(dot(lightDir, norm), 0.0f);
     vec3 diffuseLight = diff * light.color;
 
     fragColor = vec4(ambientLight + diffuseLight, 1.0f);
     
-    fragTexCoord = inTexCoord;
+    fragTexCoord = texCoord;
 }
\ No newline at end of file
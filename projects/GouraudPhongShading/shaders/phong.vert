@@ -1,9 +1,32 @@
 #version 450
 
+#ifdef PACKED_VERTEX
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec2 inNorm;
+
+layout(push_constant) uniform VertexDecode {
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;
+} decode;
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 norm = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-norm.z, 0.0f);
+    norm.x += norm.x >= 0.0f ? -fold : fold;
+    norm.y += norm.y >= 0.0f ? -fold : fold;
+    return normalize(norm);
+}
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNorm;
+#endif
+
+// Per-instance transform, one column per location
+layout(location = 4) in mat4 inTransform;
 
 layout(binding = 0) uniform MVP {
     mat4 model;
@@ -17,9 +40,23 @@ layout(location = 2) out vec3 fragNorm;
 layout(location = 3) out vec3 fragPosition;
 
 void main() {
-    fragPosition = vec3(mvp.model * vec4(inPosition, 1.0f));
-    gl_Position = mvp.projection * mvp.view * mvp.model * vec4(inPosition, 1.0f);
-    fragColor = vec4(inColor, 1.0);
-    fragTexCoord = inTexCoord;
-    fragNorm = mat3(mvp.model) * inNorm;
+#ifdef PACKED_VERTEX
+    vec3 position = decode.positionOffset.xyz + decode.positionScale.xyz * inPosition;
+    vec2 texCoord = decode.texCoordScaleOffset.zw + decode.texCoordScaleOffset.xy * inTexCoord;
+    vec3 normal = decodeOctahedral(inNorm);
+    vec3 color = vec3(0.0f);
+#else
+    vec3 position = inPosition;
+    vec2 texCoord = inTexCoord;
+    vec3 normal = inNorm;
+    vec3 color = inColor;
+#endif
+
+    mat4 model = mvp.model * inTransform;
+
+    fragPosition = vec3(model * vec4(position, 1.0f));
+    gl_Position = mvp.projection * mvp.view * model * vec4(position, 1.0f);
+    fragColor = vec4(color, 1.0);
+    fragTexCoord = texCoord;
+    fragNorm = mat3(model) * normal;
 }
\ No newline at end of file
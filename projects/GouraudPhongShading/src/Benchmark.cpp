@@ -0,0 +1,177 @@
+#include "Benchmark.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <iterator>
+
+#include <glm/gtc/constants.hpp>
+
+static float getPercentile(const std::vector<float>& sorted, float percentile)
+{
+	// Nearest rank
+	size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0f * sorted.size()));
+	return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+Benchmark::Benchmark(uint32_t frameCount, uint32_t warmupFrames)
+{
+	this->warmupFrames = warmupFrames;
+
+	frames.resize(warmupFrames + frameCount);
+}
+
+void Benchmark::getCameraPose(uint32_t frame, glm::vec3& position, glm::vec3& target)
+{
+	// One orbit over the run at the distance of the interactive start position, bobbing up and down twice
+	float angle = glm::two_pi<float>() * frame / frames.size();
+
+	position.x = 5.0f * std::sin(angle);
+	position.y = 1.5f * std::sin(2.0f * angle);
+	position.z = -5.0f * std::cos(angle);
+
+	target = glm::vec3(0.0f);
+}
+
+void Benchmark::setCpuTimes(uint32_t frame, float frameTime, float cpuTime)
+{
+	frames[frame].frameTime = frameTime;
+	frames[frame].cpuTime = cpuTime;
+}
+
+void Benchmark::setGpuTime(uint32_t frame, float gpuTime)
+{
+	frames[frame].gpuTime = gpuTime;
+}
+
+void Benchmark::report(std::string outputPath)
+{
+	Statistics frameStatistics = getStatistics(&Frame::frameTime);
+	Statistics cpuStatistics = getStatistics(&Frame::cpuTime);
+	Statistics gpuStatistics = getStatistics(&Frame::gpuTime);
+
+	std::cout << "Benchmark >> " << frames.size() - warmupFrames << " frames (" << warmupFrames << " warmup)" << std::endl;
+	std::cout << "Benchmark >> frame mean " << frameStatistics.mean << " ms, p50 " << frameStatistics.p50 << " ms, p99 " << frameStatistics.p99 << " ms" << std::endl;
+	std::cout << "Benchmark >> cpu   mean " << cpuStatistics.mean << " ms, p50 " << cpuStatistics.p50 << " ms, p99 " << cpuStatistics.p99 << " ms" << std::endl;
+	std::cout << "Benchmark >> gpu   mean " << gpuStatistics.mean << " ms, p50 " << gpuStatistics.p50 << " ms, p99 " << gpuStatistics.p99 << " ms" << std::endl;
+
+	if (outputPath.empty()) {
+		return;
+	}
+
+	std::string extension = outputPath.substr(std::min(outputPath.size(), outputPath.find_last_of('.')));
+	if (extension == ".json") {
+		writeJSON(outputPath);
+	}
+	else {
+		writeCSV(outputPath);
+	}
+
+	std::cout << "Benchmark >> results written to \"" << outputPath << "\"" << std::endl;
+}
+
+Benchmark::Statistics Benchmark::getStatistics(float Frame::* time)
+{
+	std::vector<float> sorted;
+	sorted.reserve(frames.size());
+
+	for (size_t i = warmupFrames; i < frames.size(); i++) {
+		sorted.push_back(frames[i].*time);
+	}
+
+	Statistics statistics = {};
+	if (sorted.empty()) {
+		return statistics;
+	}
+
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (float value : sorted) {
+		sum += value;
+	}
+
+	statistics.mean = static_cast<float>(sum / sorted.size());
+	statistics.min = sorted.front();
+	statistics.p50 = getPercentile(sorted, 50.0f);
+	statistics.p90 = getPercentile(sorted, 90.0f);
+	statistics.p95 = getPercentile(sorted, 95.0f);
+	statistics.p99 = getPercentile(sorted, 99.0f);
+	statistics.max = sorted.back();
+
+	return statistics;
+}
+
+void Benchmark::writeCSV(std::string outputPath)
+{
+	std::ofstream file(outputPath, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("ERROR: cannot write benchmark results \"" + outputPath + "\".");
+	}
+
+	// Per-frame table, then the summary table after an empty line
+	file << "frame,frame_ms,cpu_ms,gpu_ms\n";
+	for (size_t i = warmupFrames; i < frames.size(); i++) {
+		file << i - warmupFrames << "," << frames[i].frameTime << "," << frames[i].cpuTime << "," << frames[i].gpuTime << "\n";
+	}
+
+	Statistics statistics[] = {
+		getStatistics(&Frame::frameTime),
+		getStatistics(&Frame::cpuTime),
+		getStatistics(&Frame::gpuTime)
+	};
+
+	const char* names[] = { "mean", "min", "p50", "p90", "p95", "p99", "max" };
+	float Statistics::* values[] = {
+		&Statistics::mean, &Statistics::min, &Statistics::p50, &Statistics::p90,
+		&Statistics::p95, &Statistics::p99, &Statistics::max
+	};
+
+	file << "\nstatistic,frame_ms,cpu_ms,gpu_ms\n";
+	for (size_t i = 0; i < std::size(names); i++) {
+		file << names[i] << "," << statistics[0].*values[i] << "," << statistics[1].*values[i] << "," << statistics[2].*values[i] << "\n";
+	}
+}
+
+void Benchmark::writeJSON(std::string outputPath)
+{
+	std::ofstream file(outputPath, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("ERROR: cannot write benchmark results \"" + outputPath + "\".");
+	}
+
+	auto writeStatistics = [&file](const char* name, const Statistics& statistics) {
+		file << "\t\t\"" << name << "\": { "
+			<< "\"mean\": " << statistics.mean << ", "
+			<< "\"min\": " << statistics.min << ", "
+			<< "\"p50\": " << statistics.p50 << ", "
+			<< "\"p90\": " << statistics.p90 << ", "
+			<< "\"p95\": " << statistics.p95 << ", "
+			<< "\"p99\": " << statistics.p99 << ", "
+			<< "\"max\": " << statistics.max << " }";
+	};
+
+	file << "{\n";
+	file << "\t\"frameCount\": " << frames.size() - warmupFrames << ",\n";
+	file << "\t\"warmupFrames\": " << warmupFrames << ",\n";
+	file << "\t\"summary\": {\n";
+	writeStatistics("frame_ms", getStatistics(&Frame::frameTime));
+	file << ",\n";
+	writeStatistics("cpu_ms", getStatistics(&Frame::cpuTime));
+	file << ",\n";
+	writeStatistics("gpu_ms", getStatistics(&Frame::gpuTime));
+	file << "\n\t},\n";
+
+	file << "\t\"frames\": [\n";
+	for (size_t i = warmupFrames; i < frames.size(); i++) {
+		file << "\t\t{ \"frame_ms\": " << frames[i].frameTime
+			<< ", \"cpu_ms\": " << frames[i].cpuTime
+			<< ", \"gpu_ms\": " << frames[i].gpuTime << " }"
+			<< (i + 1 < frames.size() ? ",\n" : "\n");
+	}
+	file << "\t]\n";
+	file << "}\n";
+}
@@ -56,6 +56,17 @@ void Camera::rotateByMouse(float xOffset, float yOffset)
     updateVectors();
 }
 
+void Camera::lookAt(glm::vec3 position, glm::vec3 target)
+{
+    positionVector = position;
+
+    glm::vec3 direction = glm::normalize(target - position);
+    pitch = glm::degrees(asin(direction.y));
+    yaw = glm::degrees(atan2(direction.z, direction.x));
+
+    updateVectors();
+}
+
 void Camera::updateVectors()
 {
     glm::vec3 front;
@@ -29,6 +29,7 @@ public:
 	glm::mat4 getViewMatrix();
 	void move(CAMERA_MOVEMENT direction, float deltaTime);
 	void rotateByMouse(float xOffset, float yOffset);
+	void lookAt(glm::vec3 position, glm::vec3 target);
 
 private:
 
@@ -0,0 +1,129 @@
+#include "CpuProfiler.h"
+
+#ifdef ENABLE_CPU_PROFILER
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Zones kept per thread, a power of two
+#define CPU_PROFILER_RING_SIZE (1 << 16)
+
+namespace CpuProfiler
+{
+	struct Event
+	{
+		const char* name;
+		int64_t beginTime;
+		int64_t endTime;
+	};
+
+	/*
+		Single producer ring. Only the owning thread writes events and advances head,
+		the release store makes an event visible to writeTrace before its slot is counted.
+	*/
+	struct ThreadBuffer
+	{
+		uint32_t threadIndex;
+		std::atomic<uint64_t> head{ 0 };
+		Event events[CPU_PROFILER_RING_SIZE];
+	};
+
+	// Buffers outlive their threads, so zones of finished worker threads are still dumped
+	static std::mutex buffersMutex;
+	static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+	static int64_t getTime()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()
+		).count();
+	}
+
+	static ThreadBuffer* getThreadBuffer()
+	{
+		// Registration takes the lock once per thread, recording never does
+		thread_local ThreadBuffer* threadBuffer = nullptr;
+		if (!threadBuffer) {
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			buffers.push_back(std::make_unique<ThreadBuffer>());
+			threadBuffer = buffers.back().get();
+			threadBuffer->threadIndex = static_cast<uint32_t>(buffers.size() - 1);
+		}
+		return threadBuffer;
+	}
+
+	Zone::Zone(const char* name)
+	{
+		this->name = name;
+		beginTime = getTime();
+	}
+
+	Zone::~Zone()
+	{
+		int64_t endTime = getTime();
+
+		ThreadBuffer* buffer = getThreadBuffer();
+		uint64_t head = buffer->head.load(std::memory_order_relaxed);
+
+		Event& event = buffer->events[head & (CPU_PROFILER_RING_SIZE - 1)];
+		event.name = name;
+		event.beginTime = beginTime;
+		event.endTime = endTime;
+
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	void writeTrace(std::string tracePath)
+	{
+		std::ofstream file(tracePath, std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "WARNING: cannot write CPU trace \"" << tracePath << "\"." << std::endl;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+
+		int64_t startTime = INT64_MAX;
+		for (const auto& buffer : buffers) {
+			uint64_t head = buffer->head.load(std::memory_order_acquire);
+			uint64_t first = head > CPU_PROFILER_RING_SIZE ? head - CPU_PROFILER_RING_SIZE : 0;
+			if (head > first) {
+				startTime = std::min(startTime, buffer->events[first & (CPU_PROFILER_RING_SIZE - 1)].beginTime);
+			}
+		}
+
+		// Complete ("X") events in microseconds, relative to the oldest zone
+		file << "{\"traceEvents\":[\n";
+		bool isFirst = true;
+		size_t eventCount = 0;
+		for (const auto& buffer : buffers) {
+			file << (isFirst ? "" : ",\n")
+				<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadIndex
+				<< ",\"args\":{\"name\":\"Thread " << buffer->threadIndex << "\"}}";
+			isFirst = false;
+
+			uint64_t head = buffer->head.load(std::memory_order_acquire);
+			uint64_t first = head > CPU_PROFILER_RING_SIZE ? head - CPU_PROFILER_RING_SIZE : 0;
+			for (uint64_t i = first; i < head; i++) {
+				const Event& event = buffer->events[i & (CPU_PROFILER_RING_SIZE - 1)];
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadIndex
+					<< ",\"ts\":" << (event.beginTime - startTime) / 1000.0
+					<< ",\"dur\":" << (event.endTime - event.beginTime) / 1000.0 << "}";
+				eventCount++;
+			}
+		}
+		file << "\n]}\n";
+
+		std::cout << "CpuProfiler >> " << eventCount << " zones written to \"" << tracePath << "\"" << std::endl;
+	}
+}
+
+#endif
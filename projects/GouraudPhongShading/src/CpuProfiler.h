@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+	Scoped CPU zones written as a Chrome trace (chrome://tracing, https://ui.perfetto.dev).
+
+	PROFILE_SCOPE("name") times the enclosing block, PROFILE_FUNCTION() the enclosing function.
+	Every thread writes its zones to a ring buffer of its own without locks, the newest zones
+	overwrite the oldest once it is full. PROFILE_WRITE_TRACE(path) dumps all threads, call it
+	when no other thread is recording.
+
+	Everything compiles to nothing unless ENABLE_CPU_PROFILER is defined (CMake option of the same name).
+	Zone names must be string literals or otherwise outlive the trace dump.
+*/
+
+#ifdef ENABLE_CPU_PROFILER
+
+// std
+#include <string>
+#include <cstdint>
+
+namespace CpuProfiler
+{
+	class Zone
+	{
+	public:
+
+		Zone(const char* name);
+		~Zone();
+
+	private:
+
+		const char* name;
+		int64_t beginTime;
+	};
+
+	void writeTrace(std::string tracePath);
+}
+
+#define CPU_PROFILER_CONCAT_IMPL(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_IMPL(a, b)
+
+#define PROFILE_SCOPE(name) CpuProfiler::Zone CPU_PROFILER_CONCAT(profilerZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#define PROFILE_WRITE_TRACE(tracePath) CpuProfiler::writeTrace(tracePath)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_WRITE_TRACE(tracePath)
+
+#endif
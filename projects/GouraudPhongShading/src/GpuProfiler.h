@@ -0,0 +1,102 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+/*
+	GPU timings of named scopes (render passes, subpasses) from timestamp queries.
+
+	Every frame in flight has a query pool of its own. Recording a frame resets its pool and writes a timestamp
+	at the beginning and end of the frame and of every scope. Results are read when the frame's fence has signaled,
+	so reading never waits for the GPU. Scope times are accumulated and averaged on flushAverages(), which also
+	appends a row to the CSV log.
+
+	Timestamps inside a render pass are only as precise as the hardware allows: tile based GPUs
+	may report the whole render pass for every subpass.
+*/
+class GpuProfiler
+{
+public:
+
+	struct Scope
+	{
+		std::string name;
+		// Milliseconds of the last read frame, negative when the scope was not recorded in it
+		float time = -1.0f;
+		float averageTime = 0.0f;
+		double timeSum = 0.0;
+		uint32_t timeCount = 0;
+	};
+
+	GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameCount, uint32_t maxScopes = 16);
+	~GpuProfiler();
+
+	// Must be recorded outside of a render pass, resets the queries of the frame
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t frameNumber);
+	void endFrame(VkCommandBuffer commandBuffer);
+
+	void beginScope(VkCommandBuffer commandBuffer, const char* name);
+	void endScope(VkCommandBuffer commandBuffer);
+
+	// Read the last frame recorded for frameIndex, only call after its fence signaled. False when there is nothing to read
+	bool readFrame(uint32_t frameIndex);
+
+	// Average the accumulated scope times, append them to the log and start accumulating again
+	void flushAverages();
+	void openLog(std::string logPath);
+
+	// "name 1.23 ms | name 0.45 ms" of the averages
+	std::string getSummary();
+
+	// Getters
+	bool isSupported() { return timestampPeriod > 0.0f; }
+	const std::vector<Scope>& getScopes() { return scopes; }
+	// Of the last read frame
+	float getFrameTime() { return frameTime; }
+	uint32_t getFrameNumber() { return frameNumber; }
+
+private:
+
+	struct ScopeQuery
+	{
+		uint32_t scope;
+		uint32_t beginQuery;
+		uint32_t endQuery;
+	};
+
+	struct Frame
+	{
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		std::vector<ScopeQuery> scopeQueries;
+		uint32_t queryCount = 0;
+		int64_t frameNumber = -1;
+	};
+
+	VkDevice device;
+	float timestampPeriod = 0.0f;
+	uint64_t timestampMask = 0;
+	uint32_t maxQueries;
+
+	std::vector<Frame> frames;
+	Frame* recordingFrame = nullptr;
+	std::vector<uint32_t> openScopes;
+
+	std::vector<Scope> scopes;
+	float frameTime = -1.0f;
+	uint32_t frameNumber = 0;
+	double frameTimeSum = 0.0;
+	uint32_t frameTimeCount = 0;
+	float averageFrameTime = 0.0f;
+
+	std::ofstream logFile;
+	size_t loggedScopeCount = 0;
+	uint32_t flushCount = 0;
+
+	uint32_t getScope(const char* name);
+	float toMilliseconds(uint64_t begin, uint64_t end);
+};
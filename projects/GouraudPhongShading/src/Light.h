@@ -1,9 +1,5 @@
 #pragma once
 
-// std
-#include <array>
-
-#include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
 class Light
@@ -16,23 +12,15 @@ public:
 		alignas(16) glm::vec3 color;
 	};
 	
-	Light(VkDevice device, VkPhysicalDevice physicalDevice, glm::vec3 position, glm::vec3 color);
-	~Light();
+	Light(glm::vec3 position, glm::vec3 color);
 
 	// Getters
 	glm::vec3 getPostion() { return properties.position; }
 	glm::vec3 getColor() { return properties.color; }
-	VkBuffer getBuffer() { return buffer; }
+	// Written to the uniform ring every frame by the renderer
+	const Properties& getProperties() { return properties; }
 
 private:
 
 	Properties properties;
-	
-	VkDevice device;
-	VkPhysicalDevice physicalDevice;
-	VkBuffer buffer;
-	VkDeviceMemory bufferMemory;
-
-	void createBuffer();
 };
-
@@ -0,0 +1,191 @@
+#include "MeshArena.h"
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+MeshArena::MeshArena(
+	VkDevice device,
+	MemoryAllocator* allocator,
+	VkCommandPool commandPool,
+	VkQueue queue,
+	uint32_t vertexStride,
+	MEMORY_MODE memoryMode,
+	uint32_t vertexCapacity,
+	uint32_t indexCapacity)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->commandPool = commandPool;
+	this->queue = queue;
+	this->memoryMode = memoryMode;
+
+	vertexBuffer.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	vertexBuffer.stride = vertexStride;
+	grow(vertexBuffer, vertexCapacity);
+
+	indexBuffer.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	indexBuffer.stride = sizeof(uint32_t);
+	grow(indexBuffer, indexCapacity);
+}
+
+MeshArena::~MeshArena()
+{
+	for (ArenaBuffer* arenaBuffer : { &vertexBuffer, &indexBuffer }) {
+		vkDestroyBuffer(device, arenaBuffer->buffer, nullptr);
+		allocator->free(arenaBuffer->allocation);
+	}
+}
+
+uint32_t MeshArena::addVertices(const void* vertexData, uint32_t vertexCount)
+{
+	return append(vertexBuffer, vertexData, vertexCount);
+}
+
+uint32_t MeshArena::addIndices(const uint32_t* indexData, uint32_t indexCount)
+{
+	return append(indexBuffer, indexData, indexCount);
+}
+
+uint32_t MeshArena::append(ArenaBuffer& arenaBuffer, const void* data, uint32_t count)
+{
+	if (uint64_t(arenaBuffer.count) + count > arenaBuffer.capacity) {
+		grow(arenaBuffer, std::max(arenaBuffer.capacity * 2, arenaBuffer.count + count));
+	}
+
+	uint32_t first = arenaBuffer.count;
+	VkDeviceSize offset = VkDeviceSize(first) * arenaBuffer.stride;
+	VkDeviceSize size = VkDeviceSize(count) * arenaBuffer.stride;
+
+	if (size > 0) {
+		if (memoryMode == HOST_VISIBLE) {
+			memcpy(static_cast<char*>(arenaBuffer.allocation.mapped) + offset, data, (size_t)size);
+		}
+		else {
+			VkBuffer stagingBuffer;
+			MemoryAllocator::Allocation stagingBufferAllocation;
+			createBuffer(
+				size,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				stagingBuffer,
+				stagingBufferAllocation
+			);
+
+			memcpy(stagingBufferAllocation.mapped, data, (size_t)size);
+
+			copyBuffer(stagingBuffer, 0, arenaBuffer.buffer, offset, size);
+
+			vkDestroyBuffer(device, stagingBuffer, nullptr);
+			allocator->free(stagingBufferAllocation);
+		}
+	}
+
+	arenaBuffer.count += count;
+
+	return first;
+}
+
+void MeshArena::grow(ArenaBuffer& arenaBuffer, uint32_t capacity)
+{
+	VkBuffer buffer;
+	MemoryAllocator::Allocation bufferAllocation;
+
+	VkMemoryPropertyFlags properties = memoryMode == HOST_VISIBLE
+		? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		: VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	// Device local buffers are written by copies, from staging buffers or the buffer they replace
+	VkBufferUsageFlags usage = arenaBuffer.usage;
+	if (memoryMode == DEVICE_LOCAL) {
+		usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	}
+
+	createBuffer(VkDeviceSize(capacity) * arenaBuffer.stride, usage, properties, buffer, bufferAllocation);
+
+	if (arenaBuffer.buffer != VK_NULL_HANDLE) {
+		VkDeviceSize usedSize = VkDeviceSize(arenaBuffer.count) * arenaBuffer.stride;
+		if (usedSize > 0) {
+			if (memoryMode == HOST_VISIBLE) {
+				memcpy(bufferAllocation.mapped, arenaBuffer.allocation.mapped, (size_t)usedSize);
+			}
+			else {
+				copyBuffer(arenaBuffer.buffer, 0, buffer, 0, usedSize);
+			}
+		}
+
+		vkDestroyBuffer(device, arenaBuffer.buffer, nullptr);
+		allocator->free(arenaBuffer.allocation);
+
+		std::cout << "MeshArena >> " << (arenaBuffer.usage == VK_BUFFER_USAGE_VERTEX_BUFFER_BIT ? "vertex" : "index")
+			<< " buffer grown to " << capacity << " elements" << std::endl;
+	}
+
+	arenaBuffer.buffer = buffer;
+	arenaBuffer.allocation = bufferAllocation;
+	arenaBuffer.capacity = capacity;
+}
+
+void MeshArena::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocator::Allocation& bufferAllocation)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &buffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Mesh Arena Buffer.");
+	}
+
+	bufferAllocation = allocator->allocateBuffer(buffer, properties);
+}
+
+void MeshArena::copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer copyCommandBuffer;
+	VkResult result = vkAllocateCommandBuffers(device, &allocateInfo, &copyCommandBuffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot allocate Copy Command Buffer.");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(copyCommandBuffer, &beginInfo);
+		VkBufferCopy region = {};
+		region.srcOffset = srcOffset;
+		region.dstOffset = dstOffset;
+		region.size = size;
+
+		vkCmdCopyBuffer(copyCommandBuffer, srcBuffer, dstBuffer, 1, &region);
+	vkEndCommandBuffer(copyCommandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &copyCommandBuffer;
+
+	// Flush Command Buffer
+	VkFence fence;
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkCreateFence(device, &fenceInfo, nullptr, &fence);
+
+	vkQueueSubmit(queue, 1, &submitInfo, fence);
+
+	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+	vkDestroyFence(device, fence, nullptr);
+
+	vkFreeCommandBuffers(device, commandPool, 1, &copyCommandBuffer);
+}
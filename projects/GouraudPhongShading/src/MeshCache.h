@@ -0,0 +1,76 @@
+#pragma once
+
+// std
+#include <string>
+#include <cstdint>
+
+/*
+	Binary cache of a parsed mesh, stored next to the source model ("head.obj" -> "head.obj.meshcache").
+
+	File layout: Header, packed vertex blob, packed index blob. The cache is only valid while
+	the source path, size, modification time and vertex layout match the ones it was written with.
+	On a warm start the file is memory mapped and the blobs are copied straight to the GPU.
+*/
+class MeshCache
+{
+public:
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourcePathHash;
+		uint64_t sourceSize;
+		int64_t sourceModifyTime;
+		uint32_t vertexLayout;
+		uint32_t vertexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t emittedVertexCount;
+		uint32_t reserved;
+		// Dequantization constants of packed vertex formats
+		float vertexDecode[12];
+		// Center and radius in model space
+		float boundingSphere[4];
+		// Min and max corners in model space
+		float boundingBox[6];
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+	};
+
+	MeshCache(std::string sourcePath, uint32_t vertexLayout, uint32_t vertexStride);
+	~MeshCache();
+
+	bool load();
+	void save(const void* vertexData, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount, uint32_t emittedVertexCount, const void* vertexDecode, const void* boundingSphere, const void* boundingBox);
+	void release();
+
+	const void* getVertexData() { return mappedData + header.vertexOffset; }
+	const uint32_t* getIndexData() { return reinterpret_cast<const uint32_t*>(mappedData + header.indexOffset); }
+	uint32_t getVertexCount() { return header.vertexCount; }
+	uint32_t getIndexCount() { return header.indexCount; }
+	uint32_t getEmittedVertexCount() { return header.emittedVertexCount; }
+	const void* getVertexDecode() { return header.vertexDecode; }
+	const void* getBoundingSphere() { return header.boundingSphere; }
+	const void* getBoundingBox() { return header.boundingBox; }
+	std::string getCachePath() { return cachePath; }
+
+private:
+
+	std::string sourcePath;
+	std::string cachePath;
+	Header header = {};
+
+	const uint8_t* mappedData = nullptr;
+	size_t mappedSize = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+	bool readSourceStamp(Header& stamp);
+	bool mapFile();
+	void unmapFile();
+};
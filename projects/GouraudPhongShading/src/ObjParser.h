@@ -0,0 +1,81 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+
+#include "Model.h"
+
+/*
+	Multi-threaded Wavefront OBJ reader.
+
+	The file is split into chunks on line boundaries and every chunk is parsed on its own thread
+	("v", "vt", "vn" and "f" records). Chunk results are merged with prefix sums over the per-chunk
+	record counts, which also resolves relative (negative) indices. Face corners are then welded
+	into the same vertices/indices that Model produced from tinyobj.
+*/
+class ObjParser
+{
+public:
+
+	ObjParser(std::string modelPath, uint32_t threadCount = 0);
+
+	std::vector<Vertex>& getVertices() { return vertices; }
+	std::vector<uint32_t>& getIndices() { return indices; }
+	uint32_t getEmittedVertexCount() { return static_cast<uint32_t>(indices.size()); }
+
+private:
+
+	struct Corner
+	{
+		int32_t position;
+		int32_t texCoord;
+		int32_t normal;
+		// Bit per attribute, set when the index is relative to the end of the chunk's records
+		uint32_t relativeMask;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<float> positions;
+		std::vector<float> texCoords;
+		std::vector<float> normals;
+		std::vector<Corner> corners;
+		// Offsets of the first corner of every quad in corners
+		std::vector<size_t> quads;
+
+		size_t positionOffset;
+		size_t texCoordOffset;
+		size_t normalOffset;
+		size_t cornerOffset;
+
+		std::string error;
+	};
+
+	std::string modelPath;
+	uint32_t threadCount;
+
+	std::vector<char> fileData;
+	std::vector<Chunk> chunks;
+
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+	std::vector<float> normals;
+	std::vector<Vertex> cornerVertices;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	void readFile();
+	void splitChunks();
+	void parseChunk(Chunk& chunk);
+	void mergeChunks();
+	void splitQuads(Chunk& chunk);
+	void weldVertices();
+
+	template<typename Function>
+	void parallelFor(size_t count, Function function);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+/*
+	VkPipelineCache persisted across runs ("pipeline_<vendorID>_<deviceID>.pipelinecache" in the working directory).
+
+	File layout: Header, then the blob returned by vkGetPipelineCacheData. The blob is only handed back to
+	the driver when the header matches the current vendor, device, driver version and pipelineCacheUUID and
+	the blob hash is intact; otherwise the file is ignored and rewritten on save. The header also keeps the
+	pipeline creation time of the run that started without a cache, to report the time saved by warm starts.
+*/
+class PipelineCache
+{
+public:
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash;
+		// Pipeline creation time without a cache, in milliseconds
+		float coldCreateTime;
+		uint32_t reserved;
+	};
+
+	PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice);
+	~PipelineCache();
+
+	// Report how long pipeline creation took and how much of it the cache saved
+	void logCreateTime(float milliseconds);
+	void save();
+
+	// Getters
+	VkPipelineCache getCache() { return pipelineCache; }
+	bool isWarm() { return isLoaded; }
+
+private:
+
+	VkDevice device;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	std::string cachePath;
+	Header header = {};
+	bool isLoaded = false;
+
+	bool load(std::vector<char>& data);
+	bool isDataHeaderValid(const std::vector<char>& data);
+	void createCache(const std::vector<char>& data);
+};
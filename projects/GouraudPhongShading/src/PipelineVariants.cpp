@@ -0,0 +1,256 @@
+#include "PipelineVariants.h"
+
+// std
+#include <stdexcept>
+#include <array>
+
+#include "Shader.h"
+
+static void hashData(uint64_t& hash, const void* data, size_t size)
+{
+	// FNV-1a, continued from the hash so far
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+template<typename T>
+static void hashValue(uint64_t& hash, const T& value)
+{
+	hashData(hash, &value, sizeof(T));
+}
+
+PipelineVariants::PipelineVariants(VkDevice device, VkPipelineCache pipelineCache, bool isExtendedDynamicState)
+{
+	this->device = device;
+	this->pipelineCache = pipelineCache;
+	this->extendedDynamicState = isExtendedDynamicState;
+}
+
+PipelineVariants::~PipelineVariants()
+{
+	for (auto& [hash, pipeline] : pipelines) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+}
+
+VkPipeline PipelineVariants::get(const Description& description)
+{
+	uint64_t hash = hashStaticState(description);
+
+	auto pipelineIt = pipelines.find(hash);
+	if (pipelineIt != pipelines.end()) {
+		return pipelineIt->second;
+	}
+
+	VkPipeline pipeline = createPipeline(description);
+	pipelines[hash] = pipeline;
+
+	return pipeline;
+}
+
+void PipelineVariants::setDynamicState(VkCommandBuffer commandBuffer, const Description& description, VkExtent2D extent)
+{
+	VkViewport viewport = {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.extent = extent;
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	if (!extendedDynamicState) {
+		return;
+	}
+
+	vkCmdSetCullMode(commandBuffer, description.cullMode);
+	if (description.hasDepth) {
+		vkCmdSetDepthTestEnable(commandBuffer, description.depthTestEnable ? VK_TRUE : VK_FALSE);
+		vkCmdSetDepthWriteEnable(commandBuffer, description.depthWriteEnable ? VK_TRUE : VK_FALSE);
+		vkCmdSetDepthCompareOp(commandBuffer, description.depthCompareOp);
+	}
+}
+
+uint64_t PipelineVariants::hashStaticState(const Description& description)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	// Lengths go first, so neighbouring fields cannot run into each other
+	hashValue(hash, description.vertShaderPath.size());
+	hashData(hash, description.vertShaderPath.data(), description.vertShaderPath.size());
+	hashValue(hash, description.fragShaderPath.size());
+	hashData(hash, description.fragShaderPath.data(), description.fragShaderPath.size());
+
+	hashValue(hash, description.bindingDescriptions.size());
+	for (const VkVertexInputBindingDescription& binding : description.bindingDescriptions) {
+		hashValue(hash, binding.binding);
+		hashValue(hash, binding.stride);
+		hashValue(hash, binding.inputRate);
+	}
+	hashValue(hash, description.attributeDescriptions.size());
+	for (const VkVertexInputAttributeDescription& attribute : description.attributeDescriptions) {
+		hashValue(hash, attribute.location);
+		hashValue(hash, attribute.binding);
+		hashValue(hash, attribute.format);
+		hashValue(hash, attribute.offset);
+	}
+
+	hashValue(hash, description.layout);
+	hashValue(hash, description.renderPass);
+	hashValue(hash, description.subpass);
+	hashValue(hash, description.colorAttachmentCount);
+	hashValue(hash, description.samples);
+	hashValue(hash, description.hasDepth);
+
+	if (!extendedDynamicState) {
+		hashValue(hash, description.cullMode);
+		if (description.hasDepth) {
+			hashValue(hash, description.depthTestEnable);
+			hashValue(hash, description.depthWriteEnable);
+			hashValue(hash, description.depthCompareOp);
+		}
+	}
+
+	return hash;
+}
+
+VkPipeline PipelineVariants::createPipeline(const Description& description)
+{
+	Shader vertShader(device, description.vertShaderPath);
+	Shader fragShader(device, description.fragShaderPath);
+
+	VkPipelineShaderStageCreateInfo vertStageInfo = {};
+	vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertStageInfo.module = vertShader.getShaderModule();
+	vertStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo fragStageInfo = {};
+	fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragStageInfo.module = fragShader.getShaderModule();
+	fragStageInfo.pName = "main";
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = { vertStageInfo, fragStageInfo };
+
+	// VERTEX INPUT STATE
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(description.bindingDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = description.bindingDescriptions.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.attributeDescriptions.size());
+	vertexInputInfo.pVertexAttributeDescriptions = description.attributeDescriptions.data();
+
+	// INPUT ASSEMBLY STATE
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+	// VIEWPORT STATE
+	VkPipelineViewportStateCreateInfo viewportInfo = {};
+	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportInfo.viewportCount = 1;
+	viewportInfo.pViewports = nullptr;
+	viewportInfo.scissorCount = 1;
+	viewportInfo.pScissors = nullptr;
+
+	// RASTERIZATION STATE
+	VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
+	rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizationInfo.depthClampEnable = VK_FALSE;
+	rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
+	rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizationInfo.cullMode = description.cullMode;
+	rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizationInfo.depthBiasEnable = VK_FALSE;
+	rasterizationInfo.lineWidth = 1.0f;
+
+	// MULTISAMPLE STATE
+	VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+	multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampleInfo.sampleShadingEnable = VK_FALSE;
+	multisampleInfo.rasterizationSamples = description.samples;
+
+	// DEPTH STENCIL STATE
+	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilInfo.depthTestEnable = description.depthTestEnable ? VK_TRUE : VK_FALSE;
+	depthStencilInfo.depthWriteEnable = description.depthWriteEnable ? VK_TRUE : VK_FALSE;
+	depthStencilInfo.depthCompareOp = description.depthCompareOp;
+	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilInfo.stencilTestEnable = VK_FALSE;
+
+	// COLOR BLEND STATE
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.blendEnable = VK_FALSE;
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+		| VK_COLOR_COMPONENT_G_BIT
+		| VK_COLOR_COMPONENT_B_BIT
+		| VK_COLOR_COMPONENT_A_BIT;
+
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachmentStates(description.colorAttachmentCount, colorBlendAttachment);
+
+	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendInfo.logicOpEnable = VK_FALSE;
+	colorBlendInfo.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
+	colorBlendInfo.pAttachments = blendAttachmentStates.data();
+
+	// DYNAMIC STATE
+	std::vector<VkDynamicState> dynamicStates = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+	if (extendedDynamicState) {
+		dynamicStates.push_back(VK_DYNAMIC_STATE_CULL_MODE);
+		if (description.hasDepth) {
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP);
+		}
+	}
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+	// GRAPHICS PIPELINE
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+	pipelineInfo.pTessellationState = nullptr;
+	pipelineInfo.pViewportState = &viewportInfo;
+	pipelineInfo.pRasterizationState = &rasterizationInfo;
+	pipelineInfo.pMultisampleState = &multisampleInfo;
+	pipelineInfo.pDepthStencilState = description.hasDepth ? &depthStencilInfo : nullptr;
+	pipelineInfo.pColorBlendState = &colorBlendInfo;
+	pipelineInfo.pDynamicState = &dynamicStateInfo;
+	pipelineInfo.layout = description.layout;
+	pipelineInfo.renderPass = description.renderPass;
+	pipelineInfo.subpass = description.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Pipeline Variant.");
+	}
+
+	return pipeline;
+}
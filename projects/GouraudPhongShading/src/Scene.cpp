@@ -0,0 +1,155 @@
+#include "Scene.h"
+
+// std
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#include "CpuProfiler.h"
+
+Scene::Scene(VkDevice device, MemoryAllocator* allocator, uint32_t frameCount)
+{
+	this->device = device;
+	this->allocator = allocator;
+
+	instanceBuffers.resize(frameCount);
+}
+
+Scene::~Scene()
+{
+	for (InstanceBuffer& instanceBuffer : instanceBuffers) {
+		destroyInstanceBuffer(instanceBuffer);
+	}
+
+	for (Mesh& mesh : meshes) {
+		delete mesh.texture;
+		delete mesh.model;
+	}
+}
+
+uint32_t Scene::addMesh(Model* model, Texture* texture)
+{
+	meshes.push_back({ model, texture });
+	return static_cast<uint32_t>(meshes.size()) - 1;
+}
+
+uint32_t Scene::addInstance(uint32_t meshIndex, const glm::mat4& transform)
+{
+	if (meshIndex >= meshes.size()) {
+		throw std::runtime_error("ERROR: Scene instance refers to a missing mesh.");
+	}
+
+	instances.push_back({ meshIndex, transform });
+	isBatchesDirty = true;
+	isInstanceDataDirty = true;
+	version++;
+
+	return static_cast<uint32_t>(instances.size()) - 1;
+}
+
+void Scene::setTransform(uint32_t instanceIndex, const glm::mat4& transform)
+{
+	instances[instanceIndex].transform = transform;
+	isInstanceDataDirty = true;
+	version++;
+}
+
+void Scene::update(uint32_t frameIndex)
+{
+	PROFILE_FUNCTION();
+
+	if (isBatchesDirty) {
+		buildBatches();
+	}
+
+	if (isInstanceDataDirty) {
+		instanceData.resize(instances.size());
+		for (uint32_t i = 0; i < instanceData.size(); i++) {
+			const Instance& instance = instances[drawOrder[i]];
+			instanceData[i] = { instance.transform, instance.meshIndex, { 0, 0, 0 } };
+		}
+		isInstanceDataDirty = false;
+	}
+
+	InstanceBuffer& instanceBuffer = instanceBuffers[frameIndex];
+	if (instanceBuffer.version == version) {
+		return;
+	}
+
+	uint32_t instanceCount = getInstanceCount();
+
+	// The frame's fence was waited on, so its old buffer can go right away
+	if (instanceCount > instanceBuffer.capacity) {
+		// Before destroying, which zeroes the capacity
+		uint32_t capacity = std::max(instanceCount, instanceBuffer.capacity * 2);
+		destroyInstanceBuffer(instanceBuffer);
+		createInstanceBuffer(instanceBuffer, capacity);
+	}
+
+	if (instanceCount > 0) {
+		memcpy(instanceBuffer.allocation.mapped, instanceData.data(), instanceCount * sizeof(InstanceData));
+	}
+	instanceBuffer.version = version;
+}
+
+void Scene::buildBatches()
+{
+	/*
+		Counting sort of the instances by mesh. Every mesh with instances becomes one batch,
+		and drawOrder lists the instances in the order their transforms go to the instance buffer.
+	*/
+	std::vector<uint32_t> meshInstanceCounts(meshes.size(), 0);
+	for (const Instance& instance : instances) {
+		meshInstanceCounts[instance.meshIndex]++;
+	}
+
+	batches.clear();
+	std::vector<uint32_t> meshOffsets(meshes.size(), 0);
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < meshes.size(); i++) {
+		meshOffsets[i] = offset;
+		if (meshInstanceCounts[i] > 0) {
+			batches.push_back({ i, offset, meshInstanceCounts[i] });
+		}
+		offset += meshInstanceCounts[i];
+	}
+
+	drawOrder.resize(instances.size());
+	for (uint32_t i = 0; i < instances.size(); i++) {
+		drawOrder[meshOffsets[instances[i].meshIndex]++] = i;
+	}
+
+	isBatchesDirty = false;
+}
+
+void Scene::createInstanceBuffer(InstanceBuffer& instanceBuffer, uint32_t capacity)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = VkDeviceSize(capacity) * sizeof(InstanceData);
+	// Vertex input of recorded draws, storage buffer input of GPU culling
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &instanceBuffer.buffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Instance Buffer.");
+	}
+
+	instanceBuffer.allocation = allocator->allocateBuffer(instanceBuffer.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	instanceBuffer.capacity = capacity;
+}
+
+void Scene::destroyInstanceBuffer(InstanceBuffer& instanceBuffer)
+{
+	if (instanceBuffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDestroyBuffer(device, instanceBuffer.buffer, nullptr);
+	allocator->free(instanceBuffer.allocation);
+
+	instanceBuffer.buffer = VK_NULL_HANDLE;
+	instanceBuffer.capacity = 0;
+	instanceBuffer.version = 0;
+}
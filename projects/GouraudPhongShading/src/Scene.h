@@ -0,0 +1,102 @@
+#pragma once
+
+// std
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "Model.h"
+#include "Texture.h"
+#include "MemoryAllocator.h"
+
+/*
+	Meshes and the instances placed in the world.
+
+	Instances are grouped by mesh, so every mesh is drawn with one instanced vkCmdDrawIndexed
+	no matter how many copies of it there are. The transforms of a group are contiguous in the
+	instance buffer of the frame, starting at the group's firstInstance.
+
+	Every frame in flight has a persistently mapped instance buffer of its own. update() rewrites it
+	after the frame's fence was waited on, and only when instances changed since it was last written,
+	so a static scene costs nothing per frame however many instances it has.
+*/
+class Scene
+{
+public:
+
+	// Instances of one mesh, drawn with a single instanced draw
+	struct Batch
+	{
+		uint32_t meshIndex;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	Scene(VkDevice device, MemoryAllocator* allocator, uint32_t frameCount);
+	~Scene();
+
+	// The scene takes ownership of model and texture, returns the mesh index
+	uint32_t addMesh(Model* model, Texture* texture);
+	// Returns the instance index
+	uint32_t addInstance(uint32_t meshIndex, const glm::mat4& transform);
+	void setTransform(uint32_t instanceIndex, const glm::mat4& transform);
+
+	// Bring the instance buffer of the given frame up to date
+	void update(uint32_t frameIndex);
+
+	// Getters
+	Model* getModel(uint32_t meshIndex) { return meshes[meshIndex].model; }
+	Texture* getTexture(uint32_t meshIndex) { return meshes[meshIndex].texture; }
+	uint32_t getMeshCount() { return static_cast<uint32_t>(meshes.size()); }
+	uint32_t getInstanceCount() { return static_cast<uint32_t>(instances.size()); }
+	const std::vector<Batch>& getBatches() { return batches; }
+	// Instances in batch order, as in the instance buffers (valid after update())
+	const std::vector<InstanceData>& getInstanceData() { return instanceData; }
+	VkBuffer getInstanceBuffer(uint32_t frameIndex) { return instanceBuffers[frameIndex].buffer; }
+	// Changes whenever instances are added or moved
+	uint64_t getVersion() { return version; }
+
+private:
+
+	struct Mesh
+	{
+		Model* model;
+		Texture* texture;
+	};
+
+	struct Instance
+	{
+		uint32_t meshIndex;
+		glm::mat4 transform;
+	};
+
+	struct InstanceBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation allocation;
+		uint32_t capacity = 0;
+		// Scene version the buffer holds
+		uint64_t version = 0;
+	};
+
+	VkDevice device;
+	MemoryAllocator* allocator;
+
+	std::vector<Mesh> meshes;
+	std::vector<Instance> instances;
+	std::vector<Batch> batches;
+	// Instance indices in batch order
+	std::vector<uint32_t> drawOrder;
+	std::vector<InstanceData> instanceData;
+	bool isBatchesDirty = false;
+	bool isInstanceDataDirty = false;
+	// Bumped on every change to the instances
+	uint64_t version = 1;
+
+	std::vector<InstanceBuffer> instanceBuffers;
+
+	void buildBatches();
+	void createInstanceBuffer(InstanceBuffer& instanceBuffer, uint32_t capacity);
+	void destroyInstanceBuffer(InstanceBuffer& instanceBuffer);
+};
@@ -2,23 +2,142 @@
 
 // std
 #include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
 
-int main()
+static void printUsage(const char* program)
 {
-	const int windowWidth = 800;
-	const int windowHeight = 600;
-	const bool enableValidationLayers = true;
+	std::cerr << "Usage: " << program << " [options]\n"
+		<< "  --headless          render offscreen without a window and benchmark the render loop\n"
+		<< "  --width <pixels>    render width (default 800)\n"
+		<< "  --height <pixels>   render height (default 600)\n"
+		<< "  --frames <count>    headless: measured frames (default 1000)\n"
+		<< "  --warmup <count>    headless: frames rendered before measuring (default 60)\n"
+		<< "  --output <path>     headless: results file, .json for JSON, CSV otherwise (default benchmark.csv)\n"
+		<< "  --instances <count> copies of the model to render (default 1)\n"
+		<< "  --culling <mode>    off, cpu or gpu frustum culling with indirect draws (default gpu)\n"
+		<< "  --vertex-format <f> float, half or fixed vertices, half and fixed are packed (default float)\n"
+		<< "  --no-validation     disable validation layers" << std::endl;
+}
 
-	VulkanRenderer renderer(enableValidationLayers);
+static bool parseNumber(const char* text, int minimum, int& value)
+{
+	char* end = nullptr;
+	long number = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || number < minimum || number > 1000000) {
+		return false;
+	}
+	value = static_cast<int>(number);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int windowWidth = 800;
+	int windowHeight = 600;
+	bool enableValidationLayers = true;
+
+	bool isHeadless = false;
+	int frameCount = 1000;
+	int warmupFrames = 60;
+	int instanceCount = 1;
+	CULLING_MODE cullingMode = CULLING_GPU;
+	VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT;
+	std::string outputPath = "benchmark.csv";
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		bool isValid = true;
+
+		if (strcmp(argv[i], "--headless") == 0) {
+			isHeadless = true;
+		}
+		else if (strcmp(argv[i], "--no-validation") == 0) {
+			enableValidationLayers = false;
+		}
+		else if (strcmp(argv[i], "--width") == 0) {
+			isValid = hasValue && parseNumber(argv[++i], 1, windowWidth);
+		}
+		else if (strcmp(argv[i], "--height") == 0) {
+			isValid = hasValue && parseNumber(argv[++i], 1, windowHeight);
+		}
+		else if (strcmp(argv[i], "--frames") == 0) {
+			isValid = hasValue && parseNumber(argv[++i], 1, frameCount);
+		}
+		else if (strcmp(argv[i], "--warmup") == 0) {
+			isValid = hasValue && parseNumber(argv[++i], 0, warmupFrames);
+		}
+		else if (strcmp(argv[i], "--instances") == 0) {
+			isValid = hasValue && parseNumber(argv[++i], 1, instanceCount);
+		}
+		else if (strcmp(argv[i], "--culling") == 0) {
+			isValid = hasValue;
+			if (hasValue) {
+				i++;
+				if (strcmp(argv[i], "off") == 0) {
+					cullingMode = CULLING_OFF;
+				}
+				else if (strcmp(argv[i], "cpu") == 0) {
+					cullingMode = CULLING_CPU;
+				}
+				else if (strcmp(argv[i], "gpu") == 0) {
+					cullingMode = CULLING_GPU;
+				}
+				else {
+					isValid = false;
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--vertex-format") == 0) {
+			isValid = hasValue;
+			if (hasValue) {
+				i++;
+				if (strcmp(argv[i], "float") == 0) {
+					vertexFormat = VERTEX_FORMAT_FLOAT;
+				}
+				else if (strcmp(argv[i], "half") == 0) {
+					vertexFormat = VERTEX_FORMAT_PACKED_HALF;
+				}
+				else if (strcmp(argv[i], "fixed") == 0) {
+					vertexFormat = VERTEX_FORMAT_PACKED_FIXED;
+				}
+				else {
+					isValid = false;
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--output") == 0) {
+			isValid = hasValue;
+			if (hasValue) {
+				outputPath = argv[++i];
+			}
+		}
+		else {
+			isValid = false;
+		}
+
+		if (!isValid) {
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	VulkanRenderer renderer(enableValidationLayers, static_cast<uint32_t>(instanceCount), cullingMode, vertexFormat);
 
 	try {
-		renderer.start(windowWidth, windowHeight, "Vulkan Learning");
+		if (isHeadless) {
+			renderer.startHeadless(windowWidth, windowHeight, frameCount, warmupFrames, outputPath);
+		}
+		else {
+			renderer.start(windowWidth, windowHeight, "Vulkan Learning");
+		}
 	}
 	catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
-	
+
 
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -3,16 +3,16 @@
 // std
 #include <stdexcept>
 #include <cmath>
+#include <cstring>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
-#include "Utils.hpp"
-
-Texture::Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, uint32_t graphicsQueueIndex, VkQueue queue)
+Texture::Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* allocator, VkCommandPool commandPool, uint32_t graphicsQueueIndex, VkQueue queue)
 {
 	this->device = device;
 	this->physicalDevice = physicalDevice;
+	this->allocator = allocator;
 	this->texturePath = texturePath;
 	this->commandPool = commandPool;
 	this->graphicsQueueIndex = graphicsQueueIndex;
@@ -29,8 +29,8 @@ Texture::~Texture()
 {
 	vkDestroySampler(device, textureSampler, nullptr);
 	vkDestroyImageView(device, textureImageView, nullptr);
-	vkFreeMemory(device, textureImageMemory, nullptr);
 	vkDestroyImage(device, textureImage, nullptr);
+	allocator->free(textureImageAllocation);
 }
 
 VkImageView Texture::getImageView()
@@ -83,29 +83,9 @@ void Texture::createTextureImage()
 		throw std::runtime_error("ERROR: cannot create Texture Image.");
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(device, textureImage, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &textureImageMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Texture Memory.");
-	}
-
-	vkBindImageMemory(device, textureImage, textureImageMemory, 0);
+	textureImageAllocation = allocator->allocateImage(textureImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, imageSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	memcpy(stagingBufferAllocation.mapped, pixels, imageSize);
 
 	stbi_image_free(pixels);
 
@@ -114,8 +94,8 @@ void Texture::createTextureImage()
 	generateMipMaps(textureImage, texWidth, texHeight, mipLevels);
 	//transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
 	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	allocator->free(stagingBufferAllocation);
 }
 
 void Texture::createTextureImageView()
@@ -184,24 +164,7 @@ void Texture::createStagingBuffer(VkDeviceSize bufferSize)
 		throw std::runtime_error("ERROR: cannot create Staging Buffer for Texture.");
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &stagingBufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Staging Buffer Memory.");
-	}
-
-	vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+	stagingBufferAllocation = allocator->allocateBuffer(stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 }
 
 void Texture::createCopyCommandBuffer()
@@ -5,11 +5,13 @@
 
 #include <vulkan/vulkan.h>
 
+#include "MemoryAllocator.h"
+
 class Texture
 {
 public:
 
-	Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, VkCommandPool commandPool, uint32_t graphicsQueueIndex, VkQueue queue);
+	Texture(std::string texturePath, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* allocator, VkCommandPool commandPool, uint32_t graphicsQueueIndex, VkQueue queue);
 	~Texture();
 
 	VkImageView getImageView();
@@ -21,18 +23,19 @@ private:
 	
 	VkDevice device;
 	VkPhysicalDevice physicalDevice;
+	MemoryAllocator* allocator;
 	VkCommandPool commandPool;
 	uint32_t graphicsQueueIndex;
 	VkQueue queue;
 
 	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	MemoryAllocator::Allocation stagingBufferAllocation;
 
 	VkCommandBuffer copyCommandBuffer;
 
 	std::string texturePath;
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
+	MemoryAllocator::Allocation textureImageAllocation;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 	VkExtent3D textureExtent;
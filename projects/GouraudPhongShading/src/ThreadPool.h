@@ -0,0 +1,51 @@
+#pragma once
+
+// std
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+/*
+	Fixed set of worker threads for per-frame jobs.
+
+	run() hands out job indices to the workers and to the calling thread, which works as thread 0,
+	and returns once every job is done. Jobs are claimed one at a time, so uneven jobs balance out.
+	The first exception thrown by a job is rethrown by run().
+*/
+class ThreadPool
+{
+public:
+
+	// threadCount includes the calling thread, 0 uses every hardware thread
+	ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	void run(uint32_t jobCount, const std::function<void(uint32_t jobIndex, uint32_t threadIndex)>& function);
+
+	// Getters
+	uint32_t getThreadCount() { return static_cast<uint32_t>(workers.size()) + 1; }
+
+private:
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	const std::function<void(uint32_t, uint32_t)>* function = nullptr;
+	uint32_t jobCount = 0;
+	std::atomic<uint32_t> nextJob{ 0 };
+	uint32_t busyWorkers = 0;
+	uint64_t generation = 0;
+	bool isStopping = false;
+	std::exception_ptr exception;
+
+	void workerLoop(uint32_t threadIndex);
+	void runJobs(uint32_t threadIndex);
+};
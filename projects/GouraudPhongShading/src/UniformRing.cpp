@@ -0,0 +1,67 @@
+#include "UniformRing.h"
+
+// std
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+UniformRing::UniformRing(VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator* allocator, uint32_t frameCount, VkDeviceSize frameSize)
+{
+	this->device = device;
+	this->allocator = allocator;
+
+	VkPhysicalDeviceProperties deviceProperties = {};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	alignment = std::max<VkDeviceSize>(1, deviceProperties.limits.minUniformBufferOffsetAlignment);
+
+	// Frame regions start on an aligned offset so the first allocation of every frame is aligned too
+	this->frameSize = alignUp(frameSize, alignment);
+
+	createBuffer(frameCount);
+}
+
+UniformRing::~UniformRing()
+{
+	vkDestroyBuffer(device, buffer, nullptr);
+	allocator->free(bufferAllocation);
+}
+
+void UniformRing::beginFrame(uint32_t frameIndex)
+{
+	frameBegin = frameIndex * frameSize;
+	head = frameBegin;
+}
+
+uint32_t UniformRing::allocate(const void* data, VkDeviceSize size)
+{
+	VkDeviceSize offset = alignUp(head, alignment);
+	if (offset + size > frameBegin + frameSize) {
+		throw std::runtime_error("ERROR: Uniform Ring frame is full.");
+	}
+
+	memcpy(static_cast<char*>(bufferAllocation.mapped) + offset, data, size);
+	head = offset + size;
+
+	return static_cast<uint32_t>(offset);
+}
+
+void UniformRing::createBuffer(uint32_t frameCount)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = frameSize * frameCount;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &buffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot create Uniform Ring Buffer.");
+	}
+
+	bufferAllocation = allocator->allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
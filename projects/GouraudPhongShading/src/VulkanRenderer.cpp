@@ -7,22 +7,32 @@
 #include <algorithm>
 #include <set>
 #include <chrono>
+#include <cmath>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include "Utils.hpp"
 #include "Shader.h"
+#include "CpuProfiler.h"
 #include "Model.h"
 
 #define FRAMES_IN_FLIGHT 2
+// Smallest share of the scene's instances worth recording on a thread of its own
+#define MIN_INSTANCES_PER_THREAD 64
 #define MSSA_SAMPLES VK_SAMPLE_COUNT_4_BIT
 
-VulkanRenderer::VulkanRenderer(bool enableValidationLayers)
+VulkanRenderer::VulkanRenderer(bool enableValidationLayers, uint32_t instanceCount, CULLING_MODE cullingMode, VERTEX_FORMAT vertexFormat)
 {
 	this->enableValidationLayers = enableValidationLayers;
+	this->instanceCount = instanceCount;
+	this->vertexFormat = vertexFormat;
+
+	// Culling only feeds the G-buffer pass of the deferred renderer
+	if (cullingMode != CULLING_OFF) {
+		std::cout << "Culling >> not available in the forward renderer, every instance is drawn" << std::endl;
+	}
 }
 
 void VulkanRenderer::start(int windowWidth, int windowHeight, const char* windowTitle)
@@ -39,41 +49,84 @@ void VulkanRenderer::start(int windowWidth, int windowHeight, const char* window
 	initVulkan();
 	loop();
 	cleanup();
+
+	PROFILE_WRITE_TRACE("cpu_trace.json");
+}
+
+void VulkanRenderer::startHeadless(int width, int height, uint32_t frameCount, uint32_t warmupFrames, std::string outputPath)
+{
+	isHeadless = true;
+	offscreenExtent.width = static_cast<uint32_t>(width);
+	offscreenExtent.height = static_cast<uint32_t>(height);
+	camera = new Camera(
+		glm::vec3(0.0f, 0.0f, -5.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		45.0f,
+		height / float(width),
+		0.1f
+	);
+	benchmark = new Benchmark(frameCount, warmupFrames);
+	initVulkan();
+	benchmarkLoop();
+	benchmark->report(outputPath);
+	cleanup();
+
+	PROFILE_WRITE_TRACE("cpu_trace.json");
 }
 
 void VulkanRenderer::initVulkan()
 {
+	PROFILE_FUNCTION();
+
 	createInstance();
 	setupDebugMessenger();
-	createSurface();
+	if (!isHeadless) {
+		createSurface();
+	}
 	choosePhysicalDevice();
 	createLogicalDevice();
-	createSwapchain();
+
+	allocator = new MemoryAllocator(device, device.physicalDevice);
+	uniformRing = new UniformRing(device, device.physicalDevice, allocator, FRAMES_IN_FLIGHT);
+	pipelineCache = new PipelineCache(device, device.physicalDevice);
+	pipelineVariants = new PipelineVariants(device, pipelineCache->getCache(), isExtendedDynamicStateSupported);
+
+	if (isHeadless) {
+		createOffscreenImages();
+	}
+	else {
+		createSwapchain();
+	}
 	createSwapchainImageViews();
 	createRenderPass();
 	createColorResources();
 	createDepthResources();
 	createSwapchainFramebuffers();
 	createDescriptorSetLayout();
+	auto pipelineStartTime = std::chrono::high_resolution_clock::now();
 	createGraphicsPipeline();
+	pipelineCache->logCreateTime(std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - pipelineStartTime).count());
+	std::cout << "Pipelines >> " << pipelineVariants->getVariantCount() << " variants, extended dynamic state " << (pipelineVariants->isExtendedDynamicState() ? "yes" : "no") << std::endl;
 	createCommandPool();
 	createCommandBuffers();
 
+	threadPool = new ThreadPool();
+	createThreadCommandPools();
+
 	light = new Light(
-		device,
-		device.physicalDevice,
 		glm::vec3(1.0f, 1.0f, -3.0f),
 		glm::vec3(1.0f)
 	);
 
-	std::string modelsPath = MODELS_DIR;
-	std::string texturesPath = TEXTURES_DIR;
-
-	createModel(modelsPath + "/head.obj", texturesPath + "/head.tga");
-	createMVPBuffer();
+	createScene();
 	createDescriptorPool();
-	createDescriptorSet();
+	createDescriptorSets();
 	createSyncTools();
+
+	gpuProfiler = new GpuProfiler(device, device.physicalDevice, queues.graphicsQueueIndex.value(), FRAMES_IN_FLIGHT);
+	if (!isHeadless) {
+		gpuProfiler->openLog("gpu_profile.csv");
+	}
 }
 
 void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* windowTitle)
@@ -82,7 +135,7 @@ void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* w
 
 	// GLFW was initialy created for OpenGL. So we should say GLFW that we don't want to use API
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(windowWidth, windowHeight, windowTitle, nullptr, nullptr);
 
@@ -94,6 +147,7 @@ void VulkanRenderer::initWindow(int windowWidth, int windowHeight, const char* w
 
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	glfwSetCursorPosCallback(window, mouseCallback);
+	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 }
 
 void VulkanRenderer::loop()
@@ -106,7 +160,7 @@ void VulkanRenderer::loop()
 		float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
 		startTime = std::chrono::high_resolution_clock::now();
 		processInput(deltaTime);
-		//fpsCounter(deltaTime);
+		fpsCounter(deltaTime);
 		draw();
 	}
 
@@ -115,8 +169,45 @@ void VulkanRenderer::loop()
 	vkDeviceWaitIdle(device);
 }
 
+void VulkanRenderer::benchmarkLoop()
+{
+	/*
+		Same frames as loop(), but the camera follows the benchmark path instead of input.
+		CPU time is the time spent in draw() minus the wait for the frame's fence,
+		frame time is the wall time between the ends of two frames.
+	*/
+	auto previousTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < benchmark->getFrameCount(); i++) {
+		glm::vec3 position;
+		glm::vec3 target;
+		benchmark->getCameraPose(i, position, target);
+		camera->lookAt(position, target);
+
+		auto drawStartTime = std::chrono::high_resolution_clock::now();
+		draw();
+		auto currentTime = std::chrono::high_resolution_clock::now();
+
+		float frameTime = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - previousTime).count();
+		float drawTime = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - drawStartTime).count();
+		benchmark->setCpuTimes(i, frameTime, drawTime - fenceWaitTime);
+		previousTime = currentTime;
+	}
+
+	vkDeviceWaitIdle(device);
+
+	// Timestamps of the last frames in flight
+	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		readFrameTimestamps(i);
+	}
+
+	gpuProfiler->flushAverages();
+	std::cout << "Benchmark >> " << gpuProfiler->getSummary() << std::endl;
+}
+
 void VulkanRenderer::processInput(float deltaTime)
 {
+	PROFILE_FUNCTION();
+
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
@@ -167,6 +258,13 @@ void VulkanRenderer::mouseCallback(GLFWwindow* window, double xpos, double ypos)
 	obj->camera->rotateByMouse(xoffset, yoffset);
 }
 
+void VulkanRenderer::framebufferResizeCallback(GLFWwindow* window, int, int)
+{
+	// Not every platform reports a resize as VK_ERROR_OUT_OF_DATE_KHR
+	VulkanRenderer* obj = (VulkanRenderer*)glfwGetWindowUserPointer(window);
+	obj->isFramebufferResized = true;
+}
+
 void VulkanRenderer::fpsCounter(float deltaTime)
 {
 	static float time = 0;
@@ -176,7 +274,8 @@ void VulkanRenderer::fpsCounter(float deltaTime)
 	if (time >= 1.0f) {
 		std::string msPerFrame = std::to_string(1000.0 / nFrames);
 		std::string FPS = std::to_string(nFrames / time);
-		std::string result = windowTitle + " " + msPerFrame + " ms" + " | " + FPS + " FPS";
+		gpuProfiler->flushAverages();
+		std::string result = windowTitle + " " + msPerFrame + " ms" + " | " + FPS + " FPS | " + gpuProfiler->getSummary();
 		glfwSetWindowTitle(window, result.c_str());
 		nFrames = 0;
 		time = 0.0f;
@@ -185,6 +284,8 @@ void VulkanRenderer::fpsCounter(float deltaTime)
 
 void VulkanRenderer::createInstance()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Instance is a connection point between an app and the vulkan library.
 		All states that specify an application are stored in Instance.
@@ -240,6 +341,8 @@ void VulkanRenderer::createInstance()
 
 void VulkanRenderer::setupDebugMessenger()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		By default Vulkan have no debug information. It is optimization decision.
 		But we can on such features by adding validation layers to out instance.
@@ -259,6 +362,8 @@ void VulkanRenderer::setupDebugMessenger()
 
 void VulkanRenderer::createLogicalDevice()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Logical Device is an interface to the Physical Device.
 	
@@ -283,6 +388,11 @@ void VulkanRenderer::createLogicalDevice()
 		queueInfos.push_back(queueInfo);
 	}
 
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+	// Extended dynamic state is core in 1.3 and needs no feature there
+	isExtendedDynamicStateSupported = properties.apiVersion >= VK_API_VERSION_1_3;
+
 	VkPhysicalDeviceFeatures deviceFeature = {};
 	deviceFeature.samplerAnisotropy = VK_TRUE;
 
@@ -290,8 +400,9 @@ void VulkanRenderer::createLogicalDevice()
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
 	deviceInfo.pQueueCreateInfos = queueInfos.data();
-	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	// Headless mode never presents, so it does not need the swapchain extension
+	deviceInfo.enabledExtensionCount = isHeadless ? 0 : static_cast<uint32_t>(deviceExtensions.size());
+	deviceInfo.ppEnabledExtensionNames = isHeadless ? nullptr : deviceExtensions.data();
 	deviceInfo.pEnabledFeatures = &deviceFeature;
 
 	result = vkCreateDevice(device.physicalDevice, &deviceInfo, nullptr, &device.logicalDevice);
@@ -305,6 +416,8 @@ void VulkanRenderer::createLogicalDevice()
 
 void VulkanRenderer::createSurface()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		The Surface is an object that represents where we want to represent rendered image.
 
@@ -319,6 +432,8 @@ void VulkanRenderer::createSurface()
 
 void VulkanRenderer::createSwapchain()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Swapchain define how images that we present to surface are handeled.
 		It is like a array of images that are waiting to be presented to the screnn.
@@ -370,13 +485,19 @@ void VulkanRenderer::createSwapchain()
 	swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapchainInfo.presentMode = presentMode;
 	swapchainInfo.clipped = VK_TRUE;
-	swapchainInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Lets the presentation engine hand the old swapchain's resources over, it is retired either way
+	VkSwapchainKHR oldSwapchain = swapchain;
+	swapchainInfo.oldSwapchain = oldSwapchain;
 
 	result = vkCreateSwapchainKHR(device, &swapchainInfo, nullptr, &swapchain);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot create Swapchain.");
 	}
 
+	if (oldSwapchain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+	}
+
 	uint32_t swapchainImageCount;
 	vkGetSwapchainImagesKHR(device, swapchain, &swapchainImageCount, nullptr);
 
@@ -387,8 +508,107 @@ void VulkanRenderer::createSwapchain()
 	swapchainExtent = extent;
 }
 
+void VulkanRenderer::recreateSwapchain()
+{
+	PROFILE_FUNCTION();
+
+	/*
+		A minimized window has a framebuffer of size zero, which no swapchain can have,
+		so rendering waits until it is shown again.
+	*/
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while (width == 0 || height == 0) {
+		glfwWaitEvents();
+		glfwGetFramebufferSize(window, &width, &height);
+	}
+
+	auto recreateStartTime = std::chrono::high_resolution_clock::now();
+
+	// The attachments and every framebuffer may still be in use by the frames in flight
+	vkDeviceWaitIdle(device);
+
+	destroySwapchainResources();
+
+	/*
+		The surface format comes from the same surface, so the render pass and the pipelines made for it
+		stay valid. Viewport and scissor are dynamic and the projection follows swapchainExtent every frame.
+	*/
+	createSwapchain();
+	createSwapchainImageViews();
+	createColorResources();
+	createDepthResources();
+	createSwapchainFramebuffers();
+
+	isFramebufferResized = false;
+
+	float recreateTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recreateStartTime).count();
+	std::cout << "Swapchain >> " << swapchainExtent.width << "x" << swapchainExtent.height << " in " << recreateTime << " ms" << std::endl;
+}
+
+void VulkanRenderer::destroySwapchainResources()
+{
+	for (const auto& framebuffer : swapchainFramebuffer) {
+		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	}
+
+	vkDestroyImageView(device, depthImageView, nullptr);
+	allocator->free(depthImageAllocation);
+	vkDestroyImage(device, depthImage, nullptr);
+
+	vkDestroyImageView(device, colorImageView, nullptr);
+	allocator->free(colorImageAllocation);
+	vkDestroyImage(device, colorImage, nullptr);
+
+	for (const auto& imageView : swapchainImageViews) {
+		vkDestroyImageView(device, imageView, nullptr);
+	}
+}
+
+void VulkanRenderer::createOffscreenImages()
+{
+	PROFILE_FUNCTION();
+
+	/*
+		Without a surface there is no swapchain, so headless mode renders to images of its own.
+		Every frame in flight gets one, in the format the swapchain would most likely have.
+	*/
+	swapchainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+	swapchainExtent = offscreenExtent;
+
+	swapchainImages.resize(FRAMES_IN_FLIGHT);
+	offscreenImageAllocations.resize(FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < swapchainImages.size(); i++) {
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = swapchainImageFormat;
+		imageInfo.extent.height = swapchainExtent.height;
+		imageInfo.extent.width = swapchainExtent.width;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		result = vkCreateImage(device, &imageInfo, nullptr, &swapchainImages[i]);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot create Offscreen Image.");
+		}
+
+		offscreenImageAllocations[i] = allocator->allocateImage(swapchainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+}
+
 void VulkanRenderer::createSwapchainImageViews()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Image View is an discription of an Image. Image view contain
 		information about Image, such as type (1D, 2D, 3D),
@@ -423,6 +643,8 @@ void VulkanRenderer::createSwapchainImageViews()
 
 void VulkanRenderer::createColorResources()
 {
+	PROFILE_FUNCTION();
+
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -443,24 +665,7 @@ void VulkanRenderer::createColorResources()
 		throw std::runtime_error("ERROR: cannot create Color Image.");
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(device, colorImage, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		device.physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &colorImageMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Color Image Memory.");
-	}
-
-	vkBindImageMemory(device, colorImage, colorImageMemory, 0);
+	colorImageAllocation = allocator->allocateImage(colorImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	VkImageViewCreateInfo imageViewInfo = {};
 	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -485,6 +690,8 @@ void VulkanRenderer::createColorResources()
 
 void VulkanRenderer::createDepthResources()
 {
+	PROFILE_FUNCTION();
+
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -505,24 +712,7 @@ void VulkanRenderer::createDepthResources()
 		throw std::runtime_error("ERROR: cannot create Depth Image.");
 	}
 
-	VkMemoryRequirements memRequirements = {};
-	vkGetImageMemoryRequirements(device, depthImage, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		device.physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &depthImageMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate Depth Image Memory.");
-	}
-
-	vkBindImageMemory(device, depthImage, depthImageMemory, 0);
+	depthImageAllocation = allocator->allocateImage(depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	VkImageViewCreateInfo imageViewInfo = {};
 	imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -547,6 +737,8 @@ void VulkanRenderer::createDepthResources()
 
 void VulkanRenderer::createRenderPass()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Render Pass is where rendering commands are executed.
 		
@@ -585,7 +777,8 @@ void VulkanRenderer::createRenderPass()
 	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Offscreen images are never presented, leave them ready to be copied from
+	colorAttachmentResolve.finalLayout = isHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorReference = {};
 	colorReference.attachment = 0;
@@ -637,6 +830,8 @@ void VulkanRenderer::createRenderPass()
 
 void VulkanRenderer::createSwapchainFramebuffers()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Framebuffer represent memory of attachment used in Render Pass.
 	*/
@@ -667,183 +862,73 @@ void VulkanRenderer::createSwapchainFramebuffers()
 
 void VulkanRenderer::createGraphicsPipeline()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Graphics Pipeline is an list of stages required to render image.
 
 		There we describe different stages like shaders, restarization, depth, etc.
+		The pipelines themselves come from pipelineVariants, which only builds them for state it has not seen.
+		Phong and Gouraud differ only in their shaders.
 	*/
 
-	// SHADERS
-	Shader vertShader(device, "shaders/phong_vert.spv");
-	Shader fragShader(device, "shaders/phong_frag.spv");
-
-	VkPipelineShaderStageCreateInfo vertStageInfo = {};
-	vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertStageInfo.module = vertShader.getShaderModule();
-	vertStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragStageInfo = {};
-	fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragStageInfo.module = fragShader.getShaderModule();
-	fragStageInfo.pName = "main";
-
-	std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
-		vertStageInfo,
-		fragStageInfo,
-	};
-
-	// VERTEX INPUT STATE
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	// INPUT ASSEMBLY STATE
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-	// VIEWPORT STATE
-	VkViewport viewport = {};
-	viewport.x = 0;
-	viewport.y = 0;
-	viewport.width = static_cast<float>(swapchainExtent.width);
-	viewport.height = static_cast<float>(swapchainExtent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.extent = swapchainExtent;
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-
-	VkPipelineViewportStateCreateInfo viewportInfo = {};
-	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportInfo.viewportCount = 1;
-	viewportInfo.pViewports = &viewport;
-	viewportInfo.scissorCount = 1;
-	viewportInfo.pScissors = &scissor;
-
-	// RASTERIZATION STATE
-	VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
-	rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationInfo.depthClampEnable = VK_FALSE;
-	rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
-	rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizationInfo.depthBiasEnable = VK_FALSE;
-	rasterizationInfo.lineWidth = 1.0f;
-
-	// MULTISAMPLE STATE
-	VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
-	multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleInfo.sampleShadingEnable = VK_FALSE;
-	multisampleInfo.rasterizationSamples = MSSA_SAMPLES;
-
-	// DEPTH STENCIL STATE
-	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
-	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_TRUE;
-	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
-	depthStencilInfo.stencilTestEnable = VK_FALSE;
-
-	// COLOR BLEND STATE
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT
-		| VK_COLOR_COMPONENT_G_BIT
-		| VK_COLOR_COMPONENT_B_BIT
-		| VK_COLOR_COMPONENT_A_BIT;
-
-	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
-	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendInfo.logicOpEnable = VK_FALSE;
-	colorBlendInfo.attachmentCount = 1;
-	colorBlendInfo.pAttachments = &colorBlendAttachment;
-
 	// PIPELINE LAYOUT
+	VkPushConstantRange vertexDecodeRange = {};
+	vertexDecodeRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	vertexDecodeRange.offset = 0;
+	vertexDecodeRange.size = sizeof(VertexDecode);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &vertexDecodeRange;
 
 	result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot create Pipeline Layout.");
 	}
 
-	// GRAPHICS PIPELINE
-	VkGraphicsPipelineCreateInfo graphicsPipelineInfo = {};
-	graphicsPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	graphicsPipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-	graphicsPipelineInfo.pStages = shaderStages.data();
-	graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
-	graphicsPipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-	graphicsPipelineInfo.pTessellationState = nullptr;
-	graphicsPipelineInfo.pViewportState = &viewportInfo;
-	graphicsPipelineInfo.pRasterizationState = &rasterizationInfo;
-	graphicsPipelineInfo.pMultisampleState = &multisampleInfo;
-	graphicsPipelineInfo.pDepthStencilState = &depthStencilInfo;
-	graphicsPipelineInfo.pColorBlendState = &colorBlendInfo;
-	graphicsPipelineInfo.pDynamicState = nullptr;
-	graphicsPipelineInfo.layout = pipelineLayout;
-	graphicsPipelineInfo.subpass = 0;
-	graphicsPipelineInfo.renderPass = renderPass;
-	graphicsPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	graphicsPipelineInfo.basePipelineIndex = -1;
-
-	result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, nullptr, &graphicsPipeline);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Graphics Pipeline.");
-	}
-
-	Shader gouraudVertShader(device, "shaders/gouraud_vert.spv");
-	Shader gouraudFragShader(device, "shaders/gouraud_frag.spv");
-
-	VkPipelineShaderStageCreateInfo gouraudVertStageInfo = {};
-	gouraudVertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	gouraudVertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	gouraudVertStageInfo.module = gouraudVertShader.getShaderModule();
-	gouraudVertStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo gouraudFragStageInfo = {};
-	gouraudFragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	gouraudFragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	gouraudFragStageInfo.module = gouraudFragShader.getShaderModule();
-	gouraudFragStageInfo.pName = "main";
-
-	std::vector<VkPipelineShaderStageCreateInfo> gouraudShaderStages = {
-		gouraudVertStageInfo, gouraudFragStageInfo
+	// VERTEX INPUT STATE
+	// Binding 0 is the mesh's vertices, binding 1 the instance transforms
+	phongDescription.bindingDescriptions = {
+		Model::getBindingDescription(vertexFormat),
+		InstanceData::getBindingDescription()
 	};
+	auto attributeDescriptions = Model::getAttributeDescriptions(vertexFormat);
+	auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+	attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+	phongDescription.attributeDescriptions = attributeDescriptions;
+
+	phongDescription.layout = pipelineLayout;
+	phongDescription.renderPass = renderPass;
+	phongDescription.subpass = 0;
+	phongDescription.colorAttachmentCount = 1;
+	phongDescription.samples = MSSA_SAMPLES;
+	phongDescription.hasDepth = true;
+
+	phongDescription.cullMode = VK_CULL_MODE_BACK_BIT;
+	phongDescription.depthTestEnable = true;
+	phongDescription.depthWriteEnable = true;
+	phongDescription.depthCompareOp = VK_COMPARE_OP_LESS;
 
-	graphicsPipelineInfo.stageCount = static_cast<uint32_t>(gouraudShaderStages.size());
-	graphicsPipelineInfo.pStages = gouraudShaderStages.data();
+	// SHADERS
+	gouraudDescription = phongDescription;
 
-	result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineInfo, nullptr, &gouraudPipeline);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create Graphics Pipeline.");
-	}
-}
+	phongDescription.vertShaderPath = vertexFormat == VERTEX_FORMAT_FLOAT ? "shaders/phong_vert.spv" : "shaders/phong_packed_vert.spv";
+	phongDescription.fragShaderPath = "shaders/phong_frag.spv";
+	gouraudDescription.vertShaderPath = vertexFormat == VERTEX_FORMAT_FLOAT ? "shaders/gouraud_vert.spv" : "shaders/gouraud_packed_vert.spv";
+	gouraudDescription.fragShaderPath = "shaders/gouraud_frag.spv";
 
-void VulkanRenderer::createGouraudPipeline()
-{
+	graphicsPipeline = pipelineVariants->get(phongDescription);
+	gouraudPipeline = pipelineVariants->get(gouraudDescription);
 }
 
 void VulkanRenderer::createCommandPool()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Command Buffer's memory allocated from Command Pool.
 	*/
@@ -860,6 +945,8 @@ void VulkanRenderer::createCommandPool()
 
 void VulkanRenderer::createCommandBuffers()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Command Buffer are object where command are recorded.
 
@@ -882,6 +969,8 @@ void VulkanRenderer::createCommandBuffers()
 
 void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
+	PROFILE_FUNCTION();
+
 	/*
 		There command are recorded to Command Buffer. Such as begining of render pass
 		(required if we want render something), pipeline binding, draw commands, etc.
@@ -896,6 +985,10 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 		throw std::runtime_error("ERROR: cannot begin Command Buffer recording.");
 	}
 
+	gpuProfiler->beginFrame(commandBuffer, currentFrame, frameNumber);
+
+	recordSceneCommandBuffers(imageIndex);
+
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassBeginInfo.renderPass = renderPass;
@@ -915,47 +1008,182 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassBeginInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Only vkCmdExecuteCommands is allowed in a subpass recorded in Secondary Command Buffers, so the scope encloses the whole render pass
+	gpuProfiler->beginScope(commandBuffer, gouraudMode ? "Gouraud" : "Phong");
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 	
-		if (gouraudMode) {
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gouraudPipeline);
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(sceneCommandBuffers.size()), sceneCommandBuffers.data());
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	gpuProfiler->endScope(commandBuffer);
+
+	gpuProfiler->endFrame(commandBuffer);
+
+	result = vkEndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot end Command Buffer recording.");
+	}
+}
+
+void VulkanRenderer::createThreadCommandPools()
+{
+	PROFILE_FUNCTION();
+
+	/*
+		Command Pools are not thread safe, so every thread records from a pool of its own.
+		Pools are also per frame in flight, so a whole pool can be reset once the frame's fence signaled.
+	*/
+	threadCommands.resize(FRAMES_IN_FLIGHT);
+
+	for (auto& frameCommands : threadCommands) {
+		frameCommands.resize(threadPool->getThreadCount());
+
+		for (ThreadCommands& commands : frameCommands) {
+			VkCommandPoolCreateInfo commandPoolInfo = {};
+			commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			commandPoolInfo.queueFamilyIndex = queues.graphicsQueueIndex.value();
+
+			result = vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commands.commandPool);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("ERROR: cannot create Thread Command Pool.");
+			}
+		}
+	}
+}
+
+void VulkanRenderer::recordSceneCommandBuffers(uint32_t imageIndex)
+{
+	PROFILE_FUNCTION();
+
+	/*
+		Every scene batch is one instanced draw, and the batches cover the instance buffer back to back.
+		The instances are split into contiguous ranges that worker threads record into Secondary Command
+		Buffers in parallel, so a batch can be drawn in pieces by several threads. The primary executes
+		them in range order in the render pass.
+	*/
+	std::vector<ThreadCommands>& frameCommands = threadCommands[currentFrame];
+	for (ThreadCommands& commands : frameCommands) {
+		vkResetCommandPool(device, commands.commandPool, 0);
+		commands.usedCount = 0;
+	}
+
+	uint32_t sceneInstanceCount = scene->getInstanceCount();
+	uint32_t jobCount = std::clamp((sceneInstanceCount + MIN_INSTANCES_PER_THREAD - 1) / MIN_INSTANCES_PER_THREAD, 1u, threadPool->getThreadCount());
+
+	sceneCommandBuffers.resize(jobCount);
+
+	threadPool->run(jobCount, [&](uint32_t jobIndex, uint32_t threadIndex) {
+		uint32_t firstInstance = static_cast<uint32_t>(uint64_t(jobIndex) * sceneInstanceCount / jobCount);
+		uint32_t lastInstance = static_cast<uint32_t>(uint64_t(jobIndex + 1) * sceneInstanceCount / jobCount);
+
+		VkCommandBuffer commandBuffer = getSecondaryCommandBuffer(frameCommands[threadIndex]);
+		recordDrawCalls(commandBuffer, imageIndex, firstInstance, lastInstance);
+		sceneCommandBuffers[jobIndex] = commandBuffer;
+	});
+}
+
+VkCommandBuffer VulkanRenderer::getSecondaryCommandBuffer(ThreadCommands& commands)
+{
+	// Buffers survive pool resets, so they are only allocated the first time a thread needs that many
+	if (commands.usedCount == commands.commandBuffers.size()) {
+		VkCommandBufferAllocateInfo commandBufferInfo = {};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.commandPool = commands.commandPool;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		commandBufferInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		VkResult allocateResult = vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer);
+		if (allocateResult != VK_SUCCESS) {
+			throw std::runtime_error("ERROR: cannot allocate Secondary Command Buffer.");
 		}
-		else
-		{
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+		commands.commandBuffers.push_back(commandBuffer);
+	}
+
+	return commands.commandBuffers[commands.usedCount++];
+}
+
+void VulkanRenderer::recordDrawCalls(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t lastInstance)
+{
+	PROFILE_FUNCTION();
+
+	// Runs on worker threads, so it keeps its VkResult to itself
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapchainFramebuffer[imageIndex];
+
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VkResult recordResult = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+	if (recordResult != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot begin Secondary Command Buffer recording.");
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gouraudMode ? gouraudPipeline : graphicsPipeline);
+	// Secondary Command Buffers do not inherit dynamic state, every one sets its own
+	pipelineVariants->setDynamicState(commandBuffer, gouraudMode ? gouraudDescription : phongDescription, swapchainExtent);
+
+	// Dynamic offsets go in binding order: MVP (binding 0), then light (binding 2)
+	std::array<uint32_t, 2> dynamicOffsets = { uniformOffsets.mvp, uniformOffsets.light };
+	// firstInstance of a batch indexes the transforms in this frame's instance buffer
+	const std::vector<Scene::Batch>& batches = scene->getBatches();
+	VkBuffer instanceBuffer = scene->getInstanceBuffer(currentFrame);
+
+	Model* boundModel = nullptr;
+	for (const Scene::Batch& batch : batches) {
+		// The part of the batch inside this range of instances
+		uint32_t batchFirst = std::max(batch.firstInstance, firstInstance);
+		uint32_t batchLast = std::min(batch.firstInstance + batch.instanceCount, lastInstance);
+		if (batchFirst >= batchLast) {
+			continue;
 		}
 
-		VkBuffer vertexBuffers[] = {model->getVertexBuffer()};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		Model* model = scene->getModel(batch.meshIndex);
 
-		VkBuffer indexBuffer = model->getIndexBuffer();
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		if (model != boundModel) {
+			boundModel = model;
 
-		vkCmdBindDescriptorSets(
-			commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0,
-			1,
-			&descriptorSet,
-			0,
-			nullptr
-		);
+			VkBuffer vertexBuffers[] = { boundModel->getVertexBuffer(), instanceBuffer };
+			VkDeviceSize offsets[] = { 0, 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, boundModel->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 
-		uint32_t indexCount = model->getIndexCount();
-		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+			vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				pipelineLayout,
+				0,
+				1,
+				&descriptorSets[batch.meshIndex],
+				static_cast<uint32_t>(dynamicOffsets.size()),
+				dynamicOffsets.data()
+			);
 
-	vkCmdEndRenderPass(commandBuffer);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecode), &boundModel->getVertexDecode());
+		}
 
-	result = vkEndCommandBuffer(commandBuffer);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot end Command Buffer recording.");
+		vkCmdDrawIndexed(commandBuffer, boundModel->getIndexCount(), batchLast - batchFirst, boundModel->getFirstIndex(), boundModel->getVertexOffset(), batchFirst);
+	}
+
+	recordResult = vkEndCommandBuffer(commandBuffer);
+	if (recordResult != VK_SUCCESS) {
+		throw std::runtime_error("ERROR: cannot end Secondary Command Buffer recording.");
 	}
 }
 
 void VulkanRenderer::createSyncTools()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		Vulkan have synchronization tools such as Semaphore and Fence.
 
@@ -995,63 +1223,52 @@ void VulkanRenderer::createSyncTools()
 	}
 }
 
-void VulkanRenderer::createMVPBuffer()
+void VulkanRenderer::readFrameTimestamps(uint32_t frameIndex)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	bufferInfo.size = sizeof(MVP);
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	result = vkCreateBuffer(device, &bufferInfo, nullptr, &mvpBuffer);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot create MVP buffer.");
-	}
-
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, mvpBuffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memRequirements.size;
-	allocateInfo.memoryTypeIndex = findMemoryType(
-		device.physicalDevice,
-		memRequirements.memoryTypeBits,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
-
-	result = vkAllocateMemory(device, &allocateInfo, nullptr, &mvpBufferMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot allocate MVP Buffer Memory.");
+	if (gpuProfiler->readFrame(frameIndex) && benchmark) {
+		benchmark->setGpuTime(gpuProfiler->getFrameNumber(), gpuProfiler->getFrameTime());
 	}
-
-	vkBindBufferMemory(device, mvpBuffer, mvpBufferMemory, 0);
-
-	vkMapMemory(device, mvpBufferMemory, 0, sizeof(MVP), 0, &mvpBufferMapped);
 }
 
-void VulkanRenderer::updateMVPBuffer()
+void VulkanRenderer::updateUniforms(uint32_t frameIndex)
 {
+	PROFILE_FUNCTION();
+
+	/*
+		Per-frame uniform data is written to the ring region of this frame, which the GPU
+		stopped reading when the frame's fence signaled. The returned offsets are bound as
+		dynamic offsets, so frames in flight never see each other's data.
+	*/
+	uniformRing->beginFrame(frameIndex);
+
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+	// Headless runs animate by frame number at 60 FPS, so every run renders the same frames
+	if (isHeadless) {
+		deltaTime = frameNumber / 60.0f;
+	}
 	
 	mvp.model = glm::mat4(1.0f);
 	mvp.model = glm::rotate(mvp.model, deltaTime * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	mvp.view = camera->getViewMatrix();
-	mvp.projection = glm::perspective(glm::radians(camera->getFOV()), swapchainExtent.width / (float)swapchainExtent.height, 0.1f, 10.f);
+	mvp.projection = glm::perspective(glm::radians(camera->getFOV()), swapchainExtent.width / (float)swapchainExtent.height, 0.1f, farPlane);
 	mvp.projection[1][1] *= -1;
 
-	memcpy(mvpBufferMapped, &mvp, sizeof(MVP));
+	uniformOffsets.mvp = uniformRing->push(mvp);
+	uniformOffsets.light = uniformRing->push(light->getProperties());
 }
 
 void VulkanRenderer::createDescriptorSetLayout()
 {
+	PROFILE_FUNCTION();
+
 	VkDescriptorSetLayoutBinding mvpLayoutBinding = {};
 	mvpLayoutBinding.binding = 0;
 	mvpLayoutBinding.descriptorCount = 1;
-	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	mvpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	mvpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	mvpLayoutBinding.pImmutableSamplers = nullptr;
 
@@ -1065,7 +1282,7 @@ void VulkanRenderer::createDescriptorSetLayout()
 	VkDescriptorSetLayoutBinding lightLayoutBinding = {};
 	lightLayoutBinding.binding = 2;
 	lightLayoutBinding.descriptorCount = 1;
-	lightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	lightLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	lightLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT;
 	lightLayoutBinding.pImmutableSamplers = nullptr;
 
@@ -1084,17 +1301,22 @@ void VulkanRenderer::createDescriptorSetLayout()
 
 void VulkanRenderer::createDescriptorPool()
 {
+	PROFILE_FUNCTION();
+
+	// A set per scene mesh, they differ by texture only
+	uint32_t setCount = scene->getMeshCount();
+
 	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
-	poolSizes[0].descriptorCount = 1;
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[1].descriptorCount = 1;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = setCount;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[2].descriptorCount = 1;
-	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[2].descriptorCount = setCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.maxSets = 1;
+	descriptorPoolInfo.maxSets = setCount;
 	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	descriptorPoolInfo.pPoolSizes = poolSizes.data();
 
@@ -1104,65 +1326,76 @@ void VulkanRenderer::createDescriptorPool()
 	}
 }
 
-void VulkanRenderer::createDescriptorSet()
+void VulkanRenderer::createDescriptorSets()
 {
+	PROFILE_FUNCTION();
+
+	descriptorSets.resize(scene->getMeshCount());
+	std::vector<VkDescriptorSetLayout> layouts(descriptorSets.size(), descriptorSetLayout);
+
 	VkDescriptorSetAllocateInfo allocateInfo = {};
 	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocateInfo.descriptorPool = descriptorPool;
-	allocateInfo.descriptorSetCount = 1;
-	allocateInfo.pSetLayouts = &descriptorSetLayout;
+	allocateInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+	allocateInfo.pSetLayouts = layouts.data();
 
-	result = vkAllocateDescriptorSets(device, &allocateInfo, &descriptorSet);
+	result = vkAllocateDescriptorSets(device, &allocateInfo, descriptorSets.data());
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("ERROR: cannot allocate Descriptor Set.");
 	}
 
-	VkDescriptorBufferInfo descriptorBufferInfo = {};
-	descriptorBufferInfo.buffer = mvpBuffer;
-	descriptorBufferInfo.offset = 0;
-	descriptorBufferInfo.range = sizeof(MVP);
-
-	VkDescriptorImageInfo descriptorImageInfo = {};
-	descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	descriptorImageInfo.imageView = texture->getImageView();
-	descriptorImageInfo.sampler = texture->getSampler();
-
-	VkDescriptorBufferInfo lightDescriptorInfo = {};
-	lightDescriptorInfo.buffer = light->getBuffer();
-	lightDescriptorInfo.offset = 0;
-	lightDescriptorInfo.range = sizeof(Light::Properties);
-
-	std::array<VkWriteDescriptorSet, 3> writeSets = {};
-
-	writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSets[0].dstSet = descriptorSet;
-	writeSets[0].dstBinding = 0;
-	writeSets[0].dstArrayElement = 0;
-	writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writeSets[0].descriptorCount = 1;
-	writeSets[0].pBufferInfo = &descriptorBufferInfo;
-
-	writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSets[1].dstSet = descriptorSet;
-	writeSets[1].dstBinding = 1;
-	writeSets[1].dstArrayElement = 0;
-	writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	writeSets[1].descriptorCount = 1;
-	writeSets[1].pImageInfo = &descriptorImageInfo;
-
-	writeSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeSets[2].dstSet = descriptorSet;
-	writeSets[2].dstBinding = 2;
-	writeSets[2].dstArrayElement = 0;
-	writeSets[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	writeSets[2].descriptorCount = 1;
-	writeSets[2].pBufferInfo = &lightDescriptorInfo;
-
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+	for (uint32_t i = 0; i < descriptorSets.size(); i++) {
+		Texture* texture = scene->getTexture(i);
+
+		VkDescriptorBufferInfo descriptorBufferInfo = {};
+		descriptorBufferInfo.buffer = uniformRing->getBuffer();
+		descriptorBufferInfo.offset = 0;
+		descriptorBufferInfo.range = sizeof(MVP);
+
+		VkDescriptorImageInfo descriptorImageInfo = {};
+		descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		descriptorImageInfo.imageView = texture->getImageView();
+		descriptorImageInfo.sampler = texture->getSampler();
+
+		VkDescriptorBufferInfo lightDescriptorInfo = {};
+		lightDescriptorInfo.buffer = uniformRing->getBuffer();
+		lightDescriptorInfo.offset = 0;
+		lightDescriptorInfo.range = sizeof(Light::Properties);
+
+		std::array<VkWriteDescriptorSet, 3> writeSets = {};
+
+		writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[0].dstSet = descriptorSets[i];
+		writeSets[0].dstBinding = 0;
+		writeSets[0].dstArrayElement = 0;
+		writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeSets[0].descriptorCount = 1;
+		writeSets[0].pBufferInfo = &descriptorBufferInfo;
+
+		writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[1].dstSet = descriptorSets[i];
+		writeSets[1].dstBinding = 1;
+		writeSets[1].dstArrayElement = 0;
+		writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeSets[1].descriptorCount = 1;
+		writeSets[1].pImageInfo = &descriptorImageInfo;
+
+		writeSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeSets[2].dstSet = descriptorSets[i];
+		writeSets[2].dstBinding = 2;
+		writeSets[2].dstArrayElement = 0;
+		writeSets[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeSets[2].descriptorCount = 1;
+		writeSets[2].pBufferInfo = &lightDescriptorInfo;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeSets.size()), writeSets.data(), 0, nullptr);
+	}
 }
 
 void VulkanRenderer::choosePhysicalDevice()
 {
+	PROFILE_FUNCTION();
+
 	/*
 	Physical devices represent GPUs installed in the system.
 	We can obtain properties of GPU and choose what device we want to use.
@@ -1192,19 +1425,13 @@ void VulkanRenderer::cleanup()
 	*/
 	delete light;
 	delete camera;
-	delete texture;
-	delete model;
-
-	vkDestroyImageView(device, depthImageView, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
+	delete benchmark;
+	delete scene;
+	delete meshArena;
 
-	vkDestroyImageView(device, colorImageView, nullptr);
-	vkFreeMemory(device, colorImageMemory, nullptr);
-	vkDestroyImage(device, colorImage, nullptr);
+	destroySwapchainResources();
 
-	vkFreeMemory(device, mvpBufferMemory, nullptr);
-	vkDestroyBuffer(device, mvpBuffer, nullptr);
+	delete uniformRing;
 
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
@@ -1215,26 +1442,38 @@ void VulkanRenderer::cleanup()
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 	}
 
+	delete gpuProfiler;
+
+	for (auto& frameCommands : threadCommands) {
+		for (ThreadCommands& commands : frameCommands) {
+			vkDestroyCommandPool(device, commands.commandPool, nullptr);
+		}
+	}
+	delete threadPool;
+
 	vkDestroyCommandPool(device, commandPool, nullptr);
 
-	vkDestroyPipeline(device, gouraudPipeline, nullptr);
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
+	delete pipelineVariants;
 
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
-	for (const auto& framebuffer : swapchainFramebuffer) {
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-	}
-
 	vkDestroyRenderPass(device, renderPass, nullptr);
 
-	for (const auto& imageView : swapchainImageViews) {
-		vkDestroyImageView(device, imageView, nullptr);
+	if (isHeadless) {
+		for (size_t i = 0; i < swapchainImages.size(); i++) {
+			vkDestroyImage(device, swapchainImages[i], nullptr);
+			allocator->free(offscreenImageAllocations[i]);
+		}
+	}
+	else {
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
+		vkDestroySurfaceKHR(instance, surface, nullptr);
 	}
 
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
+	pipelineCache->save();
+	delete pipelineCache;
 
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	delete allocator;
 
 	vkDestroyDevice(device, nullptr);
 
@@ -1244,13 +1483,16 @@ void VulkanRenderer::cleanup()
 
 	vkDestroyInstance(instance, nullptr);
 
-	glfwDestroyWindow(window);
-
-	glfwTerminate();
+	if (!isHeadless) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 }
 
 void VulkanRenderer::draw()
 {
+	PROFILE_FUNCTION();
+
 	/*
 		This is where rendering and presentation is going.
 
@@ -1260,18 +1502,43 @@ void VulkanRenderer::draw()
 		Or image is available to start rendering.
 	*/
 
-	static uint32_t currentFrame = 0;
-
+	auto fenceWaitStartTime = std::chrono::high_resolution_clock::now();
 	// waits while fence will be in state Singaled
-	vkWaitForFences(device, 1, &bufferFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// reset Fence to Unsignaled state
-	vkResetFences(device, 1, &bufferFences[currentFrame]);
+	{
+		PROFILE_SCOPE("vkWaitForFences");
+		vkWaitForFences(device, 1, &bufferFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	fenceWaitTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - fenceWaitStartTime).count();
 
 	uint32_t imageIndex;
-	// Acquire next image and signals that image is available (change imageAvailableSemaphore).
-	vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	if (isHeadless) {
+		// Every frame in flight has an offscreen image of its own, which the fence above already guards
+		imageIndex = currentFrame;
+	}
+	else {
+		// Acquire next image and signals that image is available (change imageAvailableSemaphore).
+		PROFILE_SCOPE("vkAcquireNextImageKHR");
+		result = vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+		// Nothing was submitted and the fence is still signaled, so the frame can simply be skipped
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			recreateSwapchain();
+			return;
+		}
+		// A suboptimal swapchain can still be presented to, it is recreated after the present
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("ERROR: cannot acquire Swapchain Image.");
+		}
+	}
+
+	// reset Fence to Unsignaled state, only once work that signals it is sure to be submitted
+	vkResetFences(device, 1, &bufferFences[currentFrame]);
 
-	updateMVPBuffer();
+	// The previous frame in this slot is done, so are its timestamps
+	readFrameTimestamps(currentFrame);
+
+	updateUniforms(currentFrame);
+	scene->update(currentFrame);
 
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
 	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
@@ -1280,12 +1547,12 @@ void VulkanRenderer::draw()
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = isHeadless ? 0 : 1;
 	submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = isHeadless ? 0 : 1;
 	submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
 
 	// Fence become Signaled
@@ -1294,35 +1561,90 @@ void VulkanRenderer::draw()
 		throw std::runtime_error("ERROR: cannot submit Graphics Queue.");
 	}
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &swapchain;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = nullptr;
+	frameNumber++;
 
-	result = vkQueuePresentKHR(queues.presentQueue, &presentInfo);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("ERROR: cannot Present Image.");
+	if (!isHeadless) {
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &swapchain;
+		presentInfo.pImageIndices = &imageIndex;
+		presentInfo.pResults = nullptr;
+
+		result = vkQueuePresentKHR(queues.presentQueue, &presentInfo);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR) {
+			throw std::runtime_error("ERROR: cannot Present Image.");
+		}
 	}
 
 	currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
+
+	if (!isHeadless && (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR || isFramebufferResized)) {
+		recreateSwapchain();
+	}
+}
+
+void VulkanRenderer::createScene()
+{
+	PROFILE_FUNCTION();
+
+	std::string modelsPath = MODELS_DIR;
+	std::string texturesPath = TEXTURES_DIR;
+
+	// Integrated GPUs share memory with the host, so staging the geometry would only add a copy
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.physicalDevice, &properties);
+
+	MeshArena::MEMORY_MODE memoryMode = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+		? MeshArena::HOST_VISIBLE
+		: MeshArena::DEVICE_LOCAL;
+
+	meshArena = new MeshArena(device, allocator, commandPool, queues.graphicsQueue, Model::getBindingDescription(vertexFormat).stride, memoryMode);
+	scene = new Scene(device, allocator, FRAMES_IN_FLIGHT);
+
+	uint32_t headMesh = createModel(modelsPath + "/head.obj", texturesPath + "/head.tga");
+
+	/*
+		Copies of the head go on a square grid in the XZ plane, centered on the origin.
+		They share the mesh, so the whole grid is a single instanced draw.
+	*/
+	const float spacing = 2.5f;
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(float(instanceCount))));
+	float gridOffset = (gridSize - 1) * spacing * 0.5f;
+
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		glm::vec3 position((i % gridSize) * spacing - gridOffset, 0.0f, (i / gridSize) * spacing - gridOffset);
+		scene->addInstance(headMesh, glm::translate(glm::mat4(1.0f), position));
+	}
+
+	farPlane = std::max(farPlane, 10.0f + gridSize * spacing);
+
+	std::cout << "Scene >> " << scene->getInstanceCount() << " instances of " << scene->getMeshCount() << " meshes" << std::endl;
 }
 
-void VulkanRenderer::createModel(std::string modelPath, std::string texturePath)
+uint32_t VulkanRenderer::createModel(std::string modelPath, std::string texturePath)
 {
-	model = new Model(modelPath, texturePath, device, device.physicalDevice);
-	texture = new Texture(texturePath, device, device.physicalDevice, commandPool, queues.graphicsQueueIndex.value(), queues.graphicsQueue);
+	PROFILE_FUNCTION();
+
+	Model* model = new Model(modelPath, texturePath, meshArena, vertexFormat);
+	Texture* texture = new Texture(texturePath, device, device.physicalDevice, allocator, commandPool, queues.graphicsQueueIndex.value(), queues.graphicsQueue);
+
+	return scene->addMesh(model, texture);
 }
 
 std::vector<const char*> VulkanRenderer::getRequiredExtensions()
 {
-	uint32_t extensionCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + extensionCount);
+	// Surface extensions are only needed to present to a window
+	if (!isHeadless) {
+		uint32_t extensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+
+		extensions.assign(glfwExtensions, glfwExtensions + extensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1338,6 +1660,11 @@ bool VulkanRenderer::isPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice)
 	
 	findQueueFamilyIndeces(physicalDevice);
 
+	// Headless mode runs on whatever can render, including integrated GPUs and software implementations like lavapipe
+	if (isHeadless) {
+		return queues.isComplete();
+	}
+
 	bool extensionSupported = isDeviceSupportExtensions(physicalDevice);
 
 	bool swapchainAdequate = false;
@@ -1366,8 +1693,14 @@ void VulkanRenderer::findQueueFamilyIndeces(VkPhysicalDevice physicalDevice)
 			queues.graphicsQueueIndex = i;
 		}
 
+		// Nothing is presented in headless mode, the graphics queue stands in for the present queue
 		VkBool32 presentSupported = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupported);
+		if (isHeadless) {
+			presentSupported = (queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupported);
+		}
 
 		if (presentSupported) {
 			queues.presentQueueIndex = i;
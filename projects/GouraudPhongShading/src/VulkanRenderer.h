@@ -10,7 +10,16 @@
 #include "Camera.h"
 #include "Model.h"
 #include "Texture.h"
+#include "Scene.h"
+#include "MeshArena.h"
 #include "Light.h"
+#include "MemoryAllocator.h"
+#include "UniformRing.h"
+#include "PipelineCache.h"
+#include "PipelineVariants.h"
+#include "Benchmark.h"
+#include "GpuProfiler.h"
+#include "ThreadPool.h"
 
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
@@ -21,6 +30,19 @@ const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
+/*
+	How the scene's instances reach the G-buffer subpass.
+
+	CULLING_OFF records an instanced draw per mesh into Secondary Command Buffers.
+	CULLING_CPU and CULLING_GPU frustum cull the instances and draw the survivors with indirect draws,
+	culling on the host or in a compute pass.
+*/
+enum CULLING_MODE {
+	CULLING_OFF,
+	CULLING_CPU,
+	CULLING_GPU
+};
+
 struct SwapchainSupportDetails {
 	VkSurfaceCapabilitiesKHR capabilities;
 	std::vector<VkSurfaceFormatKHR> surfaceFormats;
@@ -31,9 +53,12 @@ class VulkanRenderer
 {
 public:
 
-	VulkanRenderer(bool enableValidationLayers = true);
+	// instanceCount copies of the model are laid out on a grid
+	VulkanRenderer(bool enableValidationLayers = true, uint32_t instanceCount = 1, CULLING_MODE cullingMode = CULLING_GPU, VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT);
 
 	void start(int windowWidth, int windowHeight, const char* windowTitle);
+	// Render frameCount + warmupFrames frames offscreen without a window and report their timings
+	void startHeadless(int width, int height, uint32_t frameCount, uint32_t warmupFrames, std::string outputPath);
 
 private:
 
@@ -42,35 +67,75 @@ private:
 
 	Camera* camera;
 	
-	Model* model = nullptr;
-	Texture* texture = nullptr;
+	Scene* scene = nullptr;
+	// Geometry of every scene mesh
+	MeshArena* meshArena = nullptr;
+	CULLING_MODE cullingMode = CULLING_OFF;
+	uint32_t instanceCount = 1;
+	// Packed formats draw with the *_packed_vert.spv shaders
+	VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FLOAT;
+	// Far clip plane, pushed out to fit the scene
+	float farPlane = 10.0f;
 	Light* light = nullptr;
+	MemoryAllocator* allocator = nullptr;
+	UniformRing* uniformRing = nullptr;
+	PipelineCache* pipelineCache = nullptr;
+	PipelineVariants* pipelineVariants = nullptr;
+	bool isExtendedDynamicStateSupported = false;
+	Benchmark* benchmark = nullptr;
+	GpuProfiler* gpuProfiler = nullptr;
+	ThreadPool* threadPool = nullptr;
 	bool gouraudMode = false;
 	
 	VkResult result = VK_SUCCESS;
 	bool enableValidationLayers;
+	bool isHeadless = false;
+	// Set by framebufferResizeCallback, the swapchain is recreated after the next present
+	bool isFramebufferResized = false;
 
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkFormat swapchainImageFormat;
 	VkExtent2D swapchainExtent;
 	std::vector<VkImage> swapchainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	std::vector<VkFramebuffer> swapchainFramebuffer;
+	// Headless mode renders to these instead of swapchain images
+	VkExtent2D offscreenExtent;
+	std::vector<MemoryAllocator::Allocation> offscreenImageAllocations;
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
+	// Owned by pipelineVariants, the descriptions also give the dynamic state to record with them
 	VkPipeline graphicsPipeline;
 	VkPipeline gouraudPipeline;
+	PipelineVariants::Description phongDescription;
+	PipelineVariants::Description gouraudDescription;
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
+
+	// Secondary Command Buffers of one thread in one frame in flight
+	struct ThreadCommands {
+		VkCommandPool commandPool;
+		std::vector<VkCommandBuffer> commandBuffers;
+		uint32_t usedCount = 0;
+	};
+	// [frame in flight][thread]
+	std::vector<std::vector<ThreadCommands>> threadCommands;
+	// Recorded for the current frame, executed in this order
+	std::vector<VkCommandBuffer> sceneCommandBuffers;
+
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 	std::vector<VkFence> bufferFences;
+	uint32_t currentFrame = 0;
+	uint32_t frameNumber = 0;
+	float fenceWaitTime = 0.0f;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorPool descriptorPool;
-	VkDescriptorSet descriptorSet;
+	// One per scene mesh
+	std::vector<VkDescriptorSet> descriptorSets;
 
 	struct {
 		VkPhysicalDevice physicalDevice;
@@ -98,23 +163,27 @@ private:
 		glm::mat4 projection;
 	} mvp;
 
-	VkBuffer mvpBuffer;
-	VkDeviceMemory mvpBufferMemory;
-	void* mvpBufferMapped;
+	// Dynamic offsets of this frame's uniform data in uniformRing
+	struct {
+		uint32_t mvp;
+		uint32_t light;
+	} uniformOffsets;
 
 	VkImage depthImage;
 	VkImageView depthImageView;
-	VkDeviceMemory depthImageMemory;
+	MemoryAllocator::Allocation depthImageAllocation;
 
 	VkImage colorImage;
 	VkImageView colorImageView;
-	VkDeviceMemory colorImageMemory;
+	MemoryAllocator::Allocation colorImageAllocation;
 
 	// Window
 	void initWindow(int windowWidth, int windowHeight, const char* windowTitle);
 	void loop();
+	void benchmarkLoop();
 	void processInput(float deltaTime);
 	static void mouseCallback(GLFWwindow* window, double xpos, double ypos);
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 	void fpsCounter(float deltaTime);
 
 	// Vulkan
@@ -125,6 +194,10 @@ private:
 	void createLogicalDevice();
 	void createSurface();
 	void createSwapchain();
+	// Keeps the render pass and pipelines, rebuilds what depends on the swapchain's images and size
+	void recreateSwapchain();
+	void destroySwapchainResources();
+	void createOffscreenImages();
 	void createSwapchainImageViews();
 	void createColorResources();
 	void createRenderPass();
@@ -132,20 +205,24 @@ private:
 	void createSwapchainFramebuffers();
 	void createDescriptorSetLayout();
 	void createDescriptorPool();
-	void createDescriptorSet();
+	void createDescriptorSets();
 	void createGraphicsPipeline();
-	void createGouraudPipeline();
 	void createCommandPool();
 	void createCommandBuffers();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void createThreadCommandPools();
+	void recordSceneCommandBuffers(uint32_t imageIndex);
+	VkCommandBuffer getSecondaryCommandBuffer(ThreadCommands& commands);
+	void recordDrawCalls(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t lastInstance);
 	void createSyncTools();
-	void createMVPBuffer();
-	void updateMVPBuffer();
+	void readFrameTimestamps(uint32_t frameIndex);
+	void updateUniforms(uint32_t frameIndex);
 
 	void cleanup();
 	void draw();
 
-	void createModel(std::string modelPath, std::string texturePath);
+	void createScene();
+	uint32_t createModel(std::string modelPath, std::string texturePath);
 
 	// Support methods
 	std::vector<const char*> getRequiredExtensions();